@@ -1,11 +1,18 @@
-#include <Python.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <math.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
 
 #include "NeuroMorph.h"
+#include "dataset.h"
+#include "checkpoint.h"
+#include "server.h"
+#include "trace.h"
 
 #ifdef nm_sse
 #include <mm_malloc.h>
@@ -97,12 +104,6 @@ neuromorph_node* neuromorph_divergent_init(){
 	node->next = NULL;
 	node->prev = NULL;
 	node->type = DIVERGENT_NODE;
-	node->ready = 0;
-	node->back_ready = 0;
-	node->loop = 0;
-	node->loop_start = 0;
-	node->unrolled = 0;
-	node->unrolled_front = 0;
 	node->neuron_buffer = NULL;
 	node->neuron_buffer_raw = NULL;
 	node->buffer_size = 0;
@@ -113,10 +114,11 @@ neuromorph_node* neuromorph_divergent_init(){
 	node->activation_function = NULL;
 	node->activation_function_derivative = NULL;
 	node->activation_parameter = 0;
+	node->epilogue = NEUROMORPH_EPILOGUE_NONE;
+	node->softmax_cross_entropy = 0;
 	node->loss_function = NULL;
 	node->loss_function_derivative = NULL;
 	node->loss_parameter = 0;
-	node->expected = NULL;
 	node->previous_neuron_buffer = NULL;
 	node->previous_buffer_size = NULL;
 	node->additional_branches = NULL;
@@ -126,8 +128,6 @@ neuromorph_node* neuromorph_divergent_init(){
 	node->convergent_buffer_size = NULL;
 	node->convergence_function = NULL;
 	node->convergence_function_derivative = NULL;
-	pthread_mutex_init(&node->mutex, NULL);
-	pthread_cond_init(&node->cond, NULL);
 	node->gradient_buffer = NULL;
 	node->path_gradient_buffer = NULL;
 	node->previous_gradient_buffer = NULL;
@@ -135,6 +135,23 @@ neuromorph_node* neuromorph_divergent_init(){
 	node->previous_gradient_size = NULL;
 	node->backlog_offset = 0;
 	node->backlog_offset_activation = 0;
+	node->previous_activation_offset = 0;
+	node->previous_input = 0;
+	node->previous_owner = NULL;
+	node->convergent_owner = NULL;
+	node->convergent_activation_offset = 0;
+	node->convergent_input = 0;
+	node->recurrent = 0;
+	node->optimizer = NULL;
+	node->weight_state = NULL;
+	node->bias_state = NULL;
+	node->optimizer_step = 0;
+	node->parameter_offset = 0;
+	node->state_offset = 0;
+	node->name[0] = '\0';
+#ifdef nm_profile
+	memset(&node->profile, 0, sizeof(neuromorph_node_profile));
+#endif
 	return node;
 }
 
@@ -160,6 +177,7 @@ neuromorph_node* neuromorph_layer_init(size_t buffer_size, void (*activation)(fl
 	node->activation_function = activation;
 	node->activation_function_derivative = activation_derivative;
 	node->activation_parameter = parameter;
+	node->epilogue = neuromorph_epilogue_of(activation);
 	node->type = LAYER_NODE;
 	return node;
 }
@@ -169,12 +187,8 @@ neuromorph_node* neuromorph_output_init(size_t buffer_size, void (*activation)(f
 	node->loss_function = loss;
 	node->loss_function_derivative = loss_derivative;
 	node->loss_parameter = loss_parameter;
+	node->softmax_cross_entropy = activation == activation_softmax && loss == loss_cross_entropy;
 	node->type = OUTPUT_NODE;
-#ifdef nm_sse
-	node->expected = _mm_malloc(sizeof(float)*node->buffer_size, 16);
-#else
-	node->expected = malloc(sizeof(float)*node->buffer_size);
-#endif
 	return node;
 }
 
@@ -188,9 +202,8 @@ void neuromorph_node_free(neuromorph_node* node){
 		_mm_free(node->gradient_buffer);
 	}
 	_mm_free(node->path_gradient_buffer);
-	if (node->type == INPUT_NODE){
-		_mm_free(node->expected);
-	}
+	_mm_free(node->weight_state);
+	_mm_free(node->bias_state);
 #else
 	free(node->neuron_buffer);
 	free(node->neuron_buffer_raw);
@@ -200,9 +213,8 @@ void neuromorph_node_free(neuromorph_node* node){
 		free(node->gradient_buffer);
 	}
 	free(node->path_gradient_buffer);
-	if (node->type == INPUT_NODE){
-		free(node->expected);
-	}
+	free(node->weight_state);
+	free(node->bias_state);
 #endif
 	free(node->additional_branches);
 	free(node);
@@ -273,7 +285,6 @@ uint8_t neuromorph_link_destination(neuromorph_node* const source, neuromorph_no
 		if (source->neuron_buffer != NULL){
 			destination->previous_neuron_buffer = source->neuron_buffer;
 			destination->previous_buffer_size = &source->buffer_size;
-			destination->previous_buffer_size = &source->backlog_offset_activation;
 			destination->weight_buffer_size = source->buffer_size*destination->buffer_size;
 		}
 #ifdef nm_sse
@@ -300,8 +311,8 @@ uint8_t neuromorph_link_destination(neuromorph_node* const source, neuromorph_no
 				destination->path_gradient_buffer = _mm_malloc(sizeof(float)*destination->buffer_size, 16);
 #else
 				destination->neuron_buffer = malloc(sizeof(float)*destination->buffer_size);
-				destination->gradient_buffer = malloc(sizeof(float)*buffer_size);
-				destination->path_gradient_buffer = malloc(sizeof(float)*buffer_size);
+				destination->gradient_buffer = malloc(sizeof(float)*destination->buffer_size);
+				destination->path_gradient_buffer = malloc(sizeof(float)*destination->buffer_size);
 #endif
 				if (!destination->neuron_buffer){
 					fprintf(stderr, "could not allocate memory for neuron buffer during link\n");
@@ -341,16 +352,42 @@ void neuromorph_information_transfer_destination_link(neuromorph_node* const sou
 	destination->previous_backlog_offset = source->previous_backlog_offset;
 }
 
+static uint8_t precision_default = NEUROMORPH_PRECISION_ACCURATE;
+static __thread uint8_t neuromorph_precision_thread = NEUROMORPH_PRECISION_ACCURATE; // read by the transcendental kernels
+static const char* precision_names[NEUROMORPH_PRECISIONS] = {"exact", "accurate", "fast"};
+
 neuromorph* neuromorph_init(size_t batch_size, float learning_rate){
 	neuromorph* model = malloc(sizeof(neuromorph));
 	model->adjacency = adjacency_map_init();
 	model->input = NULL;
+	model->output = NULL;
 	model->batch_size = batch_size;
 	model->batch_backlog = NULL;
-	model->batch_expected = NULL;
+	model->description = NULL;
+	model->schedule = vector_init();
+	model->recurrent_sources = vector_init();
+	model->state_size = 0;
+	model->worker_count = neuromorph_default_workers();
+	model->workers_default = 1;
+	model->pool = NULL;
+	model->parameter_count = 0;
+	model->parameters = NULL;
+	model->parameter_map = NULL;
+	model->parameter_map_size = 0;
+	model->read_epoch = 0;
+	model->readers[0] = 0;
+	model->readers[1] = 0;
+	pthread_mutex_init(&model->publish_mutex, NULL);
+	model->widest_node = 0;
+	model->worker_gradients = NULL;
+	model->worker_gradient_slots = 0;
+	model->accumulation_steps = 1;
+	model->accumulated_batches = 0;
+	model->accumulated_gradients = NULL;
 	model->backlog_size = 0;
 	model->learning_rate = learning_rate;
-	pthread_mutex_init(&model->backlog_mutex, NULL);
+	model->precision = __atomic_load_n(&precision_default, __ATOMIC_RELAXED);
+	memset(&model->epoch_stats, 0, sizeof(neuromorph_epoch_stats));
 	return model;
 }
 
@@ -365,28 +402,120 @@ void adjacency_map_free_internal(adjacency_map* adjacency){
 }
 
 void neuromorph_free(neuromorph* model){
+	for (size_t i = 0;model->parameters && i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		if (node->type == LAYER_NODE || node->type == OUTPUT_NODE){
+			node->weight_buffer = NULL;
+			node->bias_buffer = NULL;
+		}
+	}
+	if (model->parameter_map != NULL){
+		munmap(model->parameter_map, model->parameter_map_size);
+	}
+	else{
+#ifdef nm_sse
+		_mm_free(model->parameters);
+#else
+		free(model->parameters);
+#endif
+	}
+	// the output has no outgoing links, so it is not a key of the adjacency map
+	neuromorph_node* output = model->output;
+	uint8_t output_linked = output == NULL || adjacency_map_contains(&model->adjacency, (uintptr_t)output);
 	adjacency_map_free_internal(&model->adjacency);
+	if (!output_linked){
+		neuromorph_node_free(output);
+	}
 	neuromorph_ast_free_internal(&model->ast);
 	free(model->batch_backlog);
-	free(model->batch_expected);
+	vector_free(&model->schedule);
+	vector_free(&model->recurrent_sources);
+	neuromorph_pool_free(model->pool);
+	free(model->worker_gradients);
+	free(model->accumulated_gradients);
+	free(model->description);
+	pthread_mutex_destroy(&model->publish_mutex);
 	free(model);
 }
 
-uint8_t parse_header_parameter(neuromorph_header* header, float* bias_parameter, float* weight_parameter, const char* token){
+uint8_t parse_header_parameter(neuromorph_header* header, const char* token, uint8_t arg_c){
 	float token_f = atof(token);
-	if (header->bias_function == NULL){
-		if (header->weight_function == NULL){
-			fprintf(stderr, "parameter passed to non existant function\n");
-			return 0;
+	switch(arg_c){
+	case 1:
+		*(header->slot == 0 ? &header->weight_parameter_a : &header->bias_parameter_a) = token_f;
+		return 1;
+	case 2:
+		*(header->slot == 0 ? &header->weight_parameter_b : &header->bias_parameter_b) = token_f;
+		return 1;
+	}
+	fprintf(stderr, "too many initialization parameters\n");
+	return 0;
+}
+
+uint8_t parse_optimizer(neuromorph_optimizer* optimizer, const char* token){
+	optimizer_record optimizer_list[] = {
+		{"sgd", optimizer_sgd, 0, 0, 0, 0},
+		{"momentum", optimizer_momentum, 1, 0.9, 0, 0},
+		{"nesterov", optimizer_nesterov, 1, 0.9, 0, 0},
+		{"rmsprop", optimizer_rmsprop, 1, 0.9, 0, 0},
+		{"adam", optimizer_adam, 2, 0.9, 0.999, 0},
+		{"adamw", optimizer_adam, 2, 0.9, 0.999, 0.01}
+	};
+	for (size_t i = 0;i<OPTIMIZER_COUNT;++i){
+		optimizer_record record = optimizer_list[i];
+		if (strcmp(token, record.name)){
+			continue;
 		}
-		*weight_parameter = token_f;
+		optimizer->update = record.update;
+		optimizer->moments = record.moments;
+		optimizer->parameter_a = record.parameter_a;
+		optimizer->parameter_b = record.parameter_b;
+		optimizer->parameter_c = record.parameter_c;
 		return 1;
 	}
-	*bias_parameter = token_f;
-	return 1;
+	return 0;
+}
+
+uint8_t parse_optimizer_parameter(neuromorph_optimizer* optimizer, const char* token, uint8_t arg_c){
+	float token_f = atof(token);
+	switch(arg_c){
+	case 1:
+		optimizer->parameter_a = token_f;
+		return 1;
+	case 2:
+		optimizer->parameter_b = token_f;
+		return 1;
+	case 3:
+		optimizer->parameter_c = token_f;
+		return 1;
+	}
+	fprintf(stderr, "too many optimizer parameters\n");
+	return 0;
 }
 
+/*
+ * Header functions are positional, the weight initializer, the bias initializer, then an optional optimizer,
+ * each followed by its whitespace separated parameters
+*/
 uint8_t parse_header_function(neuromorph_header* header, const char* token, uint8_t arg_c){
+	if (header->slot > 2){
+		fprintf(stderr, "header takes a weight initializer, a bias initializer and an optimizer, found %s after them\n", token);
+		return 0;
+	}
+	if (arg_c != 0){
+		if (header->slot == 2){
+			return parse_optimizer_parameter(&header->optimizer, token, arg_c);
+		}
+		return parse_header_parameter(header, token, arg_c);
+	}
+	if (header->slot == 2){
+		if (!parse_optimizer(&header->optimizer, token)){
+			fprintf(stderr, "no valid optimizer %s\n", token);
+			return 0;
+		}
+		return 1;
+	}
+	const PARAMETRIC_FUNCTION_TYPE expected = header->slot == 0 ? PARAMETRIC_WEIGHT : PARAMETRIC_BIAS;
 	function_record function_list[] = {
 		{"xavier",PARAMETRIC_WEIGHT, (GENERIC_FUNCTION_TYPE)weight_initialization_xavier},
 		{"he",PARAMETRIC_WEIGHT, (GENERIC_FUNCTION_TYPE)weight_initialization_he},
@@ -398,41 +527,29 @@ uint8_t parse_header_function(neuromorph_header* header, const char* token, uint
 		{"const_flat",PARAMETRIC_BIAS, (GENERIC_FUNCTION_TYPE)bias_initialization_const_flat},
 		{"const_uneven",PARAMETRIC_BIAS, (GENERIC_FUNCTION_TYPE)bias_initialization_const_uneven}
 	};
-	switch(arg_c%3){
-	case 0:
-		for (size_t i = 0;i<PARAMETRIC_INITIALIZATION_COUNT;++i){
-			function_record func = function_list[i];
-			if (strcmp(token, func.name)){
-				continue;
-			}
-			if (function_list[i].type == PARAMETRIC_WEIGHT){
-				header->weight_function = (WEIGHT_TYPE)func.function;
-				return 1;
-			}
-			header->bias_function = (BIAS_TYPE)func.function;
-			return 1;
+	for (size_t i = 0;i<PARAMETRIC_INITIALIZATION_COUNT;++i){
+		function_record func = function_list[i];
+		if (strcmp(token, func.name)){
+			continue;
 		}
-		fprintf(stderr, "no valid function %s\n", token);
-		return 0;
-	case 1:
-		if (!parse_header_parameter(header, &header->bias_parameter_a, &header->weight_parameter_a, token)){
-			fprintf(stderr, "initialization arg parse error\n");
+		if (func.type != expected){
+			fprintf(stderr, "%s is not a %s initializer\n", token, expected == PARAMETRIC_WEIGHT ? "weight" : "bias");
 			return 0;
 		}
-		return 1;
-	case 2:
-		if (!parse_header_parameter(header, &header->bias_parameter_b, &header->weight_parameter_b, token)){
-			fprintf(stderr, "initialization arg parse error\n");
-			return 0;
+		if (expected == PARAMETRIC_WEIGHT){
+			header->weight_function = (WEIGHT_TYPE)func.function;
+			return 1;
 		}
+		header->bias_function = (BIAS_TYPE)func.function;
 		return 1;
 	}
-	fprintf(stderr, "%u mod 3 = %u\n", arg_c, arg_c%3);
+	fprintf(stderr, "no valid %s initializer %s\n", expected == PARAMETRIC_WEIGHT ? "weight" : "bias", token);
 	return 0;
 }
 
 neuromorph_header compile_header(const char** c){
-	neuromorph_header header = {NULL, NULL, 0, 0, 0, 0};
+	neuromorph_header header = {NULL, NULL, 0, 0, 0, 0, {NULL, 0, 0, 0, 0}, 0, 0};
+	parse_optimizer(&header.optimizer, "sgd");
 	char token[NODE_NAME_TOKEN_MAX];
 	size_t index = 0;
 	uint8_t subarg_c = 0;
@@ -445,17 +562,20 @@ neuromorph_header compile_header(const char** c){
 		index = 0;
 		if (!parse_header_function(&header, token, subarg_c)){
 			fprintf(stderr, "header arg parse error\n");
+			header.malformed = 1;
 		}
 		if (**c == ' '){
 			subarg_c++;
 		}
 		else if (**c == ','){
 			subarg_c = 0;
+			header.slot++;
 		}
 	}
 	token[index] = '\0';
 	if (!parse_header_function(&header, token, subarg_c)){
 		fprintf(stderr, "header arg parse error\n");
+		header.malformed = 1;
 	}
 	(*c)++;
 	return header;
@@ -468,6 +588,9 @@ neuromorph* neuromorph_compile(const char* const description, size_t batch_size,
 		return NULL;
 	}
 	neuromorph_header header = compile_header(&c);
+	if (header.malformed){
+		return NULL;
+	}
 	if (!header.bias_function || !header.weight_function){
 		fprintf(stderr, "missing initialization funtion\n");
 		return NULL;
@@ -506,6 +629,7 @@ neuromorph* neuromorph_compile(const char* const description, size_t batch_size,
 	model->ast = ast;
 	model->ast_root = root;
 	model->header = header;
+	model->description = strdup(description);
 	return model;
 }
 
@@ -813,6 +937,7 @@ uint8_t neuromorph_parse_segment(neuromorph_ast* ast, const char** c, char type,
 		arg[index++] = **c;
 	}
 	arg[index] = '\0';
+	strcpy(node.name, arg);
 	ast_node_id id = name_to_id(arg);
 	*top_level_id = id;
 	if ((!first) && prev != -1){
@@ -852,7 +977,7 @@ uint8_t neuromorph_parse_segment(neuromorph_ast* ast, const char** c, char type,
 			break;
 		case '(':
 		case '{':
-		case '[':
+		case '[':{
 			ast_node_id temp_id;
 			if (!neuromorph_parse_segment(ast, c, **c, &temp_id, sub_prev, branch_start, 0)){
 				return 0;
@@ -864,6 +989,7 @@ uint8_t neuromorph_parse_segment(neuromorph_ast* ast, const char** c, char type,
 				branch_start = 0;
 			}
 			break;
+		}
 		case ')':
 			if (node.type != NEUROMORPH_LAYER_ARGS){
 				fprintf(stderr, "node terminated with unexpected token %c\n", **c);
@@ -1079,12 +1205,132 @@ void neuromorph_build(neuromorph* model){
 	);
 	model->batch_backlog = malloc(sizeof(float)*model->backlog_size*model->batch_size);
 	graph_domain_free(&domain);
-	vector marked = vector_init();
-	neuromorph_mark_loops(model->input, &marked);
-	vector_free(&marked);
 	model->output = neuromorph_pull_output(&model->adjacency);
-	model->batch_expected = malloc(sizeof(float)*model->output->buffer_size*model->batch_size);
+	neuromorph_bind_sources(model);
+	neuromorph_schedule_build(model);
+	neuromorph_parameter_layout(model);
+	neuromorph_parameter_arena(model);
 	weight_bias_initialize(model);
+	optimizer_state_initialize(model);
+	neuromorph_pool_start(model);
+}
+
+void neuromorph_collect_nodes(neuromorph* model, vector* nodes){
+	adjacency_map_iterator it = adjacency_map_iterator_init(&model->adjacency);
+	while (adjacency_map_iterator_has_next(&it)){
+		adjacency_map_result r = adjacency_map_iterator_next(&it);
+		if (!vector_contains(nodes, r.key)){
+			vector_push(nodes, r.key);
+		}
+		for (size_t i = 0;i<r.val.size;++i){
+			if (!vector_contains(nodes, r.val.data[i])){
+				vector_push(nodes, r.val.data[i]);
+			}
+		}
+	}
+}
+
+neuromorph_node* neuromorph_buffer_owner(vector* nodes, const float* buffer){
+	for (size_t i = 0;i<nodes->size;++i){
+		neuromorph_node* candidate = (neuromorph_node*)nodes->data[i];
+		if (candidate->neuron_buffer != NULL && candidate->neuron_buffer == buffer){
+			return candidate;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Resolves where each node reads its previous activations from in the backlog
+ */
+void neuromorph_bind_sources(neuromorph* model){
+	vector nodes = vector_init();
+	neuromorph_collect_nodes(model, &nodes);
+	for (size_t i = 0;i<nodes.size;++i){
+		neuromorph_node* node = (neuromorph_node*)nodes.data[i];
+		neuromorph_node* owner = neuromorph_buffer_owner(&nodes, node->previous_neuron_buffer);
+		if (owner != NULL){
+			node->previous_owner = owner;
+			node->previous_input = (owner == model->input);
+			node->previous_activation_offset = owner->backlog_offset+owner->backlog_offset_activation;
+		}
+		if (node->type != CONVERGENT_NODE){
+			continue;
+		}
+		owner = neuromorph_buffer_owner(&nodes, node->convergent_buffer);
+		if (owner != NULL){
+			node->convergent_owner = owner;
+			node->convergent_input = (owner == model->input);
+			node->convergent_activation_offset = owner->backlog_offset+owner->backlog_offset_activation;
+		}
+	}
+	vector_free(&nodes);
+}
+
+uint8_t neuromorph_depends_on(neuromorph_node* node, neuromorph_node* target, vector* visited){
+	if (node == NULL){
+		return 0;
+	}
+	if (node == target){
+		return 1;
+	}
+	if (vector_contains(visited, (uintptr_t)node)){
+		return 0;
+	}
+	vector_push(visited, (uintptr_t)node);
+	if (neuromorph_depends_on(node->previous_owner, target, visited)){
+		return 1;
+	}
+	return neuromorph_depends_on(node->convergent_owner, target, visited);
+}
+
+void neuromorph_schedule_node(neuromorph* model, neuromorph_node* node){
+	if (node == NULL || node->type == INPUT_NODE || vector_contains(&model->schedule, (uintptr_t)node)){
+		return;
+	}
+	neuromorph_schedule_node(model, node->previous_owner);
+	if (!node->recurrent){
+		neuromorph_schedule_node(model, node->convergent_owner);
+	}
+	vector_push(&model->schedule, (uintptr_t)node);
+}
+
+/*
+ * Orders every node the output depends on so that a single thread can run the graph front to back.
+ * A convergence whose path depends on the convergence itself merges backward in time,
+ * it reads whatever its path held after the previous sample and is marked recurrent.
+*/
+void neuromorph_schedule_build(neuromorph* model){
+	vector nodes = vector_init();
+	neuromorph_collect_nodes(model, &nodes);
+	vector visited = vector_init();
+	for (size_t i = 0;i<nodes.size;++i){
+		neuromorph_node* node = (neuromorph_node*)nodes.data[i];
+		if (node->type != CONVERGENT_NODE || node->convergent_owner == NULL){
+			continue;
+		}
+		vector_clear(&visited);
+		node->recurrent = neuromorph_depends_on(node->convergent_owner, node, &visited);
+	}
+	vector_free(&visited);
+	vector_free(&nodes);
+	vector_clear(&model->schedule);
+	neuromorph_schedule_node(model, model->output);
+	vector_clear(&model->recurrent_sources);
+	model->state_size = 0;
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		if (!node->recurrent || node->convergent_input){
+			continue;
+		}
+		neuromorph_node* source = node->convergent_owner;
+		if (vector_contains(&model->recurrent_sources, (uintptr_t)source)){
+			continue;
+		}
+		source->state_offset = model->state_size;
+		model->state_size += source->buffer_size;
+		vector_push(&model->recurrent_sources, (uintptr_t)source);
+	}
 }
 
 void register_backlog(neuromorph_node* current_node, size_t* const backlog_size){
@@ -1217,6 +1463,7 @@ neuromorph_node* neuromorph_build_branch(neuromorph_ast* ast, ast_node_id node_i
 			vector_push(&div_nodes, (uintptr_t)current_node);
 			break;
 		}
+		strcpy(current_node->name, ast_node->name);
 		if (node != NULL){
 			neuromorph_link(adjacency, node, current_node);
 		}
@@ -1271,14 +1518,20 @@ neuromorph_node* neuromorph_pull_output(adjacency_map* map){
 	return NULL;
 }
 
+// 1/(1+e^-x) from e^-|x|, so neither tail overflows
+static inline float stable_sigmoidf(float x){
+	float e = expf(-fabsf(x));
+	return (x < 0 ? e : 1)/(1+e);
+}
+
 #ifdef nm_sse
 void convergence_multiplicative(const float* const path, const float* const previous, float* const buffer, const size_t buffer_size){
 	size_t i;
 	for (i = 0;i+4<=buffer_size;i+=4){
-		__m128 p = _mm_load_ps(path+i);
-		__m128 b = _mm_load_ps(previous+i);
+		__m128 p = _mm_loadu_ps(path+i);
+		__m128 b = _mm_loadu_ps(previous+i);
 		__m128 result = _mm_mul_ps(p, b);
-		_mm_store_ps(buffer+i, result);
+		_mm_storeu_ps(buffer+i, result);
 	}
 	for (;i<buffer_size;++i){
 		buffer[i] = previous[i] * path[i];
@@ -1288,10 +1541,10 @@ void convergence_multiplicative(const float* const path, const float* const prev
 void convergence_additive(const float* const path, const float* const previous, float* const buffer, const size_t buffer_size){
 	size_t i;
 	for(i = 0;i+4<=buffer_size;i+=4){
-		__m128 p = _mm_load_ps(path+i);
-		__m128 b = _mm_load_ps(previous+i);
+		__m128 p = _mm_loadu_ps(path+i);
+		__m128 b = _mm_loadu_ps(previous+i);
 		__m128 result = _mm_add_ps(p, b);
-		_mm_store_ps(buffer + i, result);
+		_mm_storeu_ps(buffer + i, result);
 	}
 	for (;i<buffer_size;++i){
 		buffer[i] = previous[i] + path[i];
@@ -1302,11 +1555,11 @@ void convergence_average(const float* const path, const float* const previous, f
 	size_t i;
 	__m128 two = _mm_set1_ps(2.0f);
 	for (i = 0;i+4<=buffer_size;i+=4){
-		__m128 p = _mm_load_ps(path+i);
-		__m128 b = _mm_load_ps(previous+i);
+		__m128 p = _mm_loadu_ps(path+i);
+		__m128 b = _mm_loadu_ps(previous+i);
 		__m128 s = _mm_add_ps(p, b);
 		__m128 avg = _mm_div_ps(s, two);
-		_mm_store_ps(buffer+i, avg);
+		_mm_storeu_ps(buffer+i, avg);
 	}
 	for (;i<buffer_size;++i){
 		buffer[i] = (previous[i]+path[i])/2;
@@ -1317,10 +1570,10 @@ float loss_mse(float* const buffer, const float* const result, const float* cons
 	__m128 s = _mm_setzero_ps();
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 #ifdef nm_fma
 		s = _mm_fmadd_ps(loss, loss, s);
 #else
@@ -1329,7 +1582,7 @@ float loss_mse(float* const buffer, const float* const result, const float* cons
 #endif
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	for (;i<size;++i){
 		float loss = expected[i]-result[i];
@@ -1343,15 +1596,15 @@ float loss_mae(float* const buffer, const float* const result, const float* cons
 	__m128 s = _mm_setzero_ps();
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 		__m128 abs_loss = _mm_andnot_ps(_mm_set1_ps(-0.f), loss);
 		s = _mm_add_ps(s,abs_loss);
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	for (;i<size;++i){
 		float loss = expected[i]-result[i];
@@ -1365,16 +1618,16 @@ float loss_mape(float* const buffer, const float* const result, const float* con
 	__m128 s = _mm_setzero_ps();
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 		__m128 abs_loss = _mm_andnot_ps(_mm_set1_ps(-0.f), loss);
-		__m128 loss_div_e = _mm_div_ps(abs_loss, e);
+		__m128 loss_div_e = _mm_div_ps(abs_loss, _mm_andnot_ps(_mm_set1_ps(-0.f), e));
 		s = _mm_add_ps(s,loss_div_e);
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	for (;i<size;++i){
 		float expect = expected[i];
@@ -1392,10 +1645,10 @@ float loss_huber(float* const buffer, const float* const result, const float* co
 	__m128 half = _mm_set1_ps(0.5f);
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 		__m128 abs_loss = _mm_andnot_ps(_mm_set1_ps(-0.f), loss);
 		__m128 mask = _mm_cmple_ps(abs_loss, param);
 		__m128 case1 = _mm_mul_ps(_mm_mul_ps(loss, loss), half);
@@ -1412,7 +1665,7 @@ float loss_huber(float* const buffer, const float* const result, const float* co
 		s = _mm_add_ps(s,combined);
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	float hpsq = parameter*parameter*0.5;
 	for (;i<size;++i){
@@ -1420,7 +1673,7 @@ float loss_huber(float* const buffer, const float* const result, const float* co
 		float res = result[i];
 		float x = expect-res;
 		buffer[i] = x;
-		if (abs(x) <= parameter){
+		if (fabsf(x) <= parameter){
 			sum += x*x*0.5;
 			continue;
 		}
@@ -1433,10 +1686,10 @@ float loss_huber_modified(float* const buffer, const float* const result, const
 	__m128 s = _mm_setzero_ps();
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 		__m128 prod = _mm_mul_ps(e, r);
 		__m128 mask = _mm_cmpgt_ps(prod, _mm_set1_ps(-1.f));
 		__m128 ones = _mm_set1_ps(1.f);
@@ -1453,7 +1706,7 @@ float loss_huber_modified(float* const buffer, const float* const result, const
 		s = _mm_add_ps(s,combined);
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	for (;i<size;++i){
 		float expect = expected[i];
@@ -1474,16 +1727,16 @@ float loss_cross_entropy(float* const buffer, const float* const result, const f
 	__m128 s = _mm_setzero_ps();
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 		__m128 log_r = _mm_set_ps(logf(r[3]), logf(r[2]), logf(r[1]), logf(r[0]));
 		__m128 term = _mm_mul_ps(e, log_r);
 		s = _mm_add_ps(s,term);
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	for (;i<size;++i){
 		float expect = expected[i];
@@ -1498,10 +1751,10 @@ float loss_hinge(float* const buffer, const float* const result, const float* co
 	__m128 s = _mm_setzero_ps();
 	size_t i;
 	for (i= 0;i+4<=size;i+=4){
-		__m128 e = _mm_load_ps(expected+i);
-		__m128 r = _mm_load_ps(result+i);
+		__m128 e = _mm_loadu_ps(expected+i);
+		__m128 r = _mm_loadu_ps(result+i);
 		__m128 loss = _mm_sub_ps(e, r);
-		_mm_store_ps(buffer+i,loss);
+		_mm_storeu_ps(buffer+i,loss);
 		__m128 prod = _mm_mul_ps(e, r);
 		__m128 ones = _mm_set1_ps(1.0f);
 		__m128 term = _mm_sub_ps(ones, prod);
@@ -1510,7 +1763,7 @@ float loss_hinge(float* const buffer, const float* const result, const float* co
 		s = _mm_add_ps(s,hinge);
 	}
 	float sum_array[4];
-	_mm_store_ps(sum_array, s);
+	_mm_storeu_ps(sum_array, s);
 	float sum = sum_array[0]+sum_array[1]+sum_array[2]+sum_array[3];
 	for (;i<size;++i){
 		float expect = expected[i];
@@ -1521,31 +1774,85 @@ float loss_hinge(float* const buffer, const float* const result, const float* co
 	return sum;
 }
 
-__m128 exp_neg_ps(__m128 x) {
+// x rounded down, x has to fit in an int
+static inline __m128 floor_ps(__m128 x){
+#ifdef nm_sse4_1
+	return _mm_floor_ps(x);
+#else
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+#endif
+}
+
+// x*2^n for integral n in [-150, 128], in two steps so each power of two is a normal float built in the exponent bits
+static inline __m128 scale_pow2n_ps(__m128 x, __m128 n){
+	const __m128i bias = _mm_set1_epi32(127);
+	__m128i k = _mm_cvttps_epi32(n);
+	__m128i half = _mm_srai_epi32(k, 1);
+	x = _mm_mul_ps(x, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(half, bias), 23)));
+	return _mm_mul_ps(x, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_sub_epi32(k, half), bias), 23)));
+}
+
+/*
+ * e^x within a few ulp, x = n*ln2+r with |r| <= ln2/2 split over two constants so r stays exact,
+ * e^r from a degree 6 polynomial scaled by 2^n. Underflow is gradual, overflow saturates near FLT_MAX instead of reaching inf
+*/
+__m128 exp_ps(__m128 x){
 	const __m128 one = _mm_set1_ps(1.0f);
-	const __m128 exp_c1 = _mm_set1_ps(0.04166669f);
-	const __m128 exp_c2 = _mm_set1_ps(0.5000004f);
-	__m128 x2 = _mm_mul_ps(x, x);  // x^2
-	__m128 x3 = _mm_mul_ps(x2, x); // x^3
-	// Compute the polynomial approximation: e^-x ≈ 1 - x - x^2/2 - x^3/6
-	__m128 poly = _mm_sub_ps(one, x);        // 1 - x
-	poly = _mm_sub_ps(poly, _mm_mul_ps(exp_c2, x2)); // 1 - x - x^2/2
-	poly = _mm_sub_ps(poly, _mm_mul_ps(exp_c1, x3)); // 1 - x - x^2/2 - x^3/6
-	return poly;
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-103.972f)), _mm_set1_ps(88.72283f));
+	__m128 n = floor_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+	__m128 poly = _mm_set1_ps(1.9875691500e-4f);
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(1.3981999507e-3f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(8.3334519073e-3f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(4.1665795894e-2f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(1.6666665459e-1f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(5.0000001201e-1f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, _mm_mul_ps(x, x)), _mm_add_ps(x, one));
+	return scale_pow2n_ps(poly, n);
 }
 
-void activation_sigmoid(float* const buffer, const size_t size, const float parameter){
-	size_t i;
+/*
+ * e^x to around 1.5e-4 relative, 2^(x*log2 e) with the fraction from a degree 3 polynomial,
+ * saturating like exp_ps, cheap enough for inference that tolerates it
+*/
+__m128 exp_fast_ps(__m128 x){
+	__m128 t = _mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f));
+	t = _mm_min_ps(_mm_max_ps(t, _mm_set1_ps(-150.0f)), _mm_set1_ps(127.9999f));
+	__m128 n = floor_ps(t);
+	__m128 f = _mm_sub_ps(t, n);
+	__m128 poly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.07944023841f), f), _mm_set1_ps(0.2244943373f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(0.6960656422f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, f), _mm_set1_ps(1.0f));
+	return scale_pow2n_ps(poly, n);
+}
+
+static inline __m128 exp_tier_ps(__m128 x, uint8_t precision){
+	return precision == NEUROMORPH_PRECISION_FAST ? exp_fast_ps(x) : exp_ps(x);
+}
+
+// 1/(1+e^-x) from e^-|x|, so neither tail overflows
+__m128 sigmoid_ps(__m128 x, uint8_t precision){
 	const __m128 one = _mm_set1_ps(1.0f);
-	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+1);
-		x = _mm_xor_ps(x, _mm_set1_ps(-0.f));
-		__m128 exp_neg_x = exp_neg_ps(x);
-		__m128 sigmoid = _mm_div_ps(one, _mm_add_ps(one, exp_neg_x));
-		_mm_store_ps(buffer+i, sigmoid);
+	__m128 e = exp_tier_ps(_mm_or_ps(x, _mm_set1_ps(-0.f)), precision);
+	__m128 mask = _mm_cmplt_ps(x, _mm_setzero_ps());
+#ifdef nm_sse4_1
+	__m128 numerator = _mm_blendv_ps(one, e, mask);
+#else
+	__m128 numerator = _mm_or_ps(_mm_and_ps(mask, e), _mm_andnot_ps(mask, one));
+#endif
+	return _mm_div_ps(numerator, _mm_add_ps(one, e));
+}
+
+void activation_sigmoid(float* const buffer, const size_t size, const float parameter){
+	const uint8_t precision = neuromorph_precision_thread;
+	size_t i = 0;
+	for (;precision != NEUROMORPH_PRECISION_EXACT && i+4<=size;i+=4){
+		_mm_storeu_ps(buffer+i, sigmoid_ps(_mm_loadu_ps(buffer+i), precision));
 	}
 	for (;i<size;++i){
-		buffer[i] = 1/(1+expf(-buffer[i]));
+		buffer[i] = stable_sigmoidf(buffer[i]);
 	}
 }
 
@@ -1553,36 +1860,49 @@ void activation_relu(float* const buffer, const size_t size, const float paramet
 	size_t i;
 	for (i = 0;i+4<=size;i+=4){
 		__m128 zeros = _mm_setzero_ps();
-		__m128 term = _mm_load_ps(buffer+i);
+		__m128 term = _mm_loadu_ps(buffer+i);
 		__m128 relu = _mm_max_ps(zeros, term);
-		_mm_store_ps(buffer+i, relu);
+		_mm_storeu_ps(buffer+i, relu);
 	}
 	for (;i<size;++i){
 		buffer[i] = fmaxf(0,buffer[i]);
 	}
 }
 
-__m128 tanh_ps(__m128 x) {
+/*
+ * tanh as 1-2/(e^2x+1) on |x| with the sign put back, which cancels near zero,
+ * so |x| < 0.625 comes from an odd polynomial instead
+*/
+__m128 tanh_ps(__m128 x, uint8_t precision){
 	const __m128 one = _mm_set1_ps(1.0f);
-	// calculate e^(2x)
-	__m128 exp2x = exp_neg_ps(_mm_mul_ps(x, _mm_set1_ps(-2.0f)));
-	exp2x = _mm_rcp_ps(exp2x);
-	// calculate (e^(2x) - 1) / (e^(2x) + 1)
-	__m128 num = _mm_sub_ps(exp2x, one);
-	__m128 den = _mm_add_ps(exp2x, one);
-	__m128 tanh_x = _mm_div_ps(num, den);
-	return tanh_x;
+	const __m128 sign = _mm_set1_ps(-0.f);
+	__m128 magnitude = _mm_andnot_ps(sign, x);
+	__m128 exp2x = exp_tier_ps(_mm_add_ps(magnitude, magnitude), precision);
+	__m128 large = _mm_sub_ps(one, _mm_div_ps(_mm_set1_ps(2.0f), _mm_add_ps(exp2x, one)));
+	large = _mm_or_ps(large, _mm_and_ps(sign, x));
+	__m128 x2 = _mm_mul_ps(x, x);
+	__m128 poly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-5.70498872745e-3f), x2), _mm_set1_ps(2.06390887954e-2f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(-5.37397155531e-2f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(1.33314422036e-1f));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x2), _mm_set1_ps(-3.33332819422e-1f));
+	__m128 small = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(poly, x2), x), x);
+	__m128 mask = _mm_cmplt_ps(magnitude, _mm_set1_ps(0.625f));
+#ifdef nm_sse4_1
+	return _mm_blendv_ps(large, small, mask);
+#else
+	return _mm_or_ps(_mm_and_ps(mask, small), _mm_andnot_ps(mask, large));
+#endif
 }
 
 void activation_tanh(float* const buffer, const size_t size, const float parameter){
-	size_t i;
-	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
-		__m128 tanh_approx = tanh_ps(x);
-		_mm_store_ps(buffer+i, tanh_approx);
+	const uint8_t precision = neuromorph_precision_thread;
+	size_t i = 0;
+	for (;precision != NEUROMORPH_PRECISION_EXACT && i+4<=size;i+=4){
+		__m128 x = _mm_loadu_ps(buffer+i);
+		_mm_storeu_ps(buffer+i, tanh_ps(x, precision));
 	}
 	for (;i<size;++i){
-		buffer[i] = tanh(buffer[i]);
+		buffer[i] = tanhf(buffer[i]);
 	}
 }
 
@@ -1590,9 +1910,9 @@ void activation_binary_step(float* const buffer, const size_t size, const float
 	const __m128 zero = _mm_setzero_ps();
 	size_t i;
 	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
+		__m128 x = _mm_loadu_ps(buffer+i);
 		__m128 step = _mm_cmpge_ps(x, zero);
-		_mm_store_ps(buffer+i, step);
+		_mm_storeu_ps(buffer+i, step);
 	}
 	for (;i<size;++i){
 		buffer[i] = buffer[i] >= 0;
@@ -1607,9 +1927,9 @@ void activation_relu_leaky(float* const buffer, const size_t size, const float p
 	size_t i;
 	const __m128 tenth = _mm_set1_ps(0.1f);
 	for (i=0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
+		__m128 x = _mm_loadu_ps(buffer+i);
 		__m128 term = _mm_max_ps(_mm_mul_ps(tenth, x), x);
-		_mm_store_ps(buffer+i, term);
+		_mm_storeu_ps(buffer+i, term);
 	}
 	for (;i<size;++i){
 		float x = buffer[i];
@@ -1621,9 +1941,9 @@ void activation_relu_parametric(float* const buffer, const size_t size, const fl
 	size_t i;
 	const __m128 tenth = _mm_set1_ps(parameter);
 	for (i=0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
+		__m128 x = _mm_loadu_ps(buffer+i);
 		__m128 term = _mm_max_ps(_mm_mul_ps(tenth, x), x);
-		_mm_store_ps(buffer+i, term);
+		_mm_storeu_ps(buffer+i, term);
 	}
 	for (;i<size;++i){
 		float x = buffer[i];
@@ -1631,93 +1951,139 @@ void activation_relu_parametric(float* const buffer, const size_t size, const fl
 	}
 }
 
+// e^x-1, which cancels near zero, so |x| < 0.35 comes from its Taylor series
+__m128 expm1_ps(__m128 x, uint8_t precision){
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 large = _mm_sub_ps(exp_tier_ps(x, precision), one);
+	__m128 poly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.0f/5040), x), _mm_set1_ps(1.0f/720));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(1.0f/120));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(1.0f/24));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(1.0f/6));
+	poly = _mm_add_ps(_mm_mul_ps(poly, x), _mm_set1_ps(0.5f));
+	__m128 small = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(poly, x), x), x);
+	__m128 mask = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.f), x), _mm_set1_ps(0.35f));
+#ifdef nm_sse4_1
+	return _mm_blendv_ps(large, small, mask);
+#else
+	return _mm_or_ps(_mm_and_ps(mask, small), _mm_andnot_ps(mask, large));
+#endif
+}
+
 void activation_elu(float* const buffer, const size_t size, const float parameter){
+	const uint8_t precision = neuromorph_precision_thread;
 	const __m128 zero = _mm_setzero_ps();
-	const __m128 one = _mm_set1_ps(1.0f);
 	const __m128 alpha = _mm_set1_ps(parameter);
-	size_t i;
-	for (i=0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
+	size_t i = 0;
+	for (;precision != NEUROMORPH_PRECISION_EXACT && i+4<=size;i+=4){
+		__m128 x = _mm_loadu_ps(buffer+i);
 		__m128 mask = _mm_cmplt_ps(x, zero);
 #ifdef nm_sse4_1
-		__m128 negs = _mm_mul_ps(alpha, _mm_sub_ps(exp_neg_ps(x), one));
+		__m128 negs = _mm_mul_ps(alpha, expm1_ps(_mm_min_ps(x, zero), precision));
 		__m128 term = _mm_blendv_ps(x, negs, mask);
 #else
-		__m128 negs = _mm_and_ps(mask, _mm_mul_ps(alpha, _mm_sub_ps(exp_neg_ps(x), one)));
+		__m128 negs = _mm_and_ps(mask, _mm_mul_ps(alpha, expm1_ps(_mm_min_ps(x, zero), precision)));
 		__m128 term = _mm_add_ps(_mm_andnot_ps(mask, x), negs);
 #endif
-		_mm_store_ps(buffer+i, term);
+		_mm_storeu_ps(buffer+i, term);
 	}
 	for (;i<size;++i){
 		float x = buffer[i];
 		if (x < 0){
-			buffer[i] = parameter*(expf(x)-1);
+			buffer[i] = parameter*expm1f(x);
 		}
 	}
 }
 
-void activation_softmax(float* const buffer, const size_t size, const float parameter){
+// e^x in place, returns the sum of the results
+float neuromorph_exp(float* const buffer, const size_t size){
+	const uint8_t precision = neuromorph_precision_thread;
 	__m128 s = _mm_setzero_ps();
-	const __m128 n1 = _mm_set1_ps(-1.0f);
-	size_t i;
-	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
-		__m128 exp_x = exp_neg_ps(_mm_mul_ps(x, n1));
+	size_t i = 0;
+	for (;precision != NEUROMORPH_PRECISION_EXACT && i+4<=size;i+=4){
+		__m128 exp_x = exp_tier_ps(_mm_loadu_ps(buffer+i), precision);
+		_mm_storeu_ps(buffer+i, exp_x);
 		s = _mm_add_ps(s, exp_x);
 	}
 	float simd_s[4];
-	_mm_store_ps(simd_s, s);
-	float denom = simd_s[0]+simd_s[1]+simd_s[2]+simd_s[3];
+	_mm_storeu_ps(simd_s, s);
+	float sum = simd_s[0]+simd_s[1]+simd_s[2]+simd_s[3];
 	for (;i<size;++i){
-		denom += expf(buffer[i]);
+		buffer[i] = expf(buffer[i]);
+		sum += buffer[i];
 	}
-	const __m128 d = _mm_set1_ps(denom);
+	return sum;
+}
+
+// buffer as source less its largest element, returns that element
+float neuromorph_shift_max(float* const buffer, const float* const source, const size_t size){
+	__m128 m = _mm_set1_ps(source[0]);
+	size_t i;
+	for (i = 0;i+4<=size;i+=4){
+		m = _mm_max_ps(m, _mm_loadu_ps(source+i));
+	}
+	float max_array[4];
+	_mm_storeu_ps(max_array, m);
+	float max = fmaxf(fmaxf(max_array[0], max_array[1]), fmaxf(max_array[2], max_array[3]));
+	for (;i<size;++i){
+		max = fmaxf(max, source[i]);
+	}
+	const __m128 shift = _mm_set1_ps(max);
 	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
-		__m128 exp_x = exp_neg_ps(_mm_mul_ps(x, n1));
-		__m128 term = _mm_div_ps(exp_x, d);
-		_mm_store_ps(buffer+i, term);
+		_mm_storeu_ps(buffer+i, _mm_sub_ps(_mm_loadu_ps(source+i), shift));
 	}
 	for (;i<size;++i){
-		buffer[i] = expf(buffer[i])/denom;
+		buffer[i] = source[i]-max;
 	}
+	return max;
 }
 
-void activation_swish(float* const buffer, const size_t size, const float parameter){
+// shifted by the largest input first, so no exponent exceeds 0 and the sum cannot overflow
+void activation_softmax(float* const buffer, const size_t size, const float parameter){
+	neuromorph_shift_max(buffer, buffer, size);
+	const float denom = neuromorph_exp(buffer, size);
+	const __m128 d = _mm_set1_ps(denom);
 	size_t i;
-	const __m128 one = _mm_set1_ps(1.0f);
 	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
-		__m128 denom = _mm_add_ps(one, exp_neg_ps(x));
-		__m128 term = _mm_div_ps(x, denom);
-		_mm_store_ps(buffer+i, term);
+		__m128 term = _mm_div_ps(_mm_loadu_ps(buffer+i), d);
+		_mm_storeu_ps(buffer+i, term);
+	}
+	for (;i<size;++i){
+		buffer[i] /= denom;
+	}
+}
+
+void activation_swish(float* const buffer, const size_t size, const float parameter){
+	const uint8_t precision = neuromorph_precision_thread;
+	size_t i = 0;
+	for (;precision != NEUROMORPH_PRECISION_EXACT && i+4<=size;i+=4){
+		__m128 x = _mm_loadu_ps(buffer+i);
+		_mm_storeu_ps(buffer+i, _mm_mul_ps(x, sigmoid_ps(x, precision)));
 	}
 	for (;i<size;++i){
 		float x = buffer[i];
-		buffer[i] = x/(1+expf(-x));
+		buffer[i] = x*stable_sigmoidf(x);
 	}
 }
 
+// 0.5x(1+tanh(a)) taken as x*sigmoid(2a), which does not cancel for negative x
 void activation_gelu(float* const buffer, const size_t size, const float parameter){
-	size_t i;
-	const float s2p = sqrtf(2.0f)/M_PI;
-	const __m128 half = _mm_set1_ps(0.5f);
-	const __m128 one = _mm_set1_ps(1.0f);
-	const __m128 sqrt2vpi = _mm_set1_ps(s2p);
+	const uint8_t precision = neuromorph_precision_thread;
+	size_t i = 0;
+	const float s2p = sqrtf(2/M_PI);
+	const __m128 scale = _mm_set1_ps(2*s2p);
 	const __m128 gelu_c = _mm_set1_ps(GELU_C);
-	for (i = 0;i+4<=size;i+=4){
-		__m128 x = _mm_load_ps(buffer+i);
+	for (;precision != NEUROMORPH_PRECISION_EXACT && i+4<=size;i+=4){
+		__m128 x = _mm_loadu_ps(buffer+i);
 		__m128 a = _mm_mul_ps(
-			sqrt2vpi,
+			scale,
 			_mm_add_ps(x, _mm_mul_ps(gelu_c, _mm_mul_ps(x, _mm_mul_ps(x, x))))
 		);
-		__m128 tanh_a = tanh_ps(a);
-		__m128 gelu = _mm_mul_ps(half, _mm_mul_ps(x, _mm_add_ps(one, tanh_a)));
-		_mm_store_ps(buffer+i, gelu);
+		__m128 gelu = _mm_mul_ps(x, sigmoid_ps(a, precision));
+		_mm_storeu_ps(buffer+i, gelu);
 	}
 	for (;i<size;++i){
 		float x = buffer[i];
-		buffer[i] = 0.5*x*(1+tanh(s2p*(x+(GELU_C*powf(x,3)))));
+		buffer[i] = x*stable_sigmoidf(2*s2p*(x+(GELU_C*x*x*x)));
 	}
 }
 
@@ -1759,7 +2125,7 @@ float loss_mae(float* const buffer, const float* const result, const float* cons
 	for (size_t i = 0;i<size;++i){
 		float loss = expected[i]-result[i];
 		buffer[i] = loss;
-		sum += abs(loss);
+		sum += fabsf(loss);
 	}
 	return sum/(size);
 }
@@ -1770,7 +2136,7 @@ float loss_mape(float* const buffer, const float* const result, const float* con
 		float expect = expected[i];
 		float loss = expect-result[i];
 		buffer[i] = loss;
-		sum += abs(loss/expect);
+		sum += fabsf(loss/expect);
 	}
 	return sum/(size);
 }
@@ -1783,11 +2149,11 @@ float loss_huber(float* const buffer, const float* const result, const float* co
 		float res = result[i];
 		float x = expect-res;
 		buffer[i] = x;
-		if (abs(x) <= parameter){
+		if (fabsf(x) <= parameter){
 			sum += x*x*0.5;
 			continue;
 		}
-		sum += (parameter*abs(x))-hpsq;
+		sum += (parameter*fabsf(x))-hpsq;
 	}
 	return sum;
 }
@@ -1833,7 +2199,7 @@ float loss_hinge(float* const buffer, const float* const result, const float* co
 
 void activation_sigmoid(float* const buffer, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
-		buffer[i] = 1/(1+expf(-buffer[i]));
+		buffer[i] = stable_sigmoidf(buffer[i]);
 	}
 }
 
@@ -1845,7 +2211,7 @@ void activation_relu(float* const buffer, const size_t size, const float paramet
 
 void activation_tanh(float* const buffer, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
-		buffer[i] = tanh(buffer[i]);
+		buffer[i] = tanhf(buffer[i]);
 	}
 }
 
@@ -1880,18 +2246,36 @@ void activation_elu(float* const buffer, const size_t size, const float paramete
 	for (size_t i = 0;i<size;++i){
 		x = buffer[i];
 		if (x < 0){
-			buffer[i] = parameter*(expf(x)-1);
+			buffer[i] = parameter*expm1f(x);
 		}
 	}
 }
 
-void activation_softmax(float* const buffer, const size_t size, const float parameter){
-	float denom = 0;
+float neuromorph_exp(float* const buffer, const size_t size){
+	float sum = 0;
+	for (size_t i = 0;i<size;++i){
+		buffer[i] = expf(buffer[i]);
+		sum += buffer[i];
+	}
+	return sum;
+}
+
+float neuromorph_shift_max(float* const buffer, const float* const source, const size_t size){
+	float max = source[0];
+	for (size_t i = 1;i<size;++i){
+		max = fmaxf(max, source[i]);
+	}
 	for (size_t i = 0;i<size;++i){
-		denom += expf(buffer[i]);
+		buffer[i] = source[i]-max;
 	}
+	return max;
+}
+
+void activation_softmax(float* const buffer, const size_t size, const float parameter){
+	neuromorph_shift_max(buffer, buffer, size);
+	const float denom = neuromorph_exp(buffer, size);
 	for (size_t i = 0;i<size;++i){
-		buffer[i] = expf(buffer[i])/denom;
+		buffer[i] /= denom;
 	}
 }
 
@@ -1899,7 +2283,7 @@ void activation_swish(float* const buffer, const size_t size, const float parame
 	float x;
 	for (size_t i = 0;i<size;++i){
 		x = buffer[i];
-		buffer[i] = x/(1+expf(-x));
+		buffer[i] = x*stable_sigmoidf(x);
 	}
 }
 
@@ -1908,7 +2292,7 @@ void activation_gelu(float* const buffer, const size_t size, const float paramet
 	const float s2p  = sqrtf(2/M_PI);
 	for (size_t i = 0;i<size;++i){
 		x = buffer[i];
-		buffer[i] = 0.5*x*(1+tanh(s2p*(x+(GELU_C*pow(x,3)))));
+		buffer[i] = x*stable_sigmoidf(2*s2p*(x+(GELU_C*x*x*x)));
 	}
 }
 
@@ -1917,281 +2301,1407 @@ void activation_selu(float* const buffer, const size_t size, const float paramet
 }
 #endif
 
-uint8_t neuromorph_mark_loops(neuromorph_node* node, vector* marked){
-	if (!node){
-		return 0;
-	}
-	vector_push(marked, (uintptr_t)node);
-	for (size_t i = 0;i<node->additional_branch_count;++i){
-		neuromorph_node* branch_candidate = node->additional_branches[i];
-		if (vector_contains(marked, (uintptr_t)branch_candidate)){
-			node->loop = 1;
-			continue;
-		}
-		branch_candidate->loop_start = neuromorph_mark_loops(branch_candidate, marked);
-	}
-	if (vector_contains(marked, (uintptr_t)node->next)){
-		node->loop = 1;
-		vector_pop(marked);
-		return 1;
+/*
+ * cross entropy of softmax(logits) taken from the logits as log sum exp, so it stays finite where the softmax underflows.
+ * buffer is left holding the shifted exponentials
+*/
+float loss_softmax_cross_entropy(float* const buffer, const float* const logits, const float* const expected, const size_t size, const float parameter){
+	const float max = neuromorph_shift_max(buffer, logits, size);
+	const float log_sum = logf(neuromorph_exp(buffer, size));
+	float sum = 0;
+	float mass = 0;
+	for (size_t i = 0;i<size;++i){
+		sum += expected[i]*(logits[i]-max);
+		mass += expected[i];
 	}
-	uint8_t start = neuromorph_mark_loops(node->next, marked);
-	vector_pop(marked);
-	return start;
+	return (mass*log_sum)-sum;
 }
 
-float neuromorph_forward(neuromorph* model, uint16_t pass_count){
-	pthread_t root;
-	forward_args arg_pair = {
-		model->input,
-		model->batch_backlog,
-		&model->backlog_mutex,
-		model->backlog_size*(pass_count % model->batch_size)
-	};
-	pthread_create(&root, NULL, neuromorph_branch_forward, (void*)(&arg_pair));
-	float* loss;
-	pthread_join(root, (void**)&loss);
-	float l = *loss;
-	free(loss);
-	return l;
+uint8_t neuromorph_epilogue_of(void (*activation)(float* const, const size_t, const float)){
+	if (activation == activation_linear){
+		return NEUROMORPH_EPILOGUE_LINEAR;
+	}
+	if (activation == activation_relu){
+		return NEUROMORPH_EPILOGUE_RELU;
+	}
+	if (activation == activation_relu_leaky){
+		return NEUROMORPH_EPILOGUE_RELU_LEAKY;
+	}
+	if (activation == activation_relu_parametric){
+		return NEUROMORPH_EPILOGUE_RELU_PARAMETRIC;
+	}
+	if (activation == activation_sigmoid){
+		return NEUROMORPH_EPILOGUE_SIGMOID;
+	}
+	if (activation == activation_tanh){
+		return NEUROMORPH_EPILOGUE_TANH;
+	}
+	if (activation == activation_elu){
+		return NEUROMORPH_EPILOGUE_ELU;
+	}
+	if (activation == activation_swish){
+		return NEUROMORPH_EPILOGUE_SWISH;
+	}
+	if (activation == activation_gelu){
+		return NEUROMORPH_EPILOGUE_GELU;
+	}
+	return NEUROMORPH_EPILOGUE_NONE;
 }
 
-uint8_t end_of_branch(neuromorph_node* node){
-	if (node->next == NULL){
-		return 0;
+// the scalar activation kernels, one element at a time
+static inline float epilogue_scalar(float x, uint8_t epilogue, float parameter){
+	switch(epilogue){
+	case NEUROMORPH_EPILOGUE_RELU:
+		return fmaxf(0, x);
+	case NEUROMORPH_EPILOGUE_RELU_LEAKY:
+		return fmaxf(0.1*x, x);
+	case NEUROMORPH_EPILOGUE_RELU_PARAMETRIC:
+		return fmaxf(parameter*x, x);
+	case NEUROMORPH_EPILOGUE_SIGMOID:
+		return stable_sigmoidf(x);
+	case NEUROMORPH_EPILOGUE_TANH:
+		return tanhf(x);
+	case NEUROMORPH_EPILOGUE_ELU:
+		return x < 0 ? parameter*expm1f(x) : x;
+	case NEUROMORPH_EPILOGUE_SWISH:
+		return x*stable_sigmoidf(x);
+	case NEUROMORPH_EPILOGUE_GELU:
+		return x*stable_sigmoidf(2*sqrtf(2/M_PI)*(x+(GELU_C*x*x*x)));
 	}
-	return node->next->type == CONVERGENT_NODE && (node->next->prev != node);
+	return x;
 }
 
-void thread_signal_ready(neuromorph_node* node){
-	pthread_mutex_lock(&node->mutex);
-	node->ready = 1;
-	pthread_cond_broadcast(&node->cond);
-	pthread_mutex_unlock(&node->mutex);
+#ifdef nm_sse
+// the SIMD activation kernels on one vector, transcendental ones only below the exact tier
+static inline __m128 epilogue_ps(__m128 x, uint8_t epilogue, float parameter, uint8_t precision){
+	switch(epilogue){
+	case NEUROMORPH_EPILOGUE_RELU:
+		return _mm_max_ps(_mm_setzero_ps(), x);
+	case NEUROMORPH_EPILOGUE_RELU_LEAKY:
+		return _mm_max_ps(_mm_mul_ps(_mm_set1_ps(0.1f), x), x);
+	case NEUROMORPH_EPILOGUE_RELU_PARAMETRIC:
+		return _mm_max_ps(_mm_mul_ps(_mm_set1_ps(parameter), x), x);
+	case NEUROMORPH_EPILOGUE_SIGMOID:
+		return sigmoid_ps(x, precision);
+	case NEUROMORPH_EPILOGUE_TANH:
+		return tanh_ps(x, precision);
+	case NEUROMORPH_EPILOGUE_ELU:{
+		__m128 mask = _mm_cmplt_ps(x, _mm_setzero_ps());
+		__m128 negs = _mm_mul_ps(_mm_set1_ps(parameter), expm1_ps(_mm_min_ps(x, _mm_setzero_ps()), precision));
+#ifdef nm_sse4_1
+		return _mm_blendv_ps(x, negs, mask);
+#else
+		return _mm_add_ps(_mm_andnot_ps(mask, x), _mm_and_ps(mask, negs));
+#endif
+	}
+	case NEUROMORPH_EPILOGUE_SWISH:
+		return _mm_mul_ps(x, sigmoid_ps(x, precision));
+	case NEUROMORPH_EPILOGUE_GELU:{
+		__m128 a = _mm_mul_ps(
+			_mm_set1_ps(2*sqrtf(2/M_PI)),
+			_mm_add_ps(x, _mm_mul_ps(_mm_set1_ps(GELU_C), _mm_mul_ps(x, _mm_mul_ps(x, x))))
+		);
+		return _mm_mul_ps(x, sigmoid_ps(a, precision));
+	}
+	}
+	return x;
 }
+#endif
 
-void node_pass(neuromorph_node* node){
+/*
+ * Rows of weights times previous plus biases into output, four rows at a time.
+ * When activated is given each block of four is also run through the node's epilogue before it leaves registers,
+ * inlined into both entry points so the plain pass carries no epilogue branches
+*/
+static inline __attribute__((always_inline)) void node_pass_rows(neuromorph_node* node, const float* const weights, const float* const biases, const float* const previous, float* const output, float* const activated){
+	const size_t previous_size = *node->previous_buffer_size;
+	const uint8_t epilogue = node->epilogue;
+	const float parameter = node->activation_parameter;
 	size_t i, k;
 #ifdef nm_sse
-	__m128 wsum;
-	__m128 bias;
+	const uint8_t precision = neuromorph_precision_thread;
+	const uint8_t vector_epilogue = precision != NEUROMORPH_PRECISION_EXACT || epilogue < NEUROMORPH_EPILOGUE_SIGMOID;
+	size_t tile = 0;
 	for (i = 0;i+4<=node->buffer_size;i+=4){
-		wsum = _mm_setzero_ps();
-		bias = _mm_load_ps(node->bias_buffer+i);
-		size_t index = *node->previous_buffer_size*i;
-		for (k = 0;k+4<=*node->previous_buffer_size;k+=4){
-			__m128 weight = _mm_load_ps(node->weight_buffer+index+k);
-			__m128 prev = _mm_load_ps(node->previous_neuron_buffer+k);
-			__m128 m = _mm_mul_ps(weight, prev);
-			wsum = _mm_add_ps(wsum, m);
+		const float* w0 = weights+(previous_size*i);
+		const float* w1 = w0+previous_size;
+		const float* w2 = w1+previous_size;
+		const float* w3 = w2+previous_size;
+		__m128 s0 = _mm_setzero_ps();
+		__m128 s1 = _mm_setzero_ps();
+		__m128 s2 = _mm_setzero_ps();
+		__m128 s3 = _mm_setzero_ps();
+		for (k = 0;k+4<=previous_size;k+=4){
+			__m128 prev = _mm_loadu_ps(previous+k);
 #ifdef nm_fma
-			wsum = _mm_fmadd_ps(weight, prev, wsum);
+			s0 = _mm_fmadd_ps(_mm_loadu_ps(w0+k), prev, s0);
+			s1 = _mm_fmadd_ps(_mm_loadu_ps(w1+k), prev, s1);
+			s2 = _mm_fmadd_ps(_mm_loadu_ps(w2+k), prev, s2);
+			s3 = _mm_fmadd_ps(_mm_loadu_ps(w3+k), prev, s3);
 #else
-			wsum = _mm_add_ps(wsum, _mm_mul_ps(weight, prev));
+			s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(w0+k), prev));
+			s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(w1+k), prev));
+			s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(w2+k), prev));
+			s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(w3+k), prev));
 #endif
 		}
-		for (;k<*node->previous_buffer_size;++k){
+		// lane j of the sum is the dot product of row i+j
+		_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+		__m128 wsum = _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));
+		for (;k<previous_size;++k){
+			__m128 weight = _mm_set_ps(w3[k], w2[k], w1[k], w0[k]);
 #ifdef nm_fma
-			wsum = _mm_fmadd_ps(
-				_mm_set_ss(node->weight_buffer[index+k]),
-				_mm_set_ss(node->previous_neuron_buffer[k]),
-				wsum
-			);
+			wsum = _mm_fmadd_ps(weight, _mm_set1_ps(previous[k]), wsum);
 #else
-			wsum = _mm_add_ps(
-				wsum,
-				_mm_mul_ps(
-					_mm_set_ss(node->weight_buffer[index+k]),
-					_mm_set_ss(node->previous_neuron_buffer[k])
-				)
-			);
+			wsum = _mm_add_ps(wsum, _mm_mul_ps(weight, _mm_set1_ps(previous[k])));
 #endif
 		}
-		_mm_store_ps(node->neuron_buffer+i, _mm_add_ps(bias, wsum));
-	}
-	for (;i<node->buffer_size;++i){
-		float wsum = 0;
-		size_t index = *node->previous_buffer_size*i;
-		for (k = 0;k<*node->previous_buffer_size; ++k){
-			wsum += node->weight_buffer[index+k]*node->previous_neuron_buffer[k];
+		_mm_storeu_ps(output+i, _mm_add_ps(_mm_loadu_ps(biases+i), wsum));
+		// a tile at a time, so the epilogues of neighbouring blocks overlap instead of each waiting on its dot products
+		if (activated == NULL || ((i+4)%NEUROMORPH_EPILOGUE_TILE != 0 && i+8<=node->buffer_size)){
+			continue;
+		}
+		for (k = tile;vector_epilogue && k<i+4;k+=4){
+			_mm_storeu_ps(activated+k, epilogue_ps(_mm_loadu_ps(output+k), epilogue, parameter, precision));
 		}
-		node->neuron_buffer[i] = node->bias_buffer[i] + wsum;
+		for (;k<i+4;++k){
+			activated[k] = epilogue_scalar(output[k], epilogue, parameter);
+		}
+		tile = i+4;
 	}
 #else
-	for (i = 0;i<node->buffer_size;++i){
+	i = 0;
+#endif
+	for (;i<node->buffer_size;++i){
 		float wsum = 0;
-		size_t index = *node->previous_buffer_size*i;
-		for (k = 0;k<*node->previous_buffer_size; ++k){
-			wsum += node->weight_buffer[index+k]*node->previous_neuron_buffer[k];
+		size_t index = previous_size*i;
+		for (k = 0;k<previous_size; ++k){
+			wsum += weights[index+k]*previous[k];
+		}
+		output[i] = biases[i] + wsum;
+		if (activated != NULL){
+			activated[i] = epilogue_scalar(output[i], epilogue, parameter);
 		}
-		node->neuron_buffer[i] = node->bias_buffer[i] + wsum;
 	}
-#endif
 }
 
-void write_to_backlog(float* const backlog, pthread_mutex_t* mut, const float* const buffer, const size_t size, const size_t offset, uint16_t batch){
-	pthread_mutex_lock(mut);
-	memcpy(backlog+batch+offset, buffer, size*sizeof(float));
-	pthread_mutex_unlock(mut);
+void node_pass_weights(neuromorph_node* node, const float* const weights, const float* const biases, const float* const previous, float* const output){
+	node_pass_rows(node, weights, biases, previous, output, NULL);
+}
+
+// node_pass_weights writing the preactivation to output and its activation to activated in the same pass
+void node_pass_epilogue(neuromorph_node* node, const float* const weights, const float* const biases, const float* const previous, float* const output, float* const activated){
+	node_pass_rows(node, weights, biases, previous, output, activated);
 }
 
-void* neuromorph_branch_forward(void* arg_pair){
-	forward_args* args = arg_pair;
-	if (!args->node){
-		fprintf(stderr, "NULL node in graph\n");
-		pthread_exit(NULL);
+uint16_t neuromorph_default_workers(){
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cores < 1){
+		return 1;
 	}
-	float* backlog = args->backlog;
-	neuromorph_node* node = args->node;
-	pthread_mutex_t* mut = args->mut;
-	uint8_t end = end_of_branch(node);
-	forward_args new_pair = {
-		node->next,
-		backlog,
-		mut,
-		args->batch
-	};
-	switch(node->type){
-	case INPUT_NODE:
-		neuromorph_branch_forward((void*)(&new_pair));
-		break;
-	case OUTPUT_NODE:
-		pthread_mutex_lock(&node->mutex);
-		node_pass(node);
-		write_to_backlog(
-			backlog,
-			mut,
-			node->neuron_buffer,
-			node->buffer_size,
-			node->backlog_offset,
-			args->batch
-		);
-		node->activation_function(node->neuron_buffer, node->buffer_size, node->activation_parameter);
-		write_to_backlog(
-			backlog,
-			mut,
-			node->neuron_buffer,
-			node->buffer_size,
-			node->backlog_offset+node->backlog_offset_activation,
-			args->batch
-		);
-		float* loss = malloc(sizeof(float));
-		*loss = node->loss_function(
-			node->neuron_buffer,
-			node->neuron_buffer,
-			node->expected,
-			node->buffer_size,
-			node->loss_parameter
-		);
-		pthread_mutex_unlock(&node->mutex);
-		pthread_exit((void*)loss);
-		break;
-	case LAYER_NODE:
-		pthread_mutex_lock(&node->mutex);
-		node_pass(node);
-		write_to_backlog(
-			backlog,
-			mut,
-			node->neuron_buffer,
-			node->buffer_size,
-			node->backlog_offset,
-			args->batch
-		);
-		node->activation_function(node->neuron_buffer, node->buffer_size, node->activation_parameter);
-		write_to_backlog(
-			backlog,
-			mut,
-			node->neuron_buffer,
-			node->buffer_size,
-			node->backlog_offset+node->backlog_offset_activation,
-			args->batch
-		);
-		pthread_mutex_unlock(&node->mutex);
-		if (end){
-			thread_signal_ready(node);
-			pthread_exit(NULL);
+	return cores > UINT16_MAX ? UINT16_MAX : cores;
+}
+
+/*
+ * Read side of weight publication. A reader registers in the slot of the current epoch for the duration of one predict or
+ * batched forward call and reads model->parameters once, so it sees either the old or the new arena from start to finish.
+ * No locks are taken, retrying only when a publish flips the epoch between the load and the registration
+*/
+size_t neuromorph_read_enter(neuromorph* model){
+	for (;;){
+		size_t epoch = __atomic_load_n(&model->read_epoch, __ATOMIC_SEQ_CST);
+		size_t slot = epoch & 1;
+		__atomic_add_fetch(&model->readers[slot], 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&model->read_epoch, __ATOMIC_SEQ_CST) == epoch){
+			return slot;
+		}
+		__atomic_sub_fetch(&model->readers[slot], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+void neuromorph_read_exit(neuromorph* model, size_t slot){
+	__atomic_sub_fetch(&model->readers[slot], 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Swaps a copy of parameters, laid out by neuromorph_parameter_layout, in as the model's weights while predictions run.
+ * Passes already reading the old arena finish on it, later passes read the new one, and the old arena is reclaimed
+ * once every reader registered before the swap has left, so this blocks for at most one forward pass.
+ * Publishing is meant for inference, training the model at the same time is not supported
+*/
+uint8_t neuromorph_publish(neuromorph* model, const float* const parameters){
+#ifdef nm_sse
+	float* fresh = _mm_malloc(sizeof(float)*(model->parameter_count ? model->parameter_count : 1), 16);
+#else
+	float* fresh = malloc(sizeof(float)*(model->parameter_count ? model->parameter_count : 1));
+#endif
+	if (!fresh){
+		fprintf(stderr, "could not allocate memory for published parameters\n");
+		return 0;
+	}
+	memcpy(fresh, parameters, sizeof(float)*model->parameter_count);
+	pthread_mutex_lock(&model->publish_mutex);
+	float* old = model->parameters;
+	void* old_map = model->parameter_map;
+	neuromorph_parameter_rebind(model, fresh);
+	__atomic_store_n(&model->parameters, fresh, __ATOMIC_SEQ_CST);
+	size_t epoch = __atomic_fetch_add(&model->read_epoch, 1, __ATOMIC_SEQ_CST);
+	// grace period, every reader that could still hold old registered under the previous epoch
+	while (__atomic_load_n(&model->readers[epoch & 1], __ATOMIC_SEQ_CST) != 0){
+		sched_yield();
+	}
+	if (old_map != NULL){
+		munmap(old_map, model->parameter_map_size);
+		model->parameter_map = NULL;
+		model->parameter_map_size = 0;
+		optimizer_state_initialize(model);
+	}
+	else{
+#ifdef nm_sse
+		_mm_free(old);
+#else
+		free(old);
+#endif
+	}
+	pthread_mutex_unlock(&model->publish_mutex);
+	return 1;
+}
+
+uint64_t neuromorph_nanoseconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec*1000000000ull)+now.tv_nsec;
+}
+
+const char* neuromorph_node_type_name(const neuromorph_node* node){
+	switch(node->type){
+	case INPUT_NODE:
+		return "input";
+	case DIVERGENT_NODE:
+		return "divergence";
+	case CONVERGENT_NODE:
+		return "convergence";
+	case LAYER_NODE:
+		return "layer";
+	case OUTPUT_NODE:
+		return "output";
+	}
+	return "unknown";
+}
+
+/*
+ * Floats a scheduled node reads and writes for one sample, in bytes.
+ * Forward layers read weights, biases and the previous activation and write the preactivation and activation,
+ * backward layers also read the weights, accumulate weight and bias gradients and the previous delta.
+ * Convergences touch their previous, path and output
+*/
+size_t neuromorph_node_bytes(const neuromorph_node* node, uint8_t phase){
+	size_t floats = 0;
+	switch(node->type){
+	case OUTPUT_NODE:
+	case LAYER_NODE:
+		floats = node->weight_buffer_size+node->bias_buffer_size+*node->previous_buffer_size+(2*node->buffer_size);
+		if (phase == NEUROMORPH_PROFILE_BACKWARD){
+			floats += node->weight_buffer_size+node->bias_buffer_size+(2**node->previous_buffer_size);
 		}
-		neuromorph_branch_forward((void*)(&new_pair));
 		break;
+	case CONVERGENT_NODE:
+		floats = (phase == NEUROMORPH_PROFILE_BACKWARD ? 5 : 3)*node->buffer_size;
+		break;
+	case INPUT_NODE:
 	case DIVERGENT_NODE:
-		if (node->additional_branch_count == 0){
-			if (end){
-				thread_signal_ready(node);
-				pthread_exit(NULL);
+		break;
+	}
+	return sizeof(float)*floats;
+}
+
+#if defined(nm_profile) || defined(nm_trace)
+void neuromorph_profile_record(neuromorph_node* node, uint8_t phase, uint64_t start, const neuromorph_perf_sample* const counters, uint64_t count){
+	const uint64_t end = neuromorph_nanoseconds();
+#ifdef nm_profile
+	__atomic_add_fetch(&node->profile.nanoseconds[phase], end-start, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&node->profile.calls[phase], count, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&node->profile.bytes[phase], count*neuromorph_node_bytes(node, phase), __ATOMIC_RELAXED);
+	if (counters->present){
+		neuromorph_perf_sample finished;
+		neuromorph_perf_read(&finished);
+		uint8_t present = counters->present & finished.present;
+		for (size_t i = 0;i<NEUROMORPH_PERF_COUNTERS;++i){
+			if (present & (1<<i)){
+				__atomic_add_fetch(&node->profile.counters[phase][i], finished.values[i]-counters->values[i], __ATOMIC_RELAXED);
 			}
-			neuromorph_branch_forward((void*)(&new_pair));
-		}
-		void* result = NULL;
-		size_t index = 0;
-		pthread_t* threads = malloc(sizeof(pthread_t)*node->additional_branch_count+1);
-		if (!end){
-			pthread_create(&threads[index++], NULL, neuromorph_branch_forward, (void*)(&new_pair));
-		}
-		size_t i;
-		forward_args* branch_args = malloc(sizeof(forward_args)*node->additional_branch_count);
-		for (i = 0;i<node->additional_branch_count;++i){
-			neuromorph_node* branch = node->additional_branches[i];
-			if (branch->type == CONVERGENT_NODE && branch->prev != node){
-				end = 1;
-				continue;
+		}
+		if (present){
+			__atomic_add_fetch(&node->profile.counted[phase], count, __ATOMIC_RELAXED);
+		}
+	}
+#endif
+#ifdef nm_trace
+	neuromorph_trace_record(
+		node->name[0] ? node->name : neuromorph_node_type_name(node),
+		phase == NEUROMORPH_PROFILE_FORWARD ? "forward" : "backward",
+		start,
+		end,
+		count
+	);
+#endif
+}
+#endif
+
+#ifdef nm_profile
+void neuromorph_profile_reset(neuromorph* model){
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		memset(&node->profile, 0, sizeof(neuromorph_node_profile));
+	}
+}
+#endif
+
+void neuromorph_forward_node(neuromorph_node* node, const float* const parameters, float* const row, const float* const recurrent_row, const float* const input){
+	const float* previous = node->previous_input ? input : row+node->previous_activation_offset;
+	float* output = row+node->backlog_offset;
+	switch(node->type){
+	case OUTPUT_NODE:
+	case LAYER_NODE:{
+		const float* weights = parameters+node->parameter_offset;
+		float* activated = output+node->backlog_offset_activation;
+		if (node->epilogue != NEUROMORPH_EPILOGUE_NONE){
+			node_pass_epilogue(node, weights, weights+node->weight_buffer_size, previous, output, activated);
+			break;
+		}
+		node_pass_weights(node, weights, weights+node->weight_buffer_size, previous, output);
+		memcpy(activated, output, sizeof(float)*node->buffer_size);
+		node->activation_function(activated, node->buffer_size, node->activation_parameter);
+		break;
+	}
+	case CONVERGENT_NODE:{
+		if (node->convergent_owner == NULL){
+			memcpy(output, previous, sizeof(float)*node->buffer_size);
+			break;
+		}
+		const float* path = node->recurrent ? recurrent_row : row;
+		node->convergence_function(
+			node->convergent_input ? input : path+node->convergent_activation_offset,
+			previous,
+			output,
+			node->buffer_size
+		);
+		break;
+	}
+	case INPUT_NODE:
+	case DIVERGENT_NODE:
+		break;
+	}
+}
+
+/*
+ * Runs one sample through the schedule on a single thread.
+ * row is laid out like one sample of the backlog, so preactivations and activations land where backprop expects them,
+ * but it is owned by the caller, so any number of rows can be in flight at once.
+ * recurrent convergences read their path from recurrent_row, the row of the previous sample, which may be row itself.
+ * scratch needs room for the output width, the loss is only computed when expected is given.
+ * Registers as a reader of the published weights, use neuromorph_forward_row_from where they can not be swapped
+*/
+float neuromorph_forward_row(neuromorph* model, float* const row, const float* const recurrent_row, float* const scratch, const float* const input, const float* const expected){
+	size_t slot = neuromorph_read_enter(model);
+	const float* parameters = __atomic_load_n(&model->parameters, __ATOMIC_ACQUIRE);
+	float loss = neuromorph_forward_row_from(model, parameters, row, recurrent_row, scratch, input, expected);
+	neuromorph_read_exit(model, slot);
+	return loss;
+}
+
+/*
+ * neuromorph_forward_row over the given parameters without registering as a reader.
+ * Training, evaluation and gradient checks own model->parameters for their duration and read it directly,
+ * predict registers once for its whole batch
+*/
+float neuromorph_forward_row_from(neuromorph* model, const float* const parameters, float* const row, const float* const recurrent_row, float* const scratch, const float* const input, const float* const expected){
+	neuromorph_precision_thread = __atomic_load_n(&model->precision, __ATOMIC_RELAXED);
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		NEUROMORPH_PROFILE_BEGIN(start);
+		neuromorph_forward_node(node, parameters, row, recurrent_row, input);
+		NEUROMORPH_PROFILE_END(node, NEUROMORPH_PROFILE_FORWARD, start, 1);
+	}
+	if (expected == NULL){
+		return 0;
+	}
+	neuromorph_node* out = model->output;
+	if (out->softmax_cross_entropy){
+		return loss_softmax_cross_entropy(scratch, row+out->backlog_offset, expected, out->buffer_size, out->loss_parameter);
+	}
+	return out->loss_function(scratch, row+out->backlog_offset+out->backlog_offset_activation, expected, out->buffer_size, out->loss_parameter);
+}
+
+/*
+ * Batched inference over count independent samples, each with its own row of rows.
+ * Runs node by node across every sample rather than sample by sample, so each weight matrix is streamed once per batch
+ * and stays in cache while every sample is multiplied through it
+*/
+void neuromorph_forward_rows(neuromorph* model, float* const rows, const float* const recurrent_row, const float* const input, size_t count){
+	neuromorph_precision_thread = __atomic_load_n(&model->precision, __ATOMIC_RELAXED);
+	size_t slot = neuromorph_read_enter(model);
+	const float* parameters = __atomic_load_n(&model->parameters, __ATOMIC_ACQUIRE);
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		NEUROMORPH_PROFILE_BEGIN(start);
+		for (size_t sample = 0;sample<count;++sample){
+			neuromorph_forward_node(
+				node,
+				parameters,
+				rows+(sample*model->backlog_size),
+				recurrent_row,
+				input+(sample*model->input->buffer_size)
+			);
+		}
+		NEUROMORPH_PROFILE_END(node, NEUROMORPH_PROFILE_FORWARD, start, count);
+	}
+	neuromorph_read_exit(model, slot);
+}
+
+// y += a*x
+void neuromorph_axpy(float* const y, const float* const x, const float a, const size_t size){
+	size_t i = 0;
+#ifdef nm_sse
+	const __m128 scale = _mm_set1_ps(a);
+	for (;i+4<=size;i+=4){
+#ifdef nm_fma
+		_mm_storeu_ps(y+i, _mm_fmadd_ps(scale, _mm_loadu_ps(x+i), _mm_loadu_ps(y+i)));
+#else
+		_mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), _mm_mul_ps(scale, _mm_loadu_ps(x+i))));
+#endif
+	}
+#endif
+	for (;i<size;++i){
+		y[i] += a*x[i];
+	}
+}
+
+/*
+ * local is the gradient at the node's preactivation for one sample.
+ * Weight and bias gradients are summed into gradients, laid out as weights then biases,
+ * and the gradient at the previous activation is summed into previous_delta when there is one
+*/
+void neuromorph_layer_gradients(neuromorph_node* node, const float* const local, const float* const previous, float* const previous_delta, float* const gradients){
+	const size_t previous_size = *node->previous_buffer_size;
+	float* const bias_gradients = gradients+node->weight_buffer_size;
+	for (size_t i = 0;i<node->buffer_size;++i){
+		const float component = local[i];
+		bias_gradients[i] += component;
+		if (component == 0){
+			continue;
+		}
+		neuromorph_axpy(gradients+(i*previous_size), previous, component, previous_size);
+		if (previous_delta != NULL){
+			neuromorph_axpy(previous_delta, node->weight_buffer+(i*previous_size), component, previous_size);
+		}
+	}
+}
+
+/*
+ * Backward pass for one sample whose forward pass left its values in row.
+ * delta holds the gradient at every activation slot of the row and has to start zeroed,
+ * scratch needs room for twice the widest node.
+ * Recurrent paths read their values from recurrent_row, their gradient is summed into recurrent_delta,
+ * the delta of the previous step, or cut when recurrent_delta is NULL
+*/
+void neuromorph_backward_row(neuromorph* model, const float* const row, const float* const recurrent_row, float* const delta, float* const recurrent_delta, float* const scratch, const float* const input, const float* const expected, float* const gradients){
+	for (size_t i = model->schedule.size;i>0;--i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i-1];
+		const float* previous = node->previous_input ? input : row+node->previous_activation_offset;
+		float* previous_delta = node->previous_input ? NULL : delta+node->previous_activation_offset;
+		const float* node_delta = delta+node->backlog_offset+node->backlog_offset_activation;
+		const float* preactivation = row+node->backlog_offset;
+		NEUROMORPH_PROFILE_BEGIN(start);
+		switch(node->type){
+		case OUTPUT_NODE:
+			if (node->softmax_cross_entropy){
+				loss_softmax_cross_entropy_partial(scratch, preactivation+node->backlog_offset_activation, expected, node->buffer_size, node->loss_parameter);
+				neuromorph_layer_gradients(node, scratch, previous, previous_delta, gradients+node->parameter_offset);
+				break;
+			}
+			if (node->activation_function == activation_softmax){
+				for (size_t k = 0;k<node->buffer_size;++k){
+					scratch[k] = 1;
+				}
+			}
+			else{
+				node->activation_function_derivative(scratch, preactivation, node->buffer_size, node->activation_parameter);
+			}
+			node->loss_function_derivative(
+				scratch,
+				preactivation+node->backlog_offset_activation,
+				expected,
+				node->buffer_size,
+				node->loss_parameter
+			);
+			if (node->activation_function == activation_softmax){
+				neuromorph_softmax_backward(scratch, preactivation+node->backlog_offset_activation, scratch, node->buffer_size);
+			}
+			neuromorph_layer_gradients(node, scratch, previous, previous_delta, gradients+node->parameter_offset);
+			break;
+		case LAYER_NODE:
+			if (node->activation_function == activation_softmax){
+				neuromorph_softmax_backward(scratch, preactivation+node->backlog_offset_activation, node_delta, node->buffer_size);
+				neuromorph_layer_gradients(node, scratch, previous, previous_delta, gradients+node->parameter_offset);
+				break;
+			}
+			node->activation_function_derivative(scratch, preactivation, node->buffer_size, node->activation_parameter);
+			for (size_t k = 0;k<node->buffer_size;++k){
+				scratch[k] *= node_delta[k];
+			}
+			neuromorph_layer_gradients(node, scratch, previous, previous_delta, gradients+node->parameter_offset);
+			break;
+		case CONVERGENT_NODE:
+			if (node->convergent_owner == NULL){
+				if (previous_delta != NULL){
+					neuromorph_axpy(previous_delta, node_delta, 1, node->buffer_size);
+				}
+				break;
+			}
+			const float* path = node->convergent_input ? input : (node->recurrent ? recurrent_row : row)+node->convergent_activation_offset;
+			float* path_gradient = scratch+node->buffer_size;
+			node->convergence_function_derivative(node_delta, previous, path, scratch, path_gradient, node->buffer_size);
+			if (previous_delta != NULL){
+				neuromorph_axpy(previous_delta, scratch, 1, node->buffer_size);
+			}
+			if (node->convergent_input){
+				break;
+			}
+			if (!node->recurrent){
+				neuromorph_axpy(delta+node->convergent_activation_offset, path_gradient, 1, node->buffer_size);
+			}
+			else if (recurrent_delta != NULL){
+				neuromorph_axpy(recurrent_delta+node->convergent_activation_offset, path_gradient, 1, node->buffer_size);
+			}
+			break;
+		case INPUT_NODE:
+		case DIVERGENT_NODE:
+			break;
+		}
+		NEUROMORPH_PROFILE_END(node, NEUROMORPH_PROFILE_BACKWARD, start, 1);
+	}
+}
+
+void* neuromorph_evaluate_worker(void* args){
+	evaluate_args* work = args;
+	neuromorph* model = work->model;
+	float* row = work->rows;
+	float* scratch = row+model->backlog_size;
+	memset(row, 0, sizeof(float)*model->backlog_size);
+	NEUROMORPH_TRACE_BEGIN(start);
+	for (size_t sample = work->start;sample<work->end;++sample){
+		work->losses[sample] = neuromorph_forward_row_from(
+			model,
+			model->parameters,
+			row,
+			row,
+			scratch,
+			work->input+(sample*model->input->buffer_size),
+			work->expected+(sample*model->output->buffer_size)
+		);
+	}
+	NEUROMORPH_TRACE_END("evaluate chunk", "evaluate", start, work->end-work->start);
+	return NULL;
+}
+
+/*
+ * Forward pass and loss over sample_count samples without backprop, split into contiguous chunks across the model's worker pool.
+ * Per sample losses are written to losses when it is not NULL, the mean is summed in sample order so it does not depend on scheduling
+*/
+float neuromorph_evaluate(neuromorph* model, const float* input, const float* expected, size_t sample_count, float* const losses){
+	if (sample_count == 0){
+		return 0;
+	}
+	if (model->pool == NULL){
+		fprintf(stderr, "model has no worker pool, build it before evaluating\n");
+		return 0;
+	}
+	float* sample_losses = losses ? losses : malloc(sizeof(float)*sample_count);
+	size_t workers = neuromorph_batch_workers(model, sample_count);
+	if (workers > model->pool->workers){
+		workers = model->pool->workers;
+	}
+	size_t chunk = (sample_count+workers-1)/workers;
+	evaluate_args* work = malloc(sizeof(evaluate_args)*workers);
+	for (size_t i = 0;i<workers;++i){
+		work[i].model = model;
+		work[i].input = input;
+		work[i].expected = expected;
+		work[i].losses = sample_losses;
+		work[i].rows = neuromorph_pool_rows(model->pool, i);
+		work[i].start = i*chunk > sample_count ? sample_count : i*chunk;
+		work[i].end = (i+1)*chunk > sample_count ? sample_count : (i+1)*chunk;
+	}
+	neuromorph_pool_run(model->pool, neuromorph_evaluate_worker, work, sizeof(evaluate_args), workers);
+	float sum = 0;
+	for (size_t i = 0;i<sample_count;++i){
+		sum += sample_losses[i];
+	}
+	free(work);
+	if (!losses){
+		free(sample_losses);
+	}
+	return sum/sample_count;
+}
+
+/*
+ * Gives every node on the schedule with weights a region of model->parameter_count floats, weights followed by biases.
+ * The same layout is used for the parameter arena and for per worker gradient buffers
+*/
+void neuromorph_parameter_layout(neuromorph* model){
+	model->parameter_count = 0;
+	model->widest_node = 0;
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		if (node->buffer_size > model->widest_node){
+			model->widest_node = node->buffer_size;
+		}
+		if (node->type != LAYER_NODE && node->type != OUTPUT_NODE){
+			continue;
+		}
+		node->parameter_offset = model->parameter_count;
+		model->parameter_count += node->weight_buffer_size+node->bias_buffer_size;
+	}
+}
+
+/*
+ * Moves the weights and biases of every scheduled node into one contiguous arena, so the whole
+ * parameter set can be copied, saved or swapped as a single block
+*/
+uint8_t neuromorph_parameter_arena(neuromorph* model){
+#ifdef nm_sse
+	model->parameters = _mm_malloc(sizeof(float)*(model->parameter_count ? model->parameter_count : 1), 16);
+#else
+	model->parameters = malloc(sizeof(float)*(model->parameter_count ? model->parameter_count : 1));
+#endif
+	if (!model->parameters){
+		fprintf(stderr, "could not allocate memory for parameter arena\n");
+		return 0;
+	}
+	vector nodes = vector_init();
+	neuromorph_collect_nodes(model, &nodes);
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		if (node->type != LAYER_NODE && node->type != OUTPUT_NODE){
+			continue;
+		}
+		float* weights = model->parameters+node->parameter_offset;
+		for (size_t k = 0;k<nodes.size;++k){
+			neuromorph_node* reader = (neuromorph_node*)nodes.data[k];
+			if (reader->previous_weight_buffer == node->weight_buffer){
+				reader->previous_weight_buffer = weights;
 			}
-			forward_args* branch_pair = branch_args+i;
-			branch_pair->node = branch;
-			branch_pair->backlog = backlog;
-			branch_pair->mut = mut;
-			branch_pair->batch = args->batch;
-			pthread_create(&threads[index++], NULL, neuromorph_branch_forward, (void*)(branch_pair));
-		}
-		for (i = 0;i<index;++i){
-			void* candidate;
-			pthread_join(threads[i], &candidate);
-			if (candidate){
-				result = candidate;
+		}
+#ifdef nm_sse
+		_mm_free(node->weight_buffer);
+		_mm_free(node->bias_buffer);
+#else
+		free(node->weight_buffer);
+		free(node->bias_buffer);
+#endif
+		node->weight_buffer = weights;
+		node->bias_buffer = weights+node->weight_buffer_size;
+	}
+	vector_free(&nodes);
+	return 1;
+}
+
+// points every scheduled node's weights and biases, and every reader of them, into parameters laid out by neuromorph_parameter_layout
+void neuromorph_parameter_rebind(neuromorph* model, float* const parameters){
+	vector nodes = vector_init();
+	neuromorph_collect_nodes(model, &nodes);
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		if (node->type != LAYER_NODE && node->type != OUTPUT_NODE){
+			continue;
+		}
+		float* weights = parameters+node->parameter_offset;
+		for (size_t k = 0;k<nodes.size;++k){
+			neuromorph_node* reader = (neuromorph_node*)nodes.data[k];
+			if (reader->previous_weight_buffer == node->weight_buffer){
+				reader->previous_weight_buffer = weights;
 			}
 		}
-		free(branch_args);
-		if (end){
-			thread_signal_ready(node);
+		node->weight_buffer = weights;
+		node->bias_buffer = weights+node->weight_buffer_size;
+	}
+	vector_free(&nodes);
+	model->parameters = parameters;
+}
+
+/*
+ * Replaces the model's own arena with parameters inside a read only mapping, which the model unmaps when freed.
+ * Any number of processes can map the same file or shared memory segment, so the weights are resident once,
+ * each process only allocating its own activations. A mapped model can predict but not train
+*/
+uint8_t neuromorph_parameter_map(neuromorph* model, void* map, size_t map_size, float* const parameters){
+	if (model->parameter_map != NULL){
+		fprintf(stderr, "model parameters are already mapped\n");
+		return 0;
+	}
+	float* owned = model->parameters;
+	neuromorph_parameter_rebind(model, parameters);
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+#ifdef nm_sse
+		_mm_free(node->weight_state);
+		_mm_free(node->bias_state);
+#else
+		free(node->weight_state);
+		free(node->bias_state);
+#endif
+		node->weight_state = NULL;
+		node->bias_state = NULL;
+	}
+#ifdef nm_sse
+	_mm_free(owned);
+#else
+	free(owned);
+#endif
+	model->parameter_map = map;
+	model->parameter_map_size = map_size;
+	return 1;
+}
+
+size_t neuromorph_input_width(const neuromorph* model){
+	return model->input->buffer_size;
+}
+
+size_t neuromorph_output_width(const neuromorph* model){
+	return model->output->buffer_size;
+}
+
+size_t neuromorph_batch_size(const neuromorph* model){
+	return model->batch_size;
+}
+
+size_t neuromorph_parameter_count(const neuromorph* model){
+	return model->parameter_count;
+}
+
+// copies the weights and biases in the order neuromorph_publish takes them, out needs room for the parameter count
+void neuromorph_get_parameters(neuromorph* model, float* const out){
+	size_t slot = neuromorph_read_enter(model);
+	const float* parameters = __atomic_load_n(&model->parameters, __ATOMIC_ACQUIRE);
+	memcpy(out, parameters, sizeof(float)*model->parameter_count);
+	neuromorph_read_exit(model, slot);
+}
+
+// 0 uses every online core, returns the count now in use
+uint16_t neuromorph_set_workers(neuromorph* model, uint16_t workers){
+	model->worker_count = workers ? workers : neuromorph_default_workers();
+	model->workers_default = 0;
+	if (model->pool != NULL && model->pool->workers != model->worker_count){
+		neuromorph_pool_start(model);
+	}
+	return model->worker_count;
+}
+
+/*
+ * Workers samples independent samples are split over. Recurrent convergences read the previous sample of the same chunk,
+ * so graphs with them only split when the caller chose a worker count, otherwise results would depend on the core count
+*/
+size_t neuromorph_batch_workers(const neuromorph* model, size_t samples){
+	size_t workers = model->worker_count == 0 ? 1 : model->worker_count;
+	if (model->workers_default && model->recurrent_sources.size > 0){
+		workers = 1;
+	}
+	return workers < samples ? workers : samples;
+}
+
+// forward passes run the model's kernels at this precision from their next call
+uint8_t neuromorph_set_precision(neuromorph* model, uint8_t precision){
+	if (precision >= NEUROMORPH_PRECISIONS){
+		fprintf(stderr, "unknown precision tier %u\n", precision);
+		return 0;
+	}
+	__atomic_store_n(&model->precision, precision, __ATOMIC_RELAXED);
+	return 1;
+}
+
+// the precision models start with
+uint8_t neuromorph_set_default_precision(uint8_t precision){
+	if (precision >= NEUROMORPH_PRECISIONS){
+		fprintf(stderr, "unknown precision tier %u\n", precision);
+		return 0;
+	}
+	__atomic_store_n(&precision_default, precision, __ATOMIC_RELAXED);
+	return 1;
+}
+
+// precision of kernels the calling thread runs outside of a model's forward pass
+void neuromorph_use_precision(uint8_t precision){
+	neuromorph_precision_thread = precision < NEUROMORPH_PRECISIONS ? precision : NEUROMORPH_PRECISION_ACCURATE;
+}
+
+const char* neuromorph_precision_name(uint8_t precision){
+	return precision < NEUROMORPH_PRECISIONS ? precision_names[precision] : "unknown";
+}
+
+// NEUROMORPH_PRECISIONS when the name is not a tier
+uint8_t neuromorph_precision_parse(const char* name){
+	for (uint8_t i = 0;i<NEUROMORPH_PRECISIONS;++i){
+		if (strcmp(name, precision_names[i]) == 0){
+			return i;
+		}
+	}
+	return NEUROMORPH_PRECISIONS;
+}
+
+neuromorph_pool* neuromorph_pool_init(size_t workers, size_t row_stride){
+	neuromorph_pool* pool = calloc(1, sizeof(neuromorph_pool));
+	if (!pool){
+		fprintf(stderr, "could not allocate memory for worker pool\n");
+		return NULL;
+	}
+	pool->workers = workers == 0 ? 1 : workers;
+	pool->row_stride = row_stride;
+	pool->threads = malloc(sizeof(pthread_t)*pool->workers);
+	pool->slots = malloc(sizeof(neuromorph_pool_slot)*pool->workers);
+	pool->rows = malloc(sizeof(float)*(row_stride ? row_stride : 1)*pool->workers);
+	if (!pool->threads || !pool->slots || !pool->rows){
+		fprintf(stderr, "could not allocate memory for worker pool\n");
+		free(pool->threads);
+		free(pool->slots);
+		free(pool->rows);
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	size_t started = 1;
+	for (;started<pool->workers;++started){
+		pool->slots[started].pool = pool;
+		pool->slots[started].index = started;
+		if (pthread_create(&pool->threads[started-1], NULL, neuromorph_pool_thread, (void*)(pool->slots+started)) != 0){
+			fprintf(stderr, "could only start %zu of %zu workers\n", started, pool->workers);
+			break;
+		}
+	}
+	pool->workers = started;
+	return pool;
+}
+
+void neuromorph_pool_free(neuromorph_pool* pool){
+	if (pool == NULL){
+		return;
+	}
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->mutex);
+	for (size_t i = 1;i<pool->workers;++i){
+		pthread_join(pool->threads[i-1], NULL);
+	}
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->idle);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool->slots);
+	free(pool->rows);
+	free(pool);
+}
+
+void* neuromorph_pool_thread(void* args){
+	neuromorph_pool_slot* slot = args;
+	neuromorph_pool* pool = slot->pool;
+	size_t seen = 0;
+	pthread_mutex_lock(&pool->mutex);
+	for (;;){
+		while (pool->generation == seen && !pool->stopping){
+			pthread_cond_wait(&pool->wake, &pool->mutex);
+		}
+		if (pool->stopping){
+			break;
+		}
+		seen = pool->generation;
+		if (slot->index >= pool->job_count){
+			continue;
+		}
+		void* (*job)(void*) = pool->job;
+		void* work = pool->args+(slot->index*pool->args_size);
+		pthread_mutex_unlock(&pool->mutex);
+		job(work);
+		pthread_mutex_lock(&pool->mutex);
+		pool->running -= 1;
+		if (pool->running == 0){
+			pthread_cond_signal(&pool->idle);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+// runs job on count consecutive argument structs, the first on the calling thread, and returns once all of them are done
+void neuromorph_pool_run(neuromorph_pool* pool, void* (*job)(void*), void* args, size_t args_size, size_t count){
+	if (count > pool->workers){
+		count = pool->workers;
+	}
+	if (count > 1){
+		pthread_mutex_lock(&pool->mutex);
+		pool->job = job;
+		pool->args = args;
+		pool->args_size = args_size;
+		pool->job_count = count;
+		pool->running = count-1;
+		pool->generation += 1;
+		pthread_cond_broadcast(&pool->wake);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	if (count > 0){
+		job(args);
+	}
+	if (count > 1){
+		NEUROMORPH_TRACE_BEGIN(join);
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->running > 0){
+			pthread_cond_wait(&pool->idle, &pool->mutex);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+		NEUROMORPH_TRACE_END("join workers", "wait", join, 0);
+	}
+}
+
+float* neuromorph_pool_rows(neuromorph_pool* pool, size_t worker){
+	return pool->rows+(worker*pool->row_stride);
+}
+
+// (re)starts the model's pool at worker_count workers once the node widths are known
+uint8_t neuromorph_pool_start(neuromorph* model){
+	neuromorph_pool_free(model->pool);
+	model->pool = neuromorph_pool_init(model->worker_count, (2*model->backlog_size)+(2*model->widest_node));
+	return model->pool != NULL;
+}
+
+float* neuromorph_worker_gradients(neuromorph* model, size_t workers){
+	if (model->worker_gradient_slots < workers){
+		free(model->worker_gradients);
+		model->worker_gradients = malloc(sizeof(float)*model->parameter_count*workers);
+		model->worker_gradient_slots = workers;
+	}
+	return model->worker_gradients;
+}
+
+void* neuromorph_train_worker(void* args){
+	train_args* work = args;
+	neuromorph* model = work->model;
+	memset(work->gradients, 0, sizeof(float)*model->parameter_count);
+	float* carry = work->rows;
+	float* delta = carry+model->backlog_size;
+	float* scratch = delta+model->backlog_size;
+	memset(carry, 0, sizeof(float)*model->backlog_size);
+	const float* recurrent_row = carry;
+	NEUROMORPH_TRACE_BEGIN(start);
+	for (size_t sample = work->start;sample<work->end;++sample){
+		float* row = model->batch_backlog+(sample*model->backlog_size);
+		const float* input = work->input+(sample*model->input->buffer_size);
+		const float* expected = work->expected+(sample*model->output->buffer_size);
+		work->losses[sample] = neuromorph_forward_row_from(model, model->parameters, row, recurrent_row, scratch, input, expected);
+		memset(delta, 0, sizeof(float)*model->backlog_size);
+		neuromorph_backward_row(model, row, recurrent_row, delta, NULL, scratch, input, expected, work->gradients);
+		recurrent_row = row;
+	}
+	NEUROMORPH_TRACE_END("train chunk", "train", start, work->end-work->start);
+	return NULL;
+}
+
+// sums every worker's gradients into the first worker's, always in worker order
+void* neuromorph_reduce_worker(void* args){
+	reduce_args* work = args;
+	float* total = work->gradients+work->start;
+	NEUROMORPH_TRACE_BEGIN(start);
+	for (size_t w = 1;w<work->workers;++w){
+		neuromorph_axpy(total, work->gradients+(w*work->stride)+work->start, 1, work->end-work->start);
+	}
+	NEUROMORPH_TRACE_END("reduce chunk", "train", start, 0);
+	return NULL;
+}
+
+// splits the sum by parameter across the pool, small models are summed on the calling thread
+void neuromorph_reduce_gradients(neuromorph* model, float* const gradients, size_t workers){
+	if (workers < 2){
+		return;
+	}
+	const size_t stride = model->parameter_count;
+	size_t split = stride*(workers-1) < NEUROMORPH_REDUCE_SERIAL ? 1 : workers;
+	size_t chunk = (stride+split-1)/split;
+	reduce_args* work = malloc(sizeof(reduce_args)*split);
+	for (size_t i = 0;i<split;++i){
+		work[i].gradients = gradients;
+		work[i].stride = stride;
+		work[i].workers = workers;
+		work[i].start = i*chunk > stride ? stride : i*chunk;
+		work[i].end = (i+1)*chunk > stride ? stride : (i+1)*chunk;
+	}
+	neuromorph_pool_run(model->pool, neuromorph_reduce_worker, work, sizeof(reduce_args), split);
+	free(work);
+}
+
+// applies summed gradients laid out by neuromorph_parameter_layout, averaged over sample_count
+void neuromorph_apply_gradients(neuromorph* model, float* const gradients, size_t sample_count){
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		if (node->type != LAYER_NODE && node->type != OUTPUT_NODE){
+			continue;
+		}
+		float* weight_gradients = gradients+node->parameter_offset;
+		update_learnables_from(node, weight_gradients+node->weight_buffer_size, weight_gradients, sample_count, model->learning_rate);
+	}
+}
+
+/*
+ * Accumulation mode, gradients of accumulation_steps micro batches are summed into a persistent buffer
+ * and applied once as a single update averaged over every accumulated sample.
+ * The buffer is sized by the parameter layout, so the model has to be built first
+*/
+uint8_t neuromorph_set_accumulation(neuromorph* model, size_t steps){
+	if (model->schedule.size == 0){
+		fprintf(stderr, "gradient accumulation needs a built model, build it first\n");
+		return 0;
+	}
+	neuromorph_flush_gradients(model);
+	model->accumulation_steps = steps == 0 ? 1 : steps;
+	if (model->accumulation_steps == 1 || model->accumulated_gradients != NULL){
+		return 1;
+	}
+	model->accumulated_gradients = calloc(model->parameter_count, sizeof(float));
+	if (!model->accumulated_gradients){
+		fprintf(stderr, "could not allocate memory for accumulated gradients\n");
+		model->accumulation_steps = 1;
+		return 0;
+	}
+	return 1;
+}
+
+void neuromorph_accumulate_gradients(neuromorph* model, const float* const gradients){
+	neuromorph_axpy(model->accumulated_gradients, gradients, 1, model->parameter_count);
+	model->accumulated_batches += 1;
+	if (model->accumulated_batches >= model->accumulation_steps){
+		neuromorph_flush_gradients(model);
+	}
+}
+
+// applies whatever has been accumulated so far, used once the steps are complete and at the end of every epoch
+void neuromorph_flush_gradients(neuromorph* model){
+	if (model->accumulated_batches == 0){
+		return;
+	}
+	neuromorph_apply_gradients(model, model->accumulated_gradients, model->accumulated_batches*model->batch_size);
+	memset(model->accumulated_gradients, 0, sizeof(float)*model->parameter_count);
+	model->accumulated_batches = 0;
+}
+
+/*
+ * Splits the batch into contiguous chunks over worker threads. Each worker runs forward and backward
+ * for its samples on the schedule, writing the samples own backlog rows and summing gradients privately.
+ * Gradients are then reduced in worker order and applied once, so a given worker count always gives the same update.
+ * Recurrent convergences read the previous sample in the same chunk, the first sample of a chunk reads zeros,
+ * which is why such graphs keep the whole batch on one worker unless a count was set
+*/
+float neuromorph_train_batch(neuromorph* model, const float* input, const float* expected, uint8_t verbose){
+	if (model->parameter_map != NULL){
+		fprintf(stderr, "model parameters are mapped read only and can not be trained\n");
+		return 0;
+	}
+	NEUROMORPH_TRACE_BEGIN(batch_start);
+	if (model->pool == NULL){
+		fprintf(stderr, "model has no worker pool, build it before training\n");
+		return 0;
+	}
+	size_t workers = neuromorph_batch_workers(model, model->batch_size);
+	if (workers > model->pool->workers){
+		workers = model->pool->workers;
+	}
+	float* gradients = neuromorph_worker_gradients(model, workers);
+	float* losses = malloc(sizeof(float)*model->batch_size);
+	size_t chunk = (model->batch_size+workers-1)/workers;
+	train_args* work = malloc(sizeof(train_args)*workers);
+	for (size_t i = 0;i<workers;++i){
+		work[i].model = model;
+		work[i].input = input;
+		work[i].expected = expected;
+		work[i].losses = losses;
+		work[i].gradients = gradients+(i*model->parameter_count);
+		work[i].rows = neuromorph_pool_rows(model->pool, i);
+		work[i].start = i*chunk > model->batch_size ? model->batch_size : i*chunk;
+		work[i].end = (i+1)*chunk > model->batch_size ? model->batch_size : (i+1)*chunk;
+	}
+	neuromorph_pool_run(model->pool, neuromorph_train_worker, work, sizeof(train_args), workers);
+	free(work);
+	neuromorph_reduce_gradients(model, gradients, workers);
+	NEUROMORPH_TRACE_BEGIN(apply);
+	if (model->accumulation_steps > 1){
+		neuromorph_accumulate_gradients(model, gradients);
+	}
+	else{
+		neuromorph_apply_gradients(model, gradients, model->batch_size);
+	}
+	NEUROMORPH_TRACE_END("apply gradients", "train", apply, 0);
+	float sum = 0;
+	for (size_t pass = 0;pass<model->batch_size;++pass){
+		if (verbose >= 2){
+			printf("Loss[%lu]: %.2f\n", pass, losses[pass]);
 		}
-		free(threads);
-		pthread_exit(result);
-		break;
-	case CONVERGENT_NODE:
-		if (node->convergent_buffer){
-			pthread_mutex_lock(&node->convergent_node->mutex);
-			if (!(node->convergent_node->ready || node->convergent_node->loop)){
-				node->convergent_node->unrolled_front = 0;
-				pthread_cond_wait(&node->convergent_node->cond, &node->convergent_node->mutex);
-			}
-			pthread_mutex_lock(&node->mutex);
-			node->convergence_function(
-				node->convergent_buffer,
-				node->previous_neuron_buffer,
-				node->neuron_buffer,
-				node->buffer_size
+		sum += losses[pass];
+	}
+	free(losses);
+	if (verbose >= 2){
+		printf("Batch loss: %.2f\n", sum/model->batch_size);
+	}
+	NEUROMORPH_TRACE_END("batch", "train", batch_start, model->batch_size);
+	return sum/model->batch_size;
+}
+
+/*
+ * Runs steps [window_start, window_end) of every sequence in the worker's chunk and backpropagates through all of them.
+ * Each sequence owns a ring of window+1 backlog rows, step t lives in row t%(window+1),
+ * so the step before the window is still there to be read by the window's first step.
+*/
+void* neuromorph_sequence_worker(void* args){
+	sequence_args* work = args;
+	neuromorph* model = work->model;
+	const size_t backlog_size = model->backlog_size;
+	const size_t ring = work->window+1;
+	const size_t steps = work->window_end-work->window_start;
+	const size_t input_width = model->input->buffer_size;
+	const size_t output_width = model->output->buffer_size;
+	memset(work->gradients, 0, sizeof(float)*model->parameter_count);
+	float* zeros = work->rows;
+	float* scratch = zeros+(2*backlog_size);
+	float* deltas = malloc(sizeof(float)*backlog_size*steps);
+	memset(zeros, 0, sizeof(float)*backlog_size);
+	NEUROMORPH_TRACE_BEGIN(start);
+	for (size_t sequence = work->start;sequence<work->end;++sequence){
+		float* rows = work->ring+(sequence*ring*backlog_size);
+		const float* input = work->input+(sequence*work->timesteps*input_width);
+		const float* expected = work->expected+(sequence*work->timesteps*output_width);
+		for (size_t t = work->window_start;t<work->window_end;++t){
+			const float* recurrent_row = t == 0 ? zeros : rows+(((t-1)%ring)*backlog_size);
+			work->losses[sequence] += neuromorph_forward_row_from(
+				model,
+				model->parameters,
+				rows+((t%ring)*backlog_size),
+				recurrent_row,
+				scratch,
+				input+(t*input_width),
+				expected+(t*output_width)
 			);
-			write_to_backlog(
-				backlog,
-				mut,
-				node->neuron_buffer,
-				node->buffer_size,
-				node->backlog_offset,
-				args->batch
+		}
+		memset(deltas, 0, sizeof(float)*backlog_size*steps);
+		for (size_t t = work->window_end;t>work->window_start;--t){
+			size_t step = t-1-work->window_start;
+			neuromorph_backward_row(
+				model,
+				rows+(((t-1)%ring)*backlog_size),
+				t == 1 ? zeros : rows+(((t-2)%ring)*backlog_size),
+				deltas+(step*backlog_size),
+				step == 0 ? NULL : deltas+((step-1)*backlog_size),
+				scratch,
+				input+((t-1)*input_width),
+				expected+((t-1)*output_width),
+				work->gradients
 			);
-			pthread_mutex_unlock(&node->mutex);
-			if (!node->convergent_node->loop){
-				node->convergent_node->ready = 0;
+		}
+	}
+	NEUROMORPH_TRACE_END("sequence chunk", "train", start, (work->end-work->start)*steps);
+	free(deltas);
+	return NULL;
+}
+
+/*
+ * Truncated backpropagation through time over sequence_count sequences of timesteps samples each, laid out sequence after sequence.
+ * Up to batch_size sequences run side by side, split across workers, and are unrolled window steps at a time.
+ * Every step has a loss, gradients of a window are summed over its steps and sequences and applied once per window,
+ * recurrent state carries across windows but gradients stop at the window boundary.
+ * Returns the mean loss over every step of every sequence
+*/
+float neuromorph_train_sequences(neuromorph* model, const float* input, const float* expected, size_t sequence_count, size_t timesteps, size_t window, uint8_t verbose){
+	if (model->parameter_map != NULL){
+		fprintf(stderr, "model parameters are mapped read only and can not be trained\n");
+		return 0;
+	}
+	if (model->pool == NULL){
+		fprintf(stderr, "model has no worker pool, build it before training\n");
+		return 0;
+	}
+	if (sequence_count == 0 || timesteps == 0){
+		return 0;
+	}
+	if (window == 0 || window > timesteps){
+		window = timesteps;
+	}
+	const size_t ring = window+1;
+	float* rows = malloc(sizeof(float)*model->backlog_size*ring*model->batch_size);
+	float* losses = malloc(sizeof(float)*model->batch_size);
+	sequence_args* work = malloc(sizeof(sequence_args)*model->batch_size);
+	float total = 0;
+	for (size_t first = 0;first<sequence_count;first+=model->batch_size){
+		size_t batch = sequence_count-first < model->batch_size ? sequence_count-first : model->batch_size;
+		size_t workers = model->pool->workers < batch ? model->pool->workers : batch;
+		size_t chunk = (batch+workers-1)/workers;
+		float* gradients = neuromorph_worker_gradients(model, workers);
+		memset(losses, 0, sizeof(float)*batch);
+		for (size_t window_start = 0;window_start<timesteps;window_start+=window){
+			for (size_t i = 0;i<workers;++i){
+				work[i].model = model;
+				work[i].input = input+(first*timesteps*model->input->buffer_size);
+				work[i].expected = expected+(first*timesteps*model->output->buffer_size);
+				work[i].ring = rows;
+				work[i].losses = losses;
+				work[i].gradients = gradients+(i*model->parameter_count);
+				work[i].rows = neuromorph_pool_rows(model->pool, i);
+				work[i].timesteps = timesteps;
+				work[i].window = window;
+				work[i].window_start = window_start;
+				work[i].window_end = window_start+window > timesteps ? timesteps : window_start+window;
+				work[i].start = i*chunk > batch ? batch : i*chunk;
+				work[i].end = (i+1)*chunk > batch ? batch : (i+1)*chunk;
 			}
-			pthread_mutex_unlock(&node->convergent_node->mutex);
+			neuromorph_pool_run(model->pool, neuromorph_sequence_worker, work, sizeof(sequence_args), workers);
+			neuromorph_reduce_gradients(model, gradients, workers);
+			NEUROMORPH_TRACE_BEGIN(apply);
+			neuromorph_apply_gradients(model, gradients, batch*(work[0].window_end-window_start));
+			NEUROMORPH_TRACE_END("apply gradients", "train", apply, 0);
 		}
-		if (end){
-			thread_signal_ready(node);
-			pthread_exit(NULL);
+		for (size_t i = 0;i<batch;++i){
+			if (verbose >= 2){
+				printf("Sequence loss[%lu]: %.4f\n", first+i, losses[i]/timesteps);
+			}
+			total += losses[i];
 		}
-		neuromorph_branch_forward((void*)(&new_pair));
-		break;
 	}
-	return NULL;
+	free(rows);
+	free(losses);
+	free(work);
+	float loss = total/(sequence_count*timesteps);
+	if (verbose >= 1){
+		printf("Sequences: %lu of %lu steps, window %lu, loss %.4f\n", sequence_count, timesteps, window, loss);
+	}
+	return loss;
+}
+
+/*
+ * A context is the per caller half of a model, the scratch rows one thread needs to run the schedule.
+ * The model itself is only read, so any number of contexts can run over it at once without locks
+*/
+neuromorph_context* neuromorph_context_init(neuromorph* model){
+	neuromorph_context* context = malloc(sizeof(neuromorph_context));
+	if (!context){
+		fprintf(stderr, "could not allocate memory for context\n");
+		return NULL;
+	}
+	context->model = model;
+	context->row = calloc(model->backlog_size+model->output->buffer_size, sizeof(float));
+	if (!context->row){
+		fprintf(stderr, "could not allocate memory for context row\n");
+		free(context);
+		return NULL;
+	}
+	context->scratch = context->row+model->backlog_size;
+	return context;
+}
+
+void neuromorph_context_free(neuromorph_context* context){
+	free(context->row);
+	free(context);
+}
+
+/*
+ * Forward pass of one sample, recurrent convergences read the previous sample run through the same context.
+ * output receives the output activations when it is not NULL, the loss is returned when expected is given
+*/
+float neuromorph_context_forward(neuromorph_context* context, const float* const input, const float* const expected, float* const output){
+	neuromorph* model = context->model;
+	float loss = neuromorph_forward_row(model, context->row, context->row, context->scratch, input, expected);
+	if (output != NULL){
+		neuromorph_node* out = model->output;
+		memcpy(output, context->row+out->backlog_offset+out->backlog_offset_activation, sizeof(float)*out->buffer_size);
+	}
+	return loss;
+}
+
+/*
+ * Predicts sample_count samples one after another through the context, registering as a reader once for the whole call
+*/
+void neuromorph_predict(neuromorph_context* context, const float* input, float* output, size_t sample_count){
+	neuromorph* model = context->model;
+	neuromorph_node* out = model->output;
+	size_t slot = neuromorph_read_enter(model);
+	const float* parameters = __atomic_load_n(&model->parameters, __ATOMIC_ACQUIRE);
+	for (size_t i = 0;i<sample_count;++i){
+		neuromorph_forward_row_from(model, parameters, context->row, context->row, context->scratch, input+(i*model->input->buffer_size), NULL);
+		memcpy(output+(i*out->buffer_size), context->row+out->backlog_offset+out->backlog_offset_activation, sizeof(float)*out->buffer_size);
+	}
+	neuromorph_read_exit(model, slot);
+}
+
+/*
+ * Sessions hold only the activations that recurrent convergences read on the next step,
+ * so any number of them can run over one model's weights
+*/
+neuromorph_session* neuromorph_session_init(neuromorph* model){
+	neuromorph_session* session = malloc(sizeof(neuromorph_session));
+	if (!session){
+		fprintf(stderr, "could not allocate memory for session\n");
+		return NULL;
+	}
+	session->model = model;
+	session->steps = 0;
+	session->state = calloc(model->state_size ? model->state_size : 1, sizeof(float));
+	if (!session->state){
+		fprintf(stderr, "could not allocate memory for session state\n");
+		free(session);
+		return NULL;
+	}
+	return session;
+}
+
+void neuromorph_session_free(neuromorph_session* session){
+	free(session->state);
+	free(session);
+}
+
+void neuromorph_session_reset(neuromorph_session* session){
+	memset(session->state, 0, sizeof(float)*session->model->state_size);
+	session->steps = 0;
+}
+
+size_t neuromorph_session_bytes(const neuromorph* model){
+	return sizeof(neuromorph_session)+(sizeof(float)*model->state_size);
+}
+
+/*
+ * Inference only forward pass for one timestep, the recurrent state is loaded into the row,
+ * the schedule reads it where it would read the previous step, and the new values are stored back.
+ * The context only lends its scratch, so one context can serve many sessions from one thread.
+ * output receives the output activations
+*/
+void neuromorph_session_step(neuromorph_session* session, neuromorph_context* context, const float* const input, float* const output){
+	neuromorph* model = session->model;
+	float* row = context->row;
+	float* scratch = context->scratch;
+	for (size_t i = 0;i<model->recurrent_sources.size;++i){
+		neuromorph_node* source = (neuromorph_node*)model->recurrent_sources.data[i];
+		memcpy(
+			row+source->backlog_offset+source->backlog_offset_activation,
+			session->state+source->state_offset,
+			sizeof(float)*source->buffer_size
+		);
+	}
+	neuromorph_forward_row(model, row, row, scratch, input, NULL);
+	for (size_t i = 0;i<model->recurrent_sources.size;++i){
+		neuromorph_node* source = (neuromorph_node*)model->recurrent_sources.data[i];
+		memcpy(
+			session->state+source->state_offset,
+			row+source->backlog_offset+source->backlog_offset_activation,
+			sizeof(float)*source->buffer_size
+		);
+	}
+	neuromorph_node* out = model->output;
+	memcpy(output, row+out->backlog_offset+out->backlog_offset_activation, sizeof(float)*out->buffer_size);
+	session->steps += 1;
 }
 
 void set_seed(time_t seed){
@@ -2296,6 +3806,40 @@ void weight_bias_initialize(neuromorph* model){
 	);
 }
 
+float* optimizer_state_alloc(size_t size){
+#ifdef nm_sse
+	float* state = _mm_malloc(sizeof(float)*size, 16);
+#else
+	float* state = malloc(sizeof(float)*size);
+#endif
+	if (!state){
+		fprintf(stderr, "could not allocate memory for optimizer state\n");
+		return NULL;
+	}
+	memset(state, 0, sizeof(float)*size);
+	return state;
+}
+
+void optimizer_state_initialize(neuromorph* model){
+	vector nodes = vector_init();
+	neuromorph_collect_nodes(model, &nodes);
+	const neuromorph_optimizer* optimizer = &model->header.optimizer;
+	for (size_t i = 0;i<nodes.size;++i){
+		neuromorph_node* node = (neuromorph_node*)nodes.data[i];
+		if (node->type != LAYER_NODE && node->type != OUTPUT_NODE){
+			continue;
+		}
+		node->optimizer = optimizer;
+		node->optimizer_step = 0;
+		if (optimizer->moments == 0){
+			continue;
+		}
+		node->weight_state = optimizer_state_alloc(node->weight_buffer_size*optimizer->moments);
+		node->bias_state = optimizer_state_alloc(node->bias_buffer_size*optimizer->moments);
+	}
+	vector_free(&nodes);
+}
+
 void convergence_multiplicative_partial(const float* const prev_gradient, const float* const prev, const float* const path, float* const gradient, float* const path_gradient, const size_t size){
 	for (size_t i = 0;i<size;++i){
 		float previous_gradient = prev_gradient[i];
@@ -2317,52 +3861,65 @@ void convergence_average_partial(const float* const prev_gradient, const float*
 	}
 }
 
+// mse, mae and mape average over the output, so their derivatives carry the 1/size too
 void loss_mse_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter){
+	const float coef = 2.0f/size;
 	for (size_t i = 0;i<size;++i){
-		gradient[i] *= 2*(result[i]-expected[i]);
+		gradient[i] *= coef*(result[i]-expected[i]);
 	}
 }
 
 void loss_mae_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
 		float term = result[i]-expected[i];
-		gradient[i] *= term/fabsf(term);
+		gradient[i] *= (float)((0<term)-(term<0))/size;
 	}
 }
 
 void loss_mape_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
-		float term = expected[i]-result[i];
-		gradient[i] *= (1/powf(expected[i], 2))*term/fabsf(term);
+		float term = result[i]-expected[i];
+		gradient[i] *= (float)((0<term)-(term<0))/(fabsf(expected[i])*size);
 	}
 }
 
 void loss_huber_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
-		float term = expected[i]-result[i];
-		if (term <= parameter){
-			gradient[i] = term;
+		float term = result[i]-expected[i];
+		if (fabsf(term) <= parameter){
+			gradient[i] *= term;
 			continue;
 		}
-		gradient[i] *= parameter*(int)((0<term)-(term<0));
+		gradient[i] *= parameter*(float)((0<term)-(term<0));
 	}
 }
 
+// the modified huber of the loss, quadratic in the margin expected*result above -1 and linear below
 void loss_huber_modified_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter){
-	float coef = 1/parameter;
 	for (size_t i = 0;i<size;++i){
-		float term = result[i]-expected[i];
-		if (expected[i]-result[i] <= parameter){
-			gradient[i] *= term*coef;
+		float margin = expected[i]*result[i];
+		if (margin > -1){
+			gradient[i] *= -2*expected[i]*fmaxf(0, 1-margin);
 			continue;
 		}
-		gradient[i] *= (int)((0<term)-(term-0));
+		gradient[i] *= -4*expected[i];
 	}
 }
 
 void loss_cross_entropy_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
-		gradient[i] *= (-(expected[i]/result[i]))+((1-expected[i])/(1-result[i]));
+		gradient[i] *= -expected[i]/result[i];
+	}
+}
+
+// gradient at the logits from the softmax output, p-y when expected sums to 1, written rather than scaled into gradient
+void loss_softmax_cross_entropy_partial(float* const gradient, const float* const activated, const float* const expected, const size_t size, const float parameter){
+	float mass = 0;
+	for (size_t i = 0;i<size;++i){
+		mass += expected[i];
+	}
+	for (size_t i = 0;i<size;++i){
+		gradient[i] = (activated[i]*mass)-expected[i];
 	}
 }
 
@@ -2400,7 +3957,9 @@ void activation_binary_step_partial(float* const gradient, const float* const bu
 }
 
 void activation_linear_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter){
-	memset(gradient, 1, size*sizeof(float));
+	for (size_t i = 0;i<size;++i){
+		gradient[i] = 1;
+	}
 }
 
 void activation_relu_leaky_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter){
@@ -2409,7 +3968,7 @@ void activation_relu_leaky_partial(float* const gradient, const float* const buf
 			gradient[i] = 1;
 			continue;
 		}
-		gradient[i] = 0.01;
+		gradient[i] = 0.1;
 	}
 }
 
@@ -2433,31 +3992,42 @@ void activation_elu_partial(float* const gradient, const float* const buffer, co
 	}
 }
 
+/*
+ * The diagonal of the softmax Jacobian, all an elementwise derivative can hold.
+ * Backward passes over the schedule take the full Jacobian through neuromorph_softmax_backward instead
+*/
 void activation_softmax_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter){
+	float max = buffer[0];
+	for (size_t i = 1;i<size;++i){
+		max = fmaxf(max, buffer[i]);
+	}
 	float sum = 0.0f;
-	float* softmax_values = malloc(sizeof(float)*size);
 	for (size_t i = 0;i<size;++i){
-		softmax_values[i] = exp(buffer[i]);
-		sum += softmax_values[i];
+		gradient[i] = expf(buffer[i]-max);
+		sum += gradient[i];
 	}
 	for (size_t i = 0;i<size;++i){
-		softmax_values[i] /= sum;
+		float s = gradient[i]/sum;
+		gradient[i] = s*(1-s);
 	}
+}
+
+// gradient at the preactivation from upstream, the gradient at the softmax output, gradient may alias upstream
+void neuromorph_softmax_backward(float* const gradient, const float* const activated, const float* const upstream, const size_t size){
+	float dot = 0;
 	for (size_t i = 0;i<size;++i){
-		gradient[i] = softmax_values[i]*(1-softmax_values[i]);
-		for (size_t j = 0;j<size;++j){
-			if (i!=j){
-				gradient[i] -= softmax_values[i]*softmax_values[j];
-			}
-		}
+		dot += activated[i]*upstream[i];
+	}
+	for (size_t i = 0;i<size;++i){
+		gradient[i] = activated[i]*(upstream[i]-dot);
 	}
-	free(softmax_values);
 }
 
+// the forward kernels run swish with beta 1
 void activation_swish_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter){
 	for (size_t i = 0;i<size;++i){
-		float fx = 1/(1+expf(-buffer[i]*parameter));
-		gradient[i] = fx+parameter*buffer[i]*fx*(1-fx);
+		float fx = stable_sigmoidf(buffer[i]);
+		gradient[i] = fx+buffer[i]*fx*(1-fx);
 	}
 }
 
@@ -2474,525 +4044,167 @@ void activation_selu_partial(float* const gradient, const float* const buffer, c
 	//TODO multiparametric support
 }
 
-void neuromorph_back(neuromorph* model){
-	pthread_t root;
-	backprop_args args = {
-		model->output,
-		model->batch_size,
-		model->backlog_size,
-		model->batch_backlog,
-		model->batch_expected,
-		model->learning_rate
-	};
-	pthread_create(&root,  NULL, neuromorph_branch_back, (void*)&args);
-	pthread_join(root, NULL);
-}
-
-void update_learnables(neuromorph_node* node, size_t batch_size, float learning_rate, float* weight_gradients){
-	for (size_t i = 0;i<node->buffer_size;++i){
-		node->gradient_buffer[i] /= batch_size;
-		node->bias_buffer[i] -= (learning_rate*node->gradient_buffer[i]);
-	}
-	for (size_t i = 0;i<node->buffer_size;++i){
-		size_t index = *node->previous_buffer_size*i;
-		for (size_t k = 0;k<*node->previous_buffer_size;++k){
-			weight_gradients[index+k] /= batch_size;
-			node->weight_buffer[index+k] -= (learning_rate*weight_gradients[index+k]);
-		}
-	}
-}
-
-/*
-	weight_gradient_Average_per_neuron = zeros
-	bias_gradients = zeros
-	for batch
-		calculate loss derivative
-		calculate activation derivative
-		for neuron
-			gradient_component = loss derivative at neuron*activation derivative at neuron
-			add to average gradients vector per index (per neuron)
-			bias_gradients_per_neuron[neuron] += gradient_component
-			for neurons in prev:
-				weight_gradient_average_per_neuron[neuron][i] += gradient_component*previous_activated
-	we now have an average bias gradient(supposing you  now divide each by batch_size), and an averaged vector of weight gradients(supposing you divide each by batch_size)
-	bias gradient updates
-	update weights and biases
-*/
-void gradient_propogate_end(neuromorph_node* node, size_t backlog_size, size_t batch_size, float* backlog, float* expected_backlog, float learning_rate){
-	float* weight_gradients = calloc(sizeof(float), node->weight_buffer_size);
-	memset(node->gradient_buffer, 0, sizeof(float)*node->buffer_size);
-	for (size_t batch = 0;batch<batch_size;++batch){
-		size_t batch_index = batch*backlog_size;
-		node->activation_function_derivative(
-			node->neuron_buffer,
-			backlog+batch_index+node->backlog_offset,
-			node->buffer_size,
-			node->activation_parameter
-		);
-		node->loss_function_derivative(
-			node->neuron_buffer,
-			backlog+batch_index+node->backlog_offset+node->backlog_offset_activation,
-			expected_backlog+(batch*node->buffer_size),
-			node->buffer_size,
-			node->loss_parameter
-		);
-		for (size_t i = 0;i<node->buffer_size;++i){
-			float gradient_component = node->neuron_buffer[i];
-			node->gradient_buffer[i] += gradient_component;
-			size_t index = i*(*node->previous_buffer_size);
-			for (size_t k = 0;k<*node->previous_buffer_size;++k){
-				weight_gradients[index+k] += gradient_component*backlog[
-					batch_index+
-					(*node->previous_backlog_offset+(*node->previous_backlog_activation))+
-					k
-				];
-			}
-		}
-	}
-	update_learnables(node, batch_size, learning_rate, weight_gradients);
-	free(weight_gradients);
-}
-
-void construct_base_gradients_layer(neuromorph_node* node, float* base_gradients){
-	for (size_t k = 0;k<node->buffer_size;++k){
-		node->gradient_buffer[k] = 0;
-		base_gradients[k] = 0;
-		for (size_t i = 0;i<(*node->previous_gradient_size);++i){
-			float weight_coef = node->previous_weight_buffer[(i*node->buffer_size)+k];
-			base_gradients[k] += weight_coef*((*node->previous_gradient_buffer)[i]);
-		}
-	}
+void update_learnables_from(neuromorph_node* node, float* bias_gradients, float* weight_gradients, size_t batch_size, float learning_rate){
+	const neuromorph_optimizer* optimizer = node->optimizer;
+	const float scale = 1.0f/batch_size;
+	node->optimizer_step += 1;
+	optimizer->update(node->bias_buffer, bias_gradients, node->bias_state, node->buffer_size, scale, learning_rate, optimizer, node->optimizer_step);
+	optimizer->update(node->weight_buffer, weight_gradients, node->weight_state, node->weight_buffer_size, scale, learning_rate, optimizer, node->optimizer_step);
 }
 
-/*
-	precalculate gradient base
-		for neuron
-			for neuron in next
-				gradient += weight * your gradient
-	weight_gradient_Average_per_neuron = zeros
-	bias_gradients = zeros
-	for batch
-		calculate derivative
-		for neuron
-			gradient_component = base_gradient*derivative at neuron
-			add to average gradients vector per index (per neuron)
-			bias_gradients_per_neuron[neuron] += gradient_component
-			for neurons in prev:
-				weight_gradient_average_per_neuron[neuron][i] += gradient_component*previous_activated
-	we now have an average bias gradient(supposing you  now divide each by batch_size), and an averaged vector of weight gradients(supposing you divide each by batch_size)
-	bias gradient updates
-	update weights and biases
-
-*/
-void gradient_propogate(neuromorph_node* node, size_t backlog_size, size_t batch_size, float* backlog, float learning_rate){
-	pthread_mutex_lock(&node->mutex);
-	float* weight_gradients = calloc(sizeof(float), node->weight_buffer_size);
-	float* base_gradients = malloc(sizeof(float)*node->buffer_size);
-	if (node->next->type == CONVERGENT_NODE || node->next->additional_branch_count > 0){
-		memcpy(base_gradients, *node->previous_gradient_buffer, sizeof(float)*node->buffer_size);
-	}
-	else{
-		construct_base_gradients_layer(node, base_gradients);
-	}
-	for (size_t batch = 0;batch<batch_size;++batch){
-		size_t batch_index = batch*backlog_size;
-		node->activation_function_derivative(
-			node->neuron_buffer,
-			backlog+batch_index+node->backlog_offset,
-			node->buffer_size,
-			node->activation_parameter
-		);
-		for (size_t i = 0;i<node->buffer_size;++i){
-			float gradient_component = base_gradients[i]*node->neuron_buffer[i];
-			node->gradient_buffer[i] += gradient_component;
-			size_t index = i*(*node->previous_buffer_size);
-			for (size_t k = 0;k<*node->previous_buffer_size;++k){
-				weight_gradients[index+k] += gradient_component*backlog[
-					batch_index+
-					(*node->previous_backlog_offset+(*node->previous_backlog_activation))+
-					k
-				];
-			}
-		}
-	}
-	update_learnables(node, batch_size, learning_rate, weight_gradients);
-	free(weight_gradients);
-	free(base_gradients);
-	pthread_mutex_unlock(&node->mutex);
+#ifdef nm_sse
+// c-(a*b) and c+(a*b), fused when fma is available
+static inline __m128 optimizer_fnmadd(__m128 a, __m128 b, __m128 c){
+#ifdef nm_fma
+	return _mm_fnmadd_ps(a, b, c);
+#else
+	return _mm_sub_ps(c, _mm_mul_ps(a, b));
+#endif
 }
 
-void back_transfer_logic(neuromorph_node* node, size_t batch_size, size_t backlog_size, float* backlog, float* expected_backlog, float learning_rate){
-	backprop_args new_args = {
-		node->prev,
-		batch_size,
-		backlog_size,
-		backlog,
-		expected_backlog,
-		learning_rate
-	};
-	pthread_mutex_lock(&node->mutex);
-	node->back_ready = 1;
-	if (node->prev->next != node){
-		pthread_cond_broadcast(&node->cond);
-		if (node->loop_start){
-			node->unrolled = 1;
-			pthread_mutex_unlock(&node->mutex);
-			neuromorph_branch_back((void*)(&new_args));
-		}
-		pthread_mutex_unlock(&node->mutex);
-		pthread_exit(NULL);
-	}
-	pthread_mutex_unlock(&node->mutex);
-	neuromorph_branch_back((void*)(&new_args));
-}
-
-void* neuromorph_branch_back(void* args){
-	if (!args){
-		fprintf(stderr, "NULL node in graph\n");
-		pthread_exit(NULL);
-	}
-	backprop_args* arg_struct = args;
-	neuromorph_node* node = arg_struct->node;
-	size_t batch_size = arg_struct->batch_size;
-	size_t backlog_size = arg_struct->backlog_size;
-	float* backlog = arg_struct->backlog;
-	float* expected_backlog = arg_struct->expected_backlog;
-	float learning_rate = arg_struct->learning_rate;
-	switch(node->type){
-	case OUTPUT_NODE:
-		gradient_propogate_end(node, backlog_size, batch_size, backlog, expected_backlog, learning_rate);
-		break;
-	case LAYER_NODE:
-		gradient_propogate(node, backlog_size, batch_size, backlog, learning_rate);
-		break;
-	case INPUT_NODE:
-		pthread_exit(NULL);
-	case DIVERGENT_NODE:
-		pthread_mutex_lock(&node->mutex);
-		for (size_t i = 0;i<node->additional_branch_count;++i){
-			neuromorph_node* branch = node->additional_branches[i];
-			pthread_mutex_lock(&branch->mutex);
-			if (branch->loop_start){
-				if (branch->unrolled){
-					memcpy(
-						node->gradient_buffer,
-						branch->gradient_buffer,
-						sizeof(float)*branch->buffer_size
-					);
-					branch->unrolled = 0;
-					pthread_mutex_unlock(&branch->mutex);
-					break;
-				}
-				pthread_mutex_unlock(&branch->mutex);
-				continue;
-			}
-			if (!branch->back_ready){
-				pthread_cond_wait(&branch->cond, &branch->mutex);
-			}
-			for (size_t k = 0;k<branch->buffer_size;++k){
-				node->gradient_buffer[k] += branch->gradient_buffer[k];
-			}
-			pthread_mutex_unlock(&branch->mutex);
-		}
-		pthread_mutex_unlock(&node->mutex);
-		break;
-	case CONVERGENT_NODE:
-		node->convergence_function_derivative(
-			*node->previous_gradient_buffer,
-			node->previous_neuron_buffer,
-			node->convergent_buffer,
-			node->gradient_buffer,
-			node->path_gradient_buffer,
-			node->buffer_size
-		);
-		pthread_t path_id;
-		backprop_args new_args = {
-			node->convergent_node,
-			batch_size,
-			backlog_size,
-			backlog,
-			expected_backlog,
-			learning_rate
-		};
-		pthread_mutex_lock(&node->convergent_node->mutex);
-		if (node->convergent_node->loop){
-			if (node->convergent_node->unrolled_front){
-				pthread_mutex_unlock(&node->convergent_node->mutex);
-				pthread_exit(NULL);
-				break;
-			}
-			node->convergent_node->unrolled_front = 1;
-			pthread_mutex_unlock(&node->convergent_node->mutex);
-			pthread_create(&path_id, NULL, neuromorph_branch_back, (void*)&new_args);
-			pthread_join(path_id, NULL);
-			break;
-		}
-		pthread_mutex_unlock(&node->convergent_node->mutex);
-		pthread_create(&path_id, NULL, neuromorph_branch_back, (void*)&new_args);
-		pthread_join(path_id, NULL);
-		break;
-	}
-	back_transfer_logic(node, batch_size, backlog_size, backlog, expected_backlog, learning_rate);
-	pthread_exit(NULL);
-	return 0;
+static inline __m128 optimizer_fmadd(__m128 a, __m128 b, __m128 c){
+#ifdef nm_fma
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(c, _mm_mul_ps(a, b));
+#endif
 }
+#endif
 
-float neuromorph_train_batch(neuromorph* model, float* input, float* expected, uint8_t verbose){
-	memcpy(model->batch_expected, expected, sizeof(float)*model->batch_size*model->output->buffer_size);
-	float losses = 0;
-	for (size_t pass = 0;pass<model->batch_size;++pass){
-		memcpy(
-			model->input->neuron_buffer,
-			input+(pass*model->input->buffer_size),
-			sizeof(float)*model->input->buffer_size
-		);
-		memcpy(
-			model->output->expected,
-			expected+(pass*model->output->buffer_size),
-			sizeof(float)*model->output->buffer_size
-		);
-		float loss = neuromorph_forward(model, pass);
-		switch (verbose){
-		default:
-		case 2:
-			printf("Loss[%lu]: %.2f\n", pass, loss);
-		case 1:
-			losses += loss;
-		break;
-		}
+void optimizer_sgd(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step){
+	size_t i = 0;
+#ifdef nm_sse
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 rate = _mm_set1_ps(learning_rate);
+	for (;i+4<=size;i+=4){
+		__m128 g = _mm_mul_ps(_mm_loadu_ps(gradients+i), s);
+		_mm_storeu_ps(gradients+i, g);
+		_mm_storeu_ps(parameters+i, optimizer_fnmadd(rate, g, _mm_loadu_ps(parameters+i)));
 	}
-	if (verbose >= 2){
-		printf("Batch loss: %.2f\n", losses/model->batch_size);
+#endif
+	for (;i<size;++i){
+		gradients[i] *= scale;
+		parameters[i] -= learning_rate*gradients[i];
 	}
-	neuromorph_back(model);
-	return losses/model->batch_size;
 }
 
-static PyObject* nm_compile(PyObject* self, PyObject* args){
-	const char* mdl;
-	uint16_t batch_size;
-	float learning_rate;
-	if (!PyArg_ParseTuple(args, "sIf", &mdl, &batch_size, &learning_rate)){
-		Py_RETURN_NONE;
-	}
-	neuromorph* model = neuromorph_compile(mdl, batch_size, learning_rate);
-	if (sizeof(uintptr_t) == sizeof(long)){
-		return Py_BuildValue("k", (uintptr_t)model);
+// v = a*v+g, w -= lr*v
+void optimizer_momentum(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step){
+	const float mu = optimizer->parameter_a;
+	size_t i = 0;
+#ifdef nm_sse
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 rate = _mm_set1_ps(learning_rate);
+	const __m128 m = _mm_set1_ps(mu);
+	for (;i+4<=size;i+=4){
+		__m128 g = _mm_mul_ps(_mm_loadu_ps(gradients+i), s);
+		__m128 v = optimizer_fmadd(m, _mm_loadu_ps(state+i), g);
+		_mm_storeu_ps(gradients+i, g);
+		_mm_storeu_ps(state+i, v);
+		_mm_storeu_ps(parameters+i, optimizer_fnmadd(rate, v, _mm_loadu_ps(parameters+i)));
 	}
-	else if (sizeof(uintptr_t) == sizeof(long long)){
-		return Py_BuildValue("K", (uintptr_t)model);
+#endif
+	for (;i<size;++i){
+		gradients[i] *= scale;
+		state[i] = mu*state[i]+gradients[i];
+		parameters[i] -= learning_rate*state[i];
 	}
-	fprintf(stderr, "Unsupported sizeof uintptr_t\n");
-	Py_RETURN_NONE;
 }
 
-static PyObject* nm_build(PyObject* self, PyObject* args){
-	uintptr_t id;
-	if (sizeof(uintptr_t) == sizeof(long)){
-		if (!PyArg_ParseTuple(args,"k", &id)){
-			fprintf(stderr, "invalid model passed\n");
-			Py_RETURN_NONE;
-		}
-	}
-	else{
-		if (!PyArg_ParseTuple(args,"K", &id)){
-			fprintf(stderr, "invalid model passed\n");
-			Py_RETURN_NONE;
-		}
-	}
-	neuromorph* model = (neuromorph*)id;
-	neuromorph_build(model);
-	if (sizeof(uintptr_t) == sizeof(long)){
-		return Py_BuildValue("k", (uintptr_t)model);
-	}
-	if (sizeof(uintptr_t) == sizeof(long long)){
-		return Py_BuildValue("K", (uintptr_t)model);
+// v = a*v+g, w -= lr*(g+a*v)
+void optimizer_nesterov(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step){
+	const float mu = optimizer->parameter_a;
+	size_t i = 0;
+#ifdef nm_sse
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 rate = _mm_set1_ps(learning_rate);
+	const __m128 m = _mm_set1_ps(mu);
+	for (;i+4<=size;i+=4){
+		__m128 g = _mm_mul_ps(_mm_loadu_ps(gradients+i), s);
+		__m128 v = optimizer_fmadd(m, _mm_loadu_ps(state+i), g);
+		_mm_storeu_ps(gradients+i, g);
+		_mm_storeu_ps(state+i, v);
+		_mm_storeu_ps(parameters+i, optimizer_fnmadd(rate, optimizer_fmadd(m, v, g), _mm_loadu_ps(parameters+i)));
 	}
-	fprintf(stderr, "Unsupported sizeof uintptr_t\n");
-	Py_RETURN_NONE;
-}
-
-uint8_t nm_fill_vector(float* v, size_t middle_size, size_t inner_size, PyObject* batch){
-	for (size_t k = 0;k<middle_size;++k){
-		PyObject* inner_list = PyList_GetItem(batch, k);
-		if (!PyList_Check(inner_list)){
-			fprintf(stderr, "non list encountered in batch\n");
-			return 0;
-		}
-		for (size_t j = 0;j<inner_size;++j){
-			PyObject* scalar = PyList_GetItem(inner_list, j);
-			if (!PyFloat_Check(scalar)){
-				fprintf(stderr, "Non float encountered in vector\n");
-				return 0;
-			}
-			v[(k*inner_size)+j] = (float)PyFloat_AsDouble(scalar);
-		}
+#endif
+	for (;i<size;++i){
+		gradients[i] *= scale;
+		state[i] = mu*state[i]+gradients[i];
+		parameters[i] -= learning_rate*(gradients[i]+mu*state[i]);
 	}
-	return 1;
 }
 
-static PyObject* nm_train(PyObject* self, PyObject* args){
-	uintptr_t id;
-	uint16_t verbosity;
-	PyObject* intptr = PyTuple_GetItem(args, 0);
-	PyObject* input = PyTuple_GetItem(args, 1);
-	PyObject* expected = PyTuple_GetItem(args, 2);
-	PyObject* int16 = PyTuple_GetItem(args, 3);
-	if (sizeof(uintptr_t) == sizeof(long) && (!intptr || !(id = PyLong_AsUnsignedLong(intptr)))){
-		fprintf(stderr, "Unable to parse model in train\n");
-		Py_RETURN_NONE;
-	}
-	if (sizeof(uintptr_t) == sizeof(long long) && (!intptr || !(id = PyLong_AsUnsignedLongLong(intptr)))){
-		fprintf(stderr, "Unable to parse model in train\n");
-		Py_RETURN_NONE;
-	}
-	if (!int16 || !(verbosity = PyLong_AsUnsignedLong(int16))){
-		fprintf(stderr, "Unable to parse verbisity in train\n");
-		Py_RETURN_NONE;
-	}
-	if (!PyList_Check(input) || !PyList_Check(expected)){
-		fprintf(stderr, "Expected list\n");
-		Py_RETURN_NONE;
-	}
-	size_t input_outer_size = PyList_Size(input);
-	size_t expected_outer_size = PyList_Size(input);
-	if (!PyList_Check(PyList_GetItem(input, 0)) || !PyList_Check(PyList_GetItem(expected, 0))){
-		fprintf(stderr, "Expected batch, found other type\n");
-		Py_RETURN_NONE;
-	}
-	size_t input_middle_size = PyList_Size(PyList_GetItem(input, 0));
-	size_t expected_middle_size = PyList_Size(PyList_GetItem(input, 0));
-	if (
-		!PyList_Check(PyList_GetItem(PyList_GetItem(input, 0), 0)) ||
-		!PyList_Check(PyList_GetItem(PyList_GetItem(expected, 0), 0))
-	){
-		fprintf(stderr, "Expected vector, found other type\n");
-		Py_RETURN_NONE;
-	}
-	size_t input_inner_size = PyList_Size(PyList_GetItem(PyList_GetItem(input, 0), 0));
-	size_t expected_inner_size = PyList_Size(PyList_GetItem(PyList_GetItem(expected, 0), 0));
-	neuromorph* model = (neuromorph*)id;
-	if (model->input->buffer_size != input_inner_size){
-		fprintf(stderr, "Input vector size %lu does not match model input vector size %lu\n",
-			input_inner_size, model->input->buffer_size
-		);
-		Py_RETURN_NONE;
-	}
-	if (model->output->buffer_size != expected_inner_size){
-		fprintf(stderr, "Expected vector size %lu does not match model output vector size %lu\n",
-			expected_inner_size, model->output->buffer_size
-		);
-		Py_RETURN_NONE;
-	}
-	if (input_outer_size != expected_outer_size){
-		fprintf(stderr, "Input batch count does not match Expected batch count: %lu != %lu\n",
-			input_outer_size, expected_outer_size
-		);
-		Py_RETURN_NONE;
-	}
-	if (input_middle_size != expected_middle_size || input_middle_size != model->batch_size){
-		fprintf(stderr, "Batches dont match model batch size: %u\n", model->batch_size);
-		Py_RETURN_NONE;
-	}
-	float* intermediate_input = malloc(sizeof(float)*model->batch_size*model->input->buffer_size);
-	float* intermediate_expected = malloc(sizeof(float)*model->batch_size*model->output->buffer_size);
-	float cum_loss = 0;
-	size_t i = 1;
-	for (i = 0;i<input_outer_size;++i){
-		PyObject* input_mid_list = PyList_GetItem(input, i);
-		PyObject* expected_mid_list = PyList_GetItem(expected, i);
-		if (!PyList_Check(input_mid_list) || !PyList_Check(expected_mid_list)){
-			fprintf(stderr, "non list encountered in batch list\n");
-			break;
-		}
-		if (
-			!nm_fill_vector(
-				intermediate_input,
-				input_middle_size,
-				input_inner_size,
-				input_mid_list
-			) ||
-			!nm_fill_vector(
-				intermediate_expected,
-				expected_middle_size,
-				expected_inner_size,
-				expected_mid_list
-			)
-		){
-			break;
-		}
-		cum_loss += neuromorph_train_batch(model, intermediate_input, intermediate_expected, verbosity);
+// r = a*r+(1-a)*g*g, w -= lr*g/(sqrt(r)+eps)
+void optimizer_rmsprop(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step){
+	const float rho = optimizer->parameter_a;
+	size_t i = 0;
+#ifdef nm_sse
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 rate = _mm_set1_ps(learning_rate);
+	const __m128 decay = _mm_set1_ps(rho);
+	const __m128 keep = _mm_set1_ps(1-rho);
+	const __m128 epsilon = _mm_set1_ps(OPTIMIZER_EPSILON);
+	for (;i+4<=size;i+=4){
+		__m128 g = _mm_mul_ps(_mm_loadu_ps(gradients+i), s);
+		__m128 r = optimizer_fmadd(keep, _mm_mul_ps(g, g), _mm_mul_ps(decay, _mm_loadu_ps(state+i)));
+		_mm_storeu_ps(gradients+i, g);
+		_mm_storeu_ps(state+i, r);
+		__m128 step_size = _mm_div_ps(_mm_mul_ps(rate, g), _mm_add_ps(_mm_sqrt_ps(r), epsilon));
+		_mm_storeu_ps(parameters+i, _mm_sub_ps(_mm_loadu_ps(parameters+i), step_size));
 	}
-	free(intermediate_input);
-	free(intermediate_expected);
-	return Py_BuildValue("f", cum_loss/i);
-}
-
-static PyObject* nm_seed(PyObject* self, PyObject* args){
-	time_t sd;
-	if (!PyArg_ParseTuple(args, "K", &sd)){
-		Py_RETURN_NONE;
+#endif
+	for (;i<size;++i){
+		float g = gradients[i]*scale;
+		gradients[i] = g;
+		state[i] = rho*state[i]+(1-rho)*g*g;
+		parameters[i] -= learning_rate*g/(sqrtf(state[i])+OPTIMIZER_EPSILON);
 	}
-	set_seed(sd);
-	Py_RETURN_NONE;
 }
 
-static PyObject* nm_release(PyObject* self, PyObject* args){
-	uintptr_t id;
-	if (sizeof(uintptr_t) == sizeof(long)){
-		if (!PyArg_ParseTuple(args,"k", &id)){
-			fprintf(stderr, "invalid model passed\n");
-			Py_RETURN_NONE;
-		}
-	}
-	else{
-		if (!PyArg_ParseTuple(args,"K", &id)){
-			fprintf(stderr, "invalid model passed\n");
-			Py_RETURN_NONE;
-		}
+/*
+ * m = a*m+(1-a)*g, v = b*v+(1-b)*g*g
+ * w -= lr*(mhat/(sqrt(vhat)+eps)+c*w)
+ * c is decoupled weight decay, 0 gives plain adam
+*/
+void optimizer_adam(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step){
+	const float beta1 = optimizer->parameter_a;
+	const float beta2 = optimizer->parameter_b;
+	const float weight_decay = optimizer->parameter_c;
+	const float first_correction = 1/(1-powf(beta1, step));
+	const float second_correction = 1/sqrtf(1-powf(beta2, step));
+	float* const first = state;
+	float* const second = state+size;
+	size_t i = 0;
+#ifdef nm_sse
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 rate = _mm_set1_ps(learning_rate);
+	const __m128 b1 = _mm_set1_ps(beta1);
+	const __m128 b1_keep = _mm_set1_ps(1-beta1);
+	const __m128 b2 = _mm_set1_ps(beta2);
+	const __m128 b2_keep = _mm_set1_ps(1-beta2);
+	const __m128 c1 = _mm_set1_ps(first_correction);
+	const __m128 c2 = _mm_set1_ps(second_correction);
+	const __m128 decay = _mm_set1_ps(weight_decay);
+	const __m128 epsilon = _mm_set1_ps(OPTIMIZER_EPSILON);
+	for (;i+4<=size;i+=4){
+		__m128 g = _mm_mul_ps(_mm_loadu_ps(gradients+i), s);
+		__m128 m = optimizer_fmadd(b1_keep, g, _mm_mul_ps(b1, _mm_loadu_ps(first+i)));
+		__m128 v = optimizer_fmadd(b2_keep, _mm_mul_ps(g, g), _mm_mul_ps(b2, _mm_loadu_ps(second+i)));
+		_mm_storeu_ps(gradients+i, g);
+		_mm_storeu_ps(first+i, m);
+		_mm_storeu_ps(second+i, v);
+		__m128 w = _mm_loadu_ps(parameters+i);
+		__m128 direction = _mm_div_ps(_mm_mul_ps(c1, m), optimizer_fmadd(_mm_sqrt_ps(v), c2, epsilon));
+		direction = optimizer_fmadd(decay, w, direction);
+		_mm_storeu_ps(parameters+i, optimizer_fnmadd(rate, direction, w));
 	}
-	neuromorph* model = (neuromorph*)id;
-	neuromorph_free(model);
-	Py_RETURN_NONE;
-}
-
-static PyObject* say_hello(PyObject* self, PyObject* args){
-	const char* description;
-	if (!PyArg_ParseTuple(args, "s", &description)){
-		return NULL;
+#endif
+	for (;i<size;++i){
+		float g = gradients[i]*scale;
+		gradients[i] = g;
+		first[i] = beta1*first[i]+(1-beta1)*g;
+		second[i] = beta2*second[i]+(1-beta2)*g*g;
+		float direction = (first_correction*first[i])/(sqrtf(second[i])*second_correction+OPTIMIZER_EPSILON);
+		parameters[i] -= learning_rate*(direction+weight_decay*parameters[i]);
 	}
-	neuromorph* model = neuromorph_compile(description, 5, 0.001);
-	neuromorph_build(model);
-	printf("compiled and built model:\n%s\n\n Running batch test\n\n", description);
-	float* input = malloc(sizeof(float)*5*model->input->buffer_size);
-	float* expected = malloc(sizeof(float)*5*model->output->buffer_size);
-	float lll = neuromorph_train_batch(model, input, expected, 2);
-	free(input);
-	free(expected);
-	neuromorph_free(model);
-	printf("memory freed\n");
-	char greeting[512];
-	snprintf(greeting, sizeof(greeting), "test passed\n\n");
-	return Py_BuildValue("s", greeting);
-}
-
-static PyMethodDef NeuroMorph[] = {
-	{"say_hello",(PyCFunction)say_hello,METH_VARARGS, "Test function, given MDL compiles, builds, runs single arbitrary random test batch, frees memory"},
-	{"compile",(PyCFunction)nm_compile,METH_VARARGS, "Compiles a model from MDL"},
-	{"build",(PyCFunction)nm_build,METH_VARARGS, "Builds a compiled model"},
-	{"train",(PyCFunction)nm_train,METH_VARARGS, "Trains the model on the given batches input and expected values"},
-	{"seed",(PyCFunction)nm_seed,METH_VARARGS, "Sets seed for learnable parameter initialization"},
-	{"release",(PyCFunction)nm_release,METH_VARARGS, "Releases memory related to model"},
-	{NULL,NULL,0,NULL}
-};
-
-PyMODINIT_FUNC PyInit_neuromorph(void){
-	static struct PyModuleDef neuromorphmodule = {
-		PyModuleDef_HEAD_INIT,
-		"neuromorph",
-		NULL,
-		-1,
-		NeuroMorph
-	};
-	return PyModule_Create(&neuromorphmodule);
 }
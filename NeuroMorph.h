@@ -9,6 +9,8 @@
 #include <inttypes.h>
 #include "hashmap.h"
 #include "vector.h"
+#include "neuromorph_api.h"
+#include "perf.h"
 
 VECTOR(vector, uintptr_t)
 HASHMAP(adjacency_map, uintptr_t, vector)
@@ -26,18 +28,86 @@ typedef enum NEUROMORPH_NODE_TYPE{
 #define LOSS_TYPE float (*)(float* const, const float* const, const float* const, const size_t, const float)
 #define LOSS_DERIVATIVE_TYPE void (*)(float* const, const float* const, const float* const, const size_t, const float)
 #define GENERIC_FUNCTION_TYPE void* (*)(void*)
+#define OPTIMIZER_TYPE void (*)(float* const, float* const, float* const, const size_t, const float, const float, const struct neuromorph_optimizer* const, const size_t)
+
+#define OPTIMIZER_COUNT 6
+#define OPTIMIZER_EPSILON 1e-8f
+
+#define NODE_NAME_TOKEN_MAX 64
+
+// gradient reductions over fewer floats than this run on the calling thread, waking the pool would cost more
+#define NEUROMORPH_REDUCE_SERIAL 65536
+
+#define NEUROMORPH_PROFILE_FORWARD 0
+#define NEUROMORPH_PROFILE_BACKWARD 1
+
+/* Per node profiling, compiled in only with nm_profile
+ * counters are summed atomically by every thread running the node, indexed by NEUROMORPH_PROFILE_FORWARD or BACKWARD
+ * bytes is an estimate of the floats read and written, from the node's widths
+ * hardware counters are summed only while neuromorph_perf_enable is on, over the counted calls
+ * the same hooks emit a span per node when built with nm_trace
+*/
+#ifdef nm_profile
+typedef struct neuromorph_node_profile{
+	uint64_t nanoseconds[2];
+	uint64_t calls[2];
+	uint64_t bytes[2];
+	uint64_t counted[2];
+	uint64_t counters[2][NEUROMORPH_PERF_COUNTERS];
+}neuromorph_node_profile;
+
+#define NEUROMORPH_PROFILE_BEGIN(start) neuromorph_perf_sample start##_counters; neuromorph_perf_read(&start##_counters); const uint64_t start = neuromorph_nanoseconds()
+#define NEUROMORPH_PROFILE_END(node, phase, start, count) neuromorph_profile_record(node, phase, start, &start##_counters, count)
+#elif defined(nm_trace)
+#define NEUROMORPH_PROFILE_BEGIN(start) const uint64_t start = neuromorph_nanoseconds()
+#define NEUROMORPH_PROFILE_END(node, phase, start, count) neuromorph_profile_record(node, phase, start, NULL, count)
+#else
+#define NEUROMORPH_PROFILE_BEGIN(start)
+#define NEUROMORPH_PROFILE_END(node, phase, start, count)
+#endif
+
+/* Optimizers
+ * update is one pass over a parameter buffer, its gradients and its state
+ * gradients are scaled in place, so nodes upstream read the batch mean
+ * state holds moments*size floats, allocated at build and zeroed
+*/
+typedef struct neuromorph_optimizer{
+	void (*update)(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const struct neuromorph_optimizer* const optimizer, const size_t step);
+	uint8_t moments;
+	float parameter_a;
+	float parameter_b;
+	float parameter_c;
+}neuromorph_optimizer;
+
+typedef struct optimizer_record{
+	const char* name;
+	void (*update)(float* const, float* const, float* const, const size_t, const float, const float, const struct neuromorph_optimizer* const, const size_t);
+	uint8_t moments;
+	float parameter_a;
+	float parameter_b;
+	float parameter_c;
+}optimizer_record;
+
+/* Layer epilogues
+ * activations node_pass_epilogue applies to each tile of preactivations while it is still in L1,
+ * taken from the activation function when a layer is initialized, softmax needs the whole vector and runs as its own pass
+*/
+#define NEUROMORPH_EPILOGUE_NONE 0
+#define NEUROMORPH_EPILOGUE_LINEAR 1
+#define NEUROMORPH_EPILOGUE_RELU 2
+#define NEUROMORPH_EPILOGUE_RELU_LEAKY 3
+#define NEUROMORPH_EPILOGUE_RELU_PARAMETRIC 4
+#define NEUROMORPH_EPILOGUE_SIGMOID 5
+#define NEUROMORPH_EPILOGUE_TANH 6
+#define NEUROMORPH_EPILOGUE_ELU 7
+#define NEUROMORPH_EPILOGUE_SWISH 8
+#define NEUROMORPH_EPILOGUE_GELU 9
+#define NEUROMORPH_EPILOGUE_TILE 16 // preactivations computed before their epilogues run, a multiple of 4
 
 typedef struct neuromorph_node{
 	struct neuromorph_node* next;
 	struct neuromorph_node* prev;
 	NEUROMORPH_NODE_TYPE type;
-	//TODO this should really just be an 8 bit flag, but we'll leave that for the optimization step
-	uint8_t ready; // forward parallel node ready
-	uint8_t back_ready; // backward parallel node ready
-	uint8_t loop; // node is the last step of a memory link converging to main branch
-	uint8_t loop_start; // node is the start of a branch which econverges back in time
-	uint8_t unrolled; // indicates that its ok to aggregate the gradient from a loop
-	uint8_t unrolled_front; // indicates that its already been propogated through 
 	/* Normal buffer
 	 * input node uses it as a standard buffer for the initial pass
 	 * convergent node uses it as a buffer for convergence between two previous branches
@@ -54,11 +124,12 @@ typedef struct neuromorph_node{
 	void (*activation_function)(float* const buffer, const size_t size, const float parameter);
 	void (*activation_function_derivative)(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 	float activation_parameter;
+	uint8_t epilogue; // NEUROMORPH_EPILOGUE_NONE runs the activation as a separate pass
 	// Used by specialized output node for loss function
 	float (*loss_function)(float* const buffer, const float* const result, const float* const expected, const size_t size, const float parameter);
 	void (*loss_function_derivative)(float* const gradient, const float* const result, const float* const expected, const size_t size, const float paramaeter);
 	float loss_parameter;
-	float* expected;
+	uint8_t softmax_cross_entropy; // softmax output with cross entropy loss, both taken from the logits as one kernel
 	// Used by information flow nodes to keep track of the previuos layer, convergence,  or input buffer
 	const float* previous_neuron_buffer;
 	const size_t* previous_buffer_size;
@@ -71,8 +142,6 @@ typedef struct neuromorph_node{
 	const size_t* convergent_buffer_size;
 	void (*convergence_function)(const float* const branch_buffer, const float* const previous, float* const output_buffer, const size_t size);
 	void (*convergence_function_derivative)(const float* const prev_gradient, const float* const prev, const float* const path, float* const gradient, float* const path_gradient, const size_t size);
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
 	// Used for calculating weight_gradients, previous means input previous still
 	const size_t* previous_backlog_offset;
 	const size_t* previous_backlog_activation;
@@ -85,6 +154,26 @@ typedef struct neuromorph_node{
 	// where out preactivated and activated results are stored in the models memory
 	size_t backlog_offset;
 	size_t backlog_offset_activation;
+	// where the previous activations are read from during backprop, the input is read from the callers batch
+	size_t previous_activation_offset;
+	uint8_t previous_input;
+	// Used by the single threaded schedule, nodes owning the buffers read as previous and convergent path
+	struct neuromorph_node* previous_owner;
+	struct neuromorph_node* convergent_owner;
+	size_t convergent_activation_offset;
+	uint8_t convergent_input;
+	uint8_t recurrent; // convergent path is read from the previous step
+	// Used by layers and output for optimizer state, laid out as moment after moment of weight or bias size
+	const neuromorph_optimizer* optimizer;
+	float* weight_state;
+	float* bias_state;
+	size_t optimizer_step;
+	size_t parameter_offset; // start of this node's weights then biases in the parameter arena and in gradient buffers
+	size_t state_offset; // start of this node's activation in a session's recurrent state
+	char name[NODE_NAME_TOKEN_MAX]; // MDL name, empty for links the builder inserts
+#ifdef nm_profile
+	neuromorph_node_profile profile;
+#endif
 }neuromorph_node;
 
 neuromorph_node* neuromorph_input_init(size_t input_size);
@@ -139,6 +228,7 @@ typedef union neuromorph_ast_node_data{
 
 typedef struct neuromorph_ast_node{
 	NEUROMORPH_AST_NODE_TYPE type;
+	char name[NODE_NAME_TOKEN_MAX];
 	neuromorph_ast_node_data data;
 	ast_node_id next;
 }neuromorph_ast_node;
@@ -155,29 +245,84 @@ typedef struct neuromorph_header{
 	float bias_parameter_b;
 	float weight_parameter_a;
 	float weight_parameter_b;
+	neuromorph_optimizer optimizer;
+	uint8_t slot; // comma separated function being parsed, weight initializer, bias initializer, then optimizer
+	uint8_t malformed; // a function did not parse or sat in the wrong slot
 }neuromorph_header;
 
+typedef struct neuromorph_epoch_stats{
+	size_t batches;
+	float loss;
+	double seconds;
+	double stall_seconds; // time the trainer spent waiting on input
+}neuromorph_epoch_stats;
+
+/*
+ * Training threads kept for the life of a built model. The calling thread runs worker 0, the other workers sleep on wake
+ * between jobs, and every worker keeps its carry, delta and scratch rows from one batch to the next
+*/
+typedef struct neuromorph_pool_slot{
+	struct neuromorph_pool* pool;
+	size_t index;
+}neuromorph_pool_slot;
+
+typedef struct neuromorph_pool{
+	size_t workers;
+	pthread_t* threads; // workers-1 threads, thread i runs worker i+1
+	neuromorph_pool_slot* slots;
+	float* rows; // row_stride floats per worker, carry and delta of backlog_size each, then scratch of widest_node*2
+	size_t row_stride;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake; // signalled when a job is posted or the pool stops
+	pthread_cond_t idle; // signalled when the last thread finishes its part of a job
+	size_t generation; // bumped by every posted job
+	size_t running;
+	uint8_t stopping;
+	void* (*job)(void*);
+	char* args; // job_count argument structs of args_size bytes, worker i gets the i-th
+	size_t args_size;
+	size_t job_count;
+}neuromorph_pool;
+
 typedef struct neuromorph{
 	ast_node_id ast_root;
 	neuromorph_ast ast;
 	neuromorph_header header;
+	char* description; // MDL the model was compiled from
 	adjacency_map adjacency;
 	neuromorph_node* input;
 	neuromorph_node* output;
 	uint16_t batch_size;
 	float* batch_backlog;
-	float* batch_expected;
+	vector schedule; // compute nodes in single threaded execution order
+	vector recurrent_sources; // nodes whose activation is read by a recurrent convergence on the next step
+	size_t state_size;
+	uint16_t worker_count;
+	uint8_t workers_default; // worker_count was not chosen through neuromorph_set_workers
+	neuromorph_pool* pool; // started by neuromorph_build, NULL before
+	size_t parameter_count; // weights and biases of every scheduled node
+	float* parameters; // arena the scheduled nodes' weight and bias buffers point into
+	void* parameter_map; // read only mapping parameters points into when they are shared, NULL when the model owns them
+	size_t parameter_map_size;
+	size_t read_epoch; // flipped by every publish, forward passes register in readers[read_epoch & 1]
+	size_t readers[2];
+	pthread_mutex_t publish_mutex;
+	size_t widest_node;
+	float* worker_gradients; // parameter_count floats per worker
+	size_t worker_gradient_slots;
+	size_t accumulation_steps; // batches summed per update
+	size_t accumulated_batches;
+	float* accumulated_gradients;
 	size_t backlog_size;
-	pthread_mutex_t backlog_mutex;
 	float learning_rate;
+	uint8_t precision; // NEUROMORPH_PRECISION tier of the transcendental kernels in forward passes
+	neuromorph_epoch_stats epoch_stats;
 }neuromorph;
 
 neuromorph* neuromorph_init(size_t batch_size, float learning_rate);
 void neuromorph_free(neuromorph* model);
 void adjacency_map_free_internal(adjacency_map* adjacency);
 
-#define NODE_NAME_TOKEN_MAX 64
-
 typedef enum PARAMETRIC_FUNCTION_TYPE{
 	PARAMETRIC_ACTIVATION,
 	PARAMETRIC_LOSS,
@@ -231,8 +376,13 @@ void neuromorph_build(neuromorph* model);
 neuromorph_node* neuromorph_build_branch(neuromorph_ast* ast, ast_node_id node_id, adjacency_map* adjacency, graph_domain* domain, uint8_t branch, neuromorph_node* node, size_t* const backlog_size);
 void build_divergent_branches(vector* stale_links, vector* div_nodes, vector_u64* divs, neuromorph_ast* ast, graph_domain* domain, adjacency_map* adjacency, neuromorph_node* leftover, size_t* const backlog_size);
 void register_backlog(neuromorph_node* current_node, size_t* const backlog_size);
-uint8_t neuromorph_mark_loops(neuromorph_node* node, vector* marked);
 neuromorph_node* neuromorph_pull_output(adjacency_map* map);
+void neuromorph_collect_nodes(neuromorph* model, vector* nodes);
+neuromorph_node* neuromorph_buffer_owner(vector* nodes, const float* buffer);
+void neuromorph_bind_sources(neuromorph* model);
+uint8_t neuromorph_depends_on(neuromorph_node* node, neuromorph_node* target, vector* visited);
+void neuromorph_schedule_node(neuromorph* model, neuromorph_node* node);
+void neuromorph_schedule_build(neuromorph* model);
 
 #define GELU_C 0.044715
 
@@ -241,7 +391,7 @@ void convergence_additive(const float* const path, const float* const previous,
 void convergence_average(const float* const path, const float* const previous, float* const buffer, const size_t buffer_size);
 //TODO concatenation, attention, weight, billinear matrix?
 
-#define PARAMETRIC_FUNCTION_COUNT 18
+#define PARAMETRIC_FUNCTION_COUNT 19
 
 float loss_mse(float* const buffer, const float* const result, const float* const expected, const size_t size, const float parameter);
 float loss_mae(float* const buffer, const float* const result, const float* const expected, const size_t size, const float parameter);
@@ -250,11 +400,17 @@ float loss_huber(float* const buffer, const float* const result, const float* co
 float loss_huber_modified(float* const buffer, const float* const result, const float* const expected, const size_t size, const float parameter);
 float loss_cross_entropy(float* const buffer, const float* const result, const float* const expected, const size_t size, const float parameter);
 float loss_hinge(float* const buffer, const float* const result, const float* const expected, const size_t size, const float parameter);
+float loss_softmax_cross_entropy(float* const buffer, const float* const logits, const float* const expected, const size_t size, const float parameter);
 
 #ifdef nm_sse
-__m128 exp_neg_ps(__m128 x);
-__m128 tanh_ps(__m128 x);
+__m128 exp_ps(__m128 x);
+__m128 exp_fast_ps(__m128 x);
+__m128 tanh_ps(__m128 x, uint8_t precision);
+__m128 expm1_ps(__m128 x, uint8_t precision);
+__m128 sigmoid_ps(__m128 x, uint8_t precision);
 #endif
+float neuromorph_exp(float* const buffer, const size_t size);
+float neuromorph_shift_max(float* const buffer, const float* const source, const size_t size);
 
 void activation_sigmoid(float* const buffer, const size_t size, const float parameter);
 void activation_relu(float* const buffer, const size_t size, const float parameter);
@@ -269,19 +425,126 @@ void activation_swish(float* const buffer, const size_t size, const float parame
 void activation_gelu(float* const buffer, const size_t size, const float parameter);
 void activation_selu(float* const buffer, const size_t size, const float parameter);
 
-typedef struct forward_args{
-	neuromorph_node* node;
-	float* backlog;
-	pthread_mutex_t* mut;
-	uint16_t batch;
-} forward_args;
-
-float neuromorph_forward(neuromorph* model, uint16_t pass_count);
-uint8_t end_of_branch(neuromorph_node* node);
-void thread_signal_ready(neuromorph_node* node);
-void write_to_backlog(float* const backlog, pthread_mutex_t* mut, const float* const buffer, const size_t size, const size_t offset, uint16_t batch);
-void node_pass(neuromorph_node* node);
-void* neuromorph_branch_forward(void* args);
+void node_pass_weights(neuromorph_node* node, const float* const weights, const float* const biases, const float* const previous, float* const output);
+void node_pass_epilogue(neuromorph_node* node, const float* const weights, const float* const biases, const float* const previous, float* const output, float* const activated);
+uint8_t neuromorph_epilogue_of(void (*activation)(float* const, const size_t, const float));
+
+typedef struct evaluate_args{
+	neuromorph* model;
+	const float* input;
+	const float* expected;
+	float* losses;
+	float* rows; // the worker's row and scratch from the pool
+	size_t start;
+	size_t end;
+}evaluate_args;
+
+uint16_t neuromorph_default_workers();
+void neuromorph_use_precision(uint8_t precision);
+const char* neuromorph_precision_name(uint8_t precision);
+uint8_t neuromorph_precision_parse(const char* name);
+size_t neuromorph_read_enter(neuromorph* model);
+void neuromorph_read_exit(neuromorph* model, size_t slot);
+uint8_t neuromorph_publish(neuromorph* model, const float* const parameters);
+const char* neuromorph_node_type_name(const neuromorph_node* node);
+size_t neuromorph_node_bytes(const neuromorph_node* node, uint8_t phase);
+uint64_t neuromorph_nanoseconds();
+#if defined(nm_profile) || defined(nm_trace)
+void neuromorph_profile_record(neuromorph_node* node, uint8_t phase, uint64_t start, const neuromorph_perf_sample* const counters, uint64_t count);
+#endif
+#ifdef nm_profile
+void neuromorph_profile_reset(neuromorph* model);
+#endif
+void neuromorph_forward_node(neuromorph_node* node, const float* const parameters, float* const row, const float* const recurrent_row, const float* const input);
+void neuromorph_forward_rows(neuromorph* model, float* const rows, const float* const recurrent_row, const float* const input, size_t count);
+float neuromorph_forward_row(neuromorph* model, float* const row, const float* const recurrent_row, float* const scratch, const float* const input, const float* const expected);
+float neuromorph_forward_row_from(neuromorph* model, const float* const parameters, float* const row, const float* const recurrent_row, float* const scratch, const float* const input, const float* const expected);
+void neuromorph_axpy(float* const y, const float* const x, const float a, const size_t size);
+void neuromorph_layer_gradients(neuromorph_node* node, const float* const local, const float* const previous, float* const previous_delta, float* const gradients);
+void neuromorph_backward_row(neuromorph* model, const float* const row, const float* const recurrent_row, float* const delta, float* const recurrent_delta, float* const scratch, const float* const input, const float* const expected, float* const gradients);
+void* neuromorph_evaluate_worker(void* args);
+float neuromorph_evaluate(neuromorph* model, const float* input, const float* expected, size_t sample_count, float* const losses);
+
+typedef struct train_args{
+	neuromorph* model;
+	const float* input;
+	const float* expected;
+	float* losses;
+	float* gradients;
+	float* rows; // the worker's carry, delta and scratch from the pool
+	size_t start;
+	size_t end;
+}train_args;
+
+typedef struct reduce_args{
+	float* gradients;
+	size_t stride;
+	size_t workers;
+	size_t start;
+	size_t end;
+}reduce_args;
+
+void neuromorph_parameter_layout(neuromorph* model);
+uint8_t neuromorph_parameter_arena(neuromorph* model);
+void neuromorph_parameter_rebind(neuromorph* model, float* const parameters);
+uint8_t neuromorph_parameter_map(neuromorph* model, void* map, size_t map_size, float* const parameters);
+neuromorph_pool* neuromorph_pool_init(size_t workers, size_t row_stride);
+void neuromorph_pool_free(neuromorph_pool* pool);
+void* neuromorph_pool_thread(void* args);
+void neuromorph_pool_run(neuromorph_pool* pool, void* (*job)(void*), void* args, size_t args_size, size_t count);
+float* neuromorph_pool_rows(neuromorph_pool* pool, size_t worker);
+uint8_t neuromorph_pool_start(neuromorph* model);
+size_t neuromorph_batch_workers(const neuromorph* model, size_t samples);
+float* neuromorph_worker_gradients(neuromorph* model, size_t workers);
+void* neuromorph_train_worker(void* args);
+void* neuromorph_reduce_worker(void* args);
+void neuromorph_reduce_gradients(neuromorph* model, float* const gradients, size_t workers);
+void neuromorph_apply_gradients(neuromorph* model, float* const gradients, size_t sample_count);
+uint8_t neuromorph_set_accumulation(neuromorph* model, size_t steps);
+void neuromorph_accumulate_gradients(neuromorph* model, const float* const gradients);
+void neuromorph_flush_gradients(neuromorph* model);
+
+typedef struct sequence_args{
+	neuromorph* model;
+	const float* input;
+	const float* expected;
+	float* ring;
+	float* losses;
+	float* gradients;
+	float* rows; // the worker's pool rows, carry as the zero step and scratch
+	size_t timesteps;
+	size_t window;
+	size_t window_start;
+	size_t window_end;
+	size_t start;
+	size_t end;
+}sequence_args;
+
+void* neuromorph_sequence_worker(void* args);
+float neuromorph_train_sequences(neuromorph* model, const float* input, const float* expected, size_t sequence_count, size_t timesteps, size_t window, uint8_t verbose);
+
+typedef struct neuromorph_context{
+	neuromorph* model;
+	float* row; // backlog_size floats, followed by scratch
+	float* scratch;
+}neuromorph_context;
+
+neuromorph_context* neuromorph_context_init(neuromorph* model);
+void neuromorph_context_free(neuromorph_context* context);
+float neuromorph_context_forward(neuromorph_context* context, const float* const input, const float* const expected, float* const output);
+void neuromorph_predict(neuromorph_context* context, const float* input, float* output, size_t sample_count);
+
+typedef struct neuromorph_session{
+	neuromorph* model;
+	float* state; // activations of model->recurrent_sources, state_size floats
+	size_t steps;
+}neuromorph_session;
+
+neuromorph_session* neuromorph_session_init(neuromorph* model);
+void neuromorph_session_free(neuromorph_session* session);
+void neuromorph_session_reset(neuromorph_session* session);
+size_t neuromorph_session_bytes(const neuromorph* model);
+void neuromorph_session_step(neuromorph_session* session, neuromorph_context* context, const float* const input, float* const output);
 
 void set_seed(time_t seed);
 float uniform_distribution(float min, float max);
@@ -301,9 +564,18 @@ void weight_initialization_orthogonal(float* const out, const size_t in_size, co
 void weight_initialization_normal(float* const out, const size_t in_size, const size_t out_size, const float a, const float b);
 
 void weight_bias_initialize(neuromorph* model);
+void optimizer_state_initialize(neuromorph* model);
+uint8_t parse_optimizer(neuromorph_optimizer* optimizer, const char* token);
+uint8_t parse_optimizer_parameter(neuromorph_optimizer* optimizer, const char* token, uint8_t arg_c);
+
+void optimizer_sgd(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step);
+void optimizer_momentum(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step);
+void optimizer_nesterov(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step);
+void optimizer_rmsprop(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step);
+void optimizer_adam(float* const parameters, float* const gradients, float* const state, const size_t size, const float scale, const float learning_rate, const neuromorph_optimizer* const optimizer, const size_t step);
 neuromorph_header compile_header(const char** c);
 uint8_t parse_header_function(neuromorph_header* header, const char* token, uint8_t arg_c);
-uint8_t parse_header_parameter(neuromorph_header* header, float* bias_parameter, float* weight_parameter, const char* token);
+uint8_t parse_header_parameter(neuromorph_header* header, const char* token, uint8_t arg_c);
 
 void convergence_multiplicative_partial(const float* const prev_gradient, const float* const prev, const float* const path, float* const gradient, float* const path_gradient, const size_t size);
 void convergence_additive_partial(const float* const prev_gradient, const float* const prev, const float* const path, float* const gradient, float* const path_gradient, const size_t size);
@@ -316,6 +588,7 @@ void loss_huber_partial(float* const gradient, const float* const result, const
 void loss_huber_modified_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter);
 void loss_cross_entropy_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter);
 void loss_hinge_partial(float* const gradient, const float* const result, const float* const expected, const size_t size, const float parameter);
+void loss_softmax_cross_entropy_partial(float* const gradient, const float* const activated, const float* const expected, const size_t size, const float parameter);
 
 void activation_sigmoid_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 void activation_relu_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
@@ -326,29 +599,12 @@ void activation_relu_leaky_partial(float* const gradient, const float* const buf
 void activation_relu_parametric_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 void activation_elu_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 void activation_softmax_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
+void neuromorph_softmax_backward(float* const gradient, const float* const activated, const float* const upstream, const size_t size);
 void activation_swish_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 void activation_gelu_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 void activation_selu_partial(float* const gradient, const float* const buffer, const size_t size, const float parameter);
 
-typedef struct backprop_args{
-	neuromorph_node* node;
-	size_t batch_size;
-	size_t backlog_size;
-	float* backlog;
-	float* expected_backlog;
-	float learning_rate;
-} backprop_args;
-
-void neuromorph_back(neuromorph* model);
-void* neuromorph_branch_back(void* args);
-void update_learnables(neuromorph_node* node, size_t batch_size, float learning_rate, float* weight_gradients);
-void gradient_propogate_end(neuromorph_node* node, size_t backlog_size, size_t batch_size, float* backlog, float* expected_backlog, float learning_rate);
-void gradient_propogate(neuromorph_node* node, size_t backlog_size, size_t batch_size, float* backlog, float learning_rate);
-float neuromorph_train_batch(neuromorph* model, float* input, float* expected, uint8_t verbose);
-void back_transfer_logic(neuromorph_node* node, size_t batch_size, size_t backlog_size, float* backlog, float* expected_backlog, float learning_rate);
-void aggregate_diverged_gradients(neuromorph_node* node);
-void construct_base_gradients_layer(neuromorph_node* node, float* base_gradients);
-void construct_base_gradients_divergence(neuromorph_node* node, float* base_gradients);
-void update_learnables(neuromorph_node* node, size_t batch_size, float learning_rate, float* weight_gradients);
+void update_learnables_from(neuromorph_node* node, float* bias_gradients, float* weight_gradients, size_t batch_size, float learning_rate);
+float neuromorph_train_batch(neuromorph* model, const float* input, const float* expected, uint8_t verbose);
 
 #endif
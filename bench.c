@@ -0,0 +1,481 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "NeuroMorph.h"
+#include "dataset.h"
+
+/*
+ * Kernel and end to end benchmarks, written as JSON to the given path or stdout
+ * the instruction set is fixed when the engine is compiled, so make bench builds this once per path
+*/
+
+#ifdef nm_fma
+#define BENCH_ISA "sse4.1+fma"
+#elif defined(nm_sse)
+#define BENCH_ISA "sse4.1"
+#else
+#define BENCH_ISA "scalar"
+#endif
+
+#define BENCH_MIN_SECONDS 0.02
+#define BENCH_WIDTH_COUNT 6
+#define BENCH_MODEL_BATCHES 64
+#define BENCH_MODEL_BATCH_SIZE 32
+#define BENCH_PRECISION_STRIDE 4099
+#define BENCH_PRECISION_WIDTH 4096
+
+static const size_t bench_widths[BENCH_WIDTH_COUNT] = {4, 16, 64, 256, 1024, 4096};
+
+typedef enum BENCH_KERNEL_KIND{
+	BENCH_ACTIVATION,
+	BENCH_ACTIVATION_PARTIAL,
+	BENCH_LOSS,
+	BENCH_LOSS_PARTIAL,
+	BENCH_CONVERGENCE,
+	BENCH_CONVERGENCE_PARTIAL
+}BENCH_KERNEL_KIND;
+
+typedef struct bench_kernel{
+	const char* name;
+	BENCH_KERNEL_KIND kind;
+	void* function;
+	float parameter;
+}bench_kernel;
+
+typedef struct bench_buffers{
+	float* source;
+	float* a;
+	float* b;
+	float* c;
+	float* d;
+	float* e;
+}bench_buffers;
+
+typedef struct bench_output{
+	FILE* file;
+	size_t entries;
+}bench_output;
+
+static const bench_kernel bench_kernels[] = {
+	{"sigmoid", BENCH_ACTIVATION, activation_sigmoid, 0},
+	{"relu", BENCH_ACTIVATION, activation_relu, 0},
+	{"tanh", BENCH_ACTIVATION, activation_tanh, 0},
+	{"binary_step", BENCH_ACTIVATION, activation_binary_step, 0},
+	{"linear", BENCH_ACTIVATION, activation_linear, 0},
+	{"relu_leaky", BENCH_ACTIVATION, activation_relu_leaky, 0.01},
+	{"relu_parametric", BENCH_ACTIVATION, activation_relu_parametric, 0.1},
+	{"elu", BENCH_ACTIVATION, activation_elu, 1},
+	{"softmax", BENCH_ACTIVATION, activation_softmax, 0},
+	{"swish", BENCH_ACTIVATION, activation_swish, 1},
+	{"gelu", BENCH_ACTIVATION, activation_gelu, 0},
+	{"selu", BENCH_ACTIVATION, activation_selu, 0},
+	{"sigmoid", BENCH_ACTIVATION_PARTIAL, activation_sigmoid_partial, 0},
+	{"relu", BENCH_ACTIVATION_PARTIAL, activation_relu_partial, 0},
+	{"tanh", BENCH_ACTIVATION_PARTIAL, activation_tanh_partial, 0},
+	{"binary_step", BENCH_ACTIVATION_PARTIAL, activation_binary_step_partial, 0},
+	{"linear", BENCH_ACTIVATION_PARTIAL, activation_linear_partial, 0},
+	{"relu_leaky", BENCH_ACTIVATION_PARTIAL, activation_relu_leaky_partial, 0.01},
+	{"relu_parametric", BENCH_ACTIVATION_PARTIAL, activation_relu_parametric_partial, 0.1},
+	{"elu", BENCH_ACTIVATION_PARTIAL, activation_elu_partial, 1},
+	{"softmax", BENCH_ACTIVATION_PARTIAL, activation_softmax_partial, 0},
+	{"swish", BENCH_ACTIVATION_PARTIAL, activation_swish_partial, 1},
+	{"gelu", BENCH_ACTIVATION_PARTIAL, activation_gelu_partial, 0},
+	{"selu", BENCH_ACTIVATION_PARTIAL, activation_selu_partial, 0},
+	{"mse", BENCH_LOSS, loss_mse, 0},
+	{"mae", BENCH_LOSS, loss_mae, 0},
+	{"mape", BENCH_LOSS, loss_mape, 0},
+	{"huber", BENCH_LOSS, loss_huber, 1},
+	{"huber_modified", BENCH_LOSS, loss_huber_modified, 1},
+	{"cross_entropy", BENCH_LOSS, loss_cross_entropy, 0},
+	{"hinge", BENCH_LOSS, loss_hinge, 0},
+	{"mse", BENCH_LOSS_PARTIAL, loss_mse_partial, 0},
+	{"mae", BENCH_LOSS_PARTIAL, loss_mae_partial, 0},
+	{"mape", BENCH_LOSS_PARTIAL, loss_mape_partial, 0},
+	{"huber", BENCH_LOSS_PARTIAL, loss_huber_partial, 1},
+	{"huber_modified", BENCH_LOSS_PARTIAL, loss_huber_modified_partial, 1},
+	{"cross_entropy", BENCH_LOSS_PARTIAL, loss_cross_entropy_partial, 0},
+	{"hinge", BENCH_LOSS_PARTIAL, loss_hinge_partial, 0},
+	{"additive", BENCH_CONVERGENCE, convergence_additive, 0},
+	{"multiplicative", BENCH_CONVERGENCE, convergence_multiplicative, 0},
+	{"average", BENCH_CONVERGENCE, convergence_average, 0},
+	{"additive", BENCH_CONVERGENCE_PARTIAL, convergence_additive_partial, 0},
+	{"multiplicative", BENCH_CONVERGENCE_PARTIAL, convergence_multiplicative_partial, 0},
+	{"average", BENCH_CONVERGENCE_PARTIAL, convergence_average_partial, 0}
+};
+
+static const char* bench_kind_names[] = {
+	"activation", "activation_partial", "loss", "loss_partial", "convergence", "convergence_partial"
+};
+
+// the README example models
+static const char* bench_models[][2] = {
+	{"small", "/normal 0 0.1,zero/ (input, 4) {gate, recur, additive} (a, 4, <relu, 5.9>) (b, 4, <swish, 5.9>) [link,[recur,]] (output, 4, <sigmoid>, <mse, 4>)"},
+	{"big", "/xavier,const_uneven 0.1 0.3/ (input, 4) (a, 4, <sigmoid>) {c2, g, additive} (b, 4, <relu>) [b1, (d, 4, <softmax>) {standby, stalerecur, additive} (e, 4, <softmax>) | (f, 4, <relu>) [stale,[stalerecur,]] (g, 4, <relu>) ] (c, 4, <sigmoid>) {c1, e, additive} (output, 4, <sigmoid>, <huber_modified, 2.4>)"},
+	{"gated", "/uniform 0 0.5,const_uneven 0.1 0.2/ (input, 4) {gate, doubleforget, additive} (a, 4, <relu>) (b, 4, <swish, 5.9>) [link,(forget, 4, <tanh>)(doubleforget, 4, <tanh>)] (output, 4, <sigmoid>, <mse>)"},
+	{"lstm", "/xavier,const_flat 0.5/ (input, 4) {a, lastrecur, additive} [b, (include, 4, <sigmoid>) | (process, 4, <tanh>) {pi, include, multiplicative} | (add, 4, <sigmoid>) ] (forget, 4, <sigmoid>) {state0, prevstaterecur, multiplicative} {state1, pi, additive} [prevstate,[prevstaterecur,]] (statep, 4, <tanh>) {lastc, add, multiplicative} [last,[lastrecur,]] (output, 4, <tanh>, <mse>)"}
+};
+
+static double bench_exp_reference(double x){
+	return exp(x);
+}
+
+static double bench_sigmoid_reference(double x){
+	return 1/(1+exp(-x));
+}
+
+static double bench_elu_reference(double x){
+	return x < 0 ? expm1(x) : x;
+}
+
+static double bench_swish_reference(double x){
+	return x/(1+exp(-x));
+}
+
+// 0.5x(1+tanh(a)) written as x/(1+e^-2a), the tanh form cancels even in double for negative x
+static double bench_gelu_reference(double x){
+	return x/(1+exp(-2*sqrt(2/M_PI)*(x+(GELU_C*x*x*x))));
+}
+
+static void bench_exp(float* const buffer, const size_t size, const float parameter){
+	neuromorph_exp(buffer, size);
+}
+
+typedef struct bench_precision_kernel{
+	const char* name;
+	void (*kernel)(float* const, const size_t, const float);
+	double (*reference)(double);
+}bench_precision_kernel;
+
+// elementwise kernels built on exp and tanh, each against a double precision reference, elu with alpha 1
+static const bench_precision_kernel bench_precision_kernels[] = {
+	{"exp", bench_exp, bench_exp_reference},
+	{"sigmoid", activation_sigmoid, bench_sigmoid_reference},
+	{"tanh", activation_tanh, tanh},
+	{"elu", activation_elu, bench_elu_reference},
+	{"swish", activation_swish, bench_swish_reference},
+	{"gelu", activation_gelu, bench_gelu_reference}
+};
+
+#define BENCH_PRECISION_KERNEL_COUNT (sizeof(bench_precision_kernels)/sizeof(bench_precision_kernels[0]))
+#define BENCH_MODEL_COUNT (sizeof(bench_models)/sizeof(bench_models[0]))
+#define BENCH_KERNEL_COUNT (sizeof(bench_kernels)/sizeof(bench_kernels[0]))
+
+float* bench_alloc(size_t size){
+#ifdef nm_sse
+	return _mm_malloc(sizeof(float)*size, 16);
+#else
+	return malloc(sizeof(float)*size);
+#endif
+}
+
+void bench_free(float* buffer){
+#ifdef nm_sse
+	_mm_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+void bench_fill(float* const buffer, size_t size, float low, float high){
+	for (size_t i = 0;i<size;++i){
+		buffer[i] = low+((high-low)*(float)random()/RAND_MAX);
+	}
+}
+
+void bench_entry(bench_output* const out, const char* group, const char* kind, const char* name, size_t width, size_t calls, double seconds, double work, const char* work_unit){
+	fprintf(out->file, "%s\n    {\"group\": \"%s\", \"kind\": \"%s\", \"name\": \"%s\", \"width\": %zu, \"calls\": %zu, \"ns_per_call\": %.2f, \"%s\": %.2f}",
+		out->entries ? "," : "", group, kind, name, width, calls, 1e9*seconds/calls, work_unit, work*calls/seconds
+	);
+	out->entries += 1;
+}
+
+/*
+ * In place kernels restore their input before every call so repeated application cannot drift into
+ * infinities or denormals, the restore alone is reported as the copy kernel
+*/
+void bench_kernel_call(const bench_kernel* const kernel, const bench_buffers* const buffers, size_t width){
+	switch(kernel->kind){
+	case BENCH_ACTIVATION:
+		memcpy(buffers->a, buffers->source, sizeof(float)*width);
+		((void (*)(float* const, const size_t, const float))kernel->function)(buffers->a, width, kernel->parameter);
+		break;
+	case BENCH_ACTIVATION_PARTIAL:
+		((void (*)(float* const, const float* const, const size_t, const float))kernel->function)(buffers->a, buffers->source, width, kernel->parameter);
+		break;
+	case BENCH_LOSS:
+		((float (*)(float* const, const float* const, const float* const, const size_t, const float))kernel->function)(buffers->a, buffers->b, buffers->c, width, kernel->parameter);
+		break;
+	case BENCH_LOSS_PARTIAL:
+		((void (*)(float* const, const float* const, const float* const, const size_t, const float))kernel->function)(buffers->a, buffers->b, buffers->c, width, kernel->parameter);
+		break;
+	case BENCH_CONVERGENCE:
+		((void (*)(const float* const, const float* const, float* const, const size_t))kernel->function)(buffers->b, buffers->c, buffers->a, width);
+		break;
+	case BENCH_CONVERGENCE_PARTIAL:
+		((void (*)(const float* const, const float* const, const float* const, float* const, float* const, const size_t))kernel->function)(buffers->b, buffers->c, buffers->source, buffers->d, buffers->e, width);
+		break;
+	}
+}
+
+void bench_kernels_run(bench_output* const out){
+	const size_t widest = bench_widths[BENCH_WIDTH_COUNT-1];
+	bench_buffers buffers = {
+		bench_alloc(widest), bench_alloc(widest), bench_alloc(widest), bench_alloc(widest), bench_alloc(widest), bench_alloc(widest)
+	};
+	bench_fill(buffers.source, widest, -1, 1);
+	bench_fill(buffers.b, widest, 0.05, 0.95);
+	bench_fill(buffers.c, widest, 0.05, 0.95);
+	for (size_t w = 0;w<BENCH_WIDTH_COUNT;++w){
+		const size_t width = bench_widths[w];
+		size_t calls = 0;
+		double start = neuromorph_seconds();
+		double seconds = 0;
+		while (seconds < BENCH_MIN_SECONDS){
+			memcpy(buffers.a, buffers.source, sizeof(float)*width);
+			calls += 1;
+			seconds = neuromorph_seconds()-start;
+		}
+		bench_entry(out, "kernel", "copy", "restore", width, calls, seconds, width, "elements_per_second");
+		for (size_t k = 0;k<BENCH_KERNEL_COUNT;++k){
+			const bench_kernel* kernel = bench_kernels+k;
+			calls = 0;
+			start = neuromorph_seconds();
+			seconds = 0;
+			while (seconds < BENCH_MIN_SECONDS){
+				for (size_t repeat = 0;repeat<8;++repeat){
+					bench_kernel_call(kernel, &buffers, width);
+				}
+				calls += 8;
+				seconds = neuromorph_seconds()-start;
+			}
+			bench_entry(out, "kernel", bench_kind_names[kernel->kind], kernel->name, width, calls, seconds, width, "elements_per_second");
+		}
+	}
+	bench_free(buffers.source);
+	bench_free(buffers.a);
+	bench_free(buffers.b);
+	bench_free(buffers.c);
+	bench_free(buffers.d);
+	bench_free(buffers.e);
+}
+
+// a square layer, width inputs to width outputs
+void bench_node_pass_run(bench_output* const out){
+	for (size_t w = 0;w<BENCH_WIDTH_COUNT;++w){
+		const size_t width = bench_widths[w];
+		neuromorph_node node;
+		memset(&node, 0, sizeof(node));
+		node.buffer_size = width;
+		node.previous_buffer_size = &width;
+		float* weights = bench_alloc(width*width);
+		float* biases = bench_alloc(width);
+		float* previous = bench_alloc(width);
+		float* output = bench_alloc(width);
+		bench_fill(weights, width*width, -0.1, 0.1);
+		bench_fill(biases, width, -0.1, 0.1);
+		bench_fill(previous, width, -1, 1);
+		size_t calls = 0;
+		double start = neuromorph_seconds();
+		double seconds = 0;
+		while (seconds < BENCH_MIN_SECONDS){
+			node_pass_weights(&node, weights, biases, previous, output);
+			calls += 1;
+			seconds = neuromorph_seconds()-start;
+		}
+		bench_entry(out, "kernel", "node_pass", "node_pass", width, calls, seconds, 2.0*width*width, "flops_per_second");
+		// a sigmoid layer as forward_node ran it before the epilogue, then fused
+		float* activated = bench_alloc(width);
+		node.activation_function = activation_sigmoid;
+		node.epilogue = NEUROMORPH_EPILOGUE_SIGMOID;
+		calls = 0;
+		start = neuromorph_seconds();
+		seconds = 0;
+		while (seconds < BENCH_MIN_SECONDS){
+			node_pass_weights(&node, weights, biases, previous, output);
+			memcpy(activated, output, sizeof(float)*width);
+			node.activation_function(activated, width, 0);
+			calls += 1;
+			seconds = neuromorph_seconds()-start;
+		}
+		bench_entry(out, "kernel", "node_pass", "sigmoid_separate", width, calls, seconds, 2.0*width*width, "flops_per_second");
+		calls = 0;
+		start = neuromorph_seconds();
+		seconds = 0;
+		while (seconds < BENCH_MIN_SECONDS){
+			node_pass_epilogue(&node, weights, biases, previous, output, activated);
+			calls += 1;
+			seconds = neuromorph_seconds()-start;
+		}
+		bench_entry(out, "kernel", "node_pass", "sigmoid_epilogue", width, calls, seconds, 2.0*width*width, "flops_per_second");
+		bench_free(weights);
+		bench_free(biases);
+		bench_free(previous);
+		bench_free(output);
+		bench_free(activated);
+	}
+}
+
+typedef struct bench_precision_error{
+	double max_relative;
+	float worst_input;
+	size_t samples;
+}bench_precision_error;
+
+void bench_precision_compare(const bench_precision_kernel* const kernel, float* const buffer, const float* const input, size_t size, bench_precision_error* const error){
+	kernel->kernel(buffer, size, 1);
+	for (size_t i = 0;i<size;++i){
+		double expected = kernel->reference(input[i]);
+		// results that overflow or fall below the normal range are not held to a relative bound
+		if (!isfinite((float)expected) || fabs(expected) < FLT_MIN){
+			continue;
+		}
+		double relative = fabs((double)buffer[i]-expected)/fabs(expected);
+		if (isnan(relative)){
+			relative = INFINITY;
+		}
+		if (relative > error->max_relative || error->samples == 0){
+			error->max_relative = relative;
+			error->worst_input = input[i];
+		}
+		error->samples += 1;
+	}
+}
+
+/*
+ * Walks every finite float a fixed stride of bit patterns apart, so each binade from the denormals to FLT_MAX is sampled
+ * in both signs, the largest relative error is reported with the input that produced it
+*/
+void bench_precision_error_sweep(const bench_precision_kernel* const kernel, float* const buffer, float* const input, bench_precision_error* const error){
+	size_t count = 0;
+	memset(error, 0, sizeof(bench_precision_error));
+	for (uint64_t bits = 0;bits < ((uint64_t)1<<32);bits += BENCH_PRECISION_STRIDE){
+		uint32_t pattern = bits;
+		float x;
+		memcpy(&x, &pattern, sizeof(float));
+		if (!isfinite(x)){
+			continue;
+		}
+		input[count] = x;
+		buffer[count] = x;
+		count += 1;
+		if (count == BENCH_PRECISION_WIDTH){
+			bench_precision_compare(kernel, buffer, input, count, error);
+			count = 0;
+		}
+	}
+	bench_precision_compare(kernel, buffer, input, count, error);
+}
+
+// every precision tier of every exp and tanh kernel, accuracy over the float range and speed over inputs in [-10, 10]
+void bench_precision_run(bench_output* const out){
+	const size_t width = BENCH_PRECISION_WIDTH;
+	float* source = bench_alloc(width);
+	float* input = bench_alloc(width);
+	float* buffer = bench_alloc(width);
+	bench_fill(source, width, -10, 10);
+	for (uint8_t precision = 0;precision<NEUROMORPH_PRECISIONS;++precision){
+		neuromorph_use_precision(precision);
+		for (size_t k = 0;k<BENCH_PRECISION_KERNEL_COUNT;++k){
+			const bench_precision_kernel* kernel = bench_precision_kernels+k;
+			bench_precision_error error;
+			bench_precision_error_sweep(kernel, buffer, input, &error);
+			size_t calls = 0;
+			double start = neuromorph_seconds();
+			double seconds = 0;
+			while (seconds < BENCH_MIN_SECONDS){
+				memcpy(buffer, source, sizeof(float)*width);
+				kernel->kernel(buffer, width, 1);
+				calls += 1;
+				seconds = neuromorph_seconds()-start;
+			}
+			fprintf(out->file, "%s\n    {\"group\": \"precision\", \"kind\": \"%s\", \"name\": \"%s\", \"width\": %zu, \"calls\": %zu, \"ns_per_element\": %.3f, \"samples\": %zu, ",
+				out->entries ? "," : "", neuromorph_precision_name(precision), kernel->name, width, calls, 1e9*seconds/(calls*width), error.samples
+			);
+			if (isfinite(error.max_relative)){
+				fprintf(out->file, "\"max_relative_error\": %.3e, \"worst_input\": %.9g}", error.max_relative, error.worst_input);
+			}
+			else{
+				fprintf(out->file, "\"max_relative_error\": null, \"worst_input\": %.9g}", error.worst_input);
+			}
+			out->entries += 1;
+		}
+	}
+	neuromorph_use_precision(NEUROMORPH_PRECISION_ACCURATE);
+	bench_free(source);
+	bench_free(input);
+	bench_free(buffer);
+}
+
+void bench_models_run(bench_output* const out){
+	for (size_t m = 0;m<BENCH_MODEL_COUNT;++m){
+		neuromorph* model = neuromorph_compile(bench_models[m][1], BENCH_MODEL_BATCH_SIZE, 0.01);
+		if (!model){
+			fprintf(stderr, "benchmark model %s does not compile\n", bench_models[m][0]);
+			continue;
+		}
+		neuromorph_build(model);
+		neuromorph_set_workers(model, 1);
+		const size_t samples = BENCH_MODEL_BATCHES*BENCH_MODEL_BATCH_SIZE;
+		float* input = bench_alloc(samples*model->input->buffer_size);
+		float* expected = bench_alloc(samples*model->output->buffer_size);
+		float* output = bench_alloc(samples*model->output->buffer_size);
+		bench_fill(input, samples*model->input->buffer_size, 0, 1);
+		bench_fill(expected, samples*model->output->buffer_size, 0, 1);
+		size_t calls = 0;
+		double start = neuromorph_seconds();
+		double seconds = 0;
+		while (seconds < BENCH_MIN_SECONDS*5){
+			for (size_t batch = 0;batch<BENCH_MODEL_BATCHES;++batch){
+				neuromorph_train_batch(
+					model,
+					input+(batch*BENCH_MODEL_BATCH_SIZE*model->input->buffer_size),
+					expected+(batch*BENCH_MODEL_BATCH_SIZE*model->output->buffer_size),
+					0
+				);
+			}
+			calls += BENCH_MODEL_BATCHES;
+			seconds = neuromorph_seconds()-start;
+		}
+		bench_entry(out, "model", "train", bench_models[m][0], BENCH_MODEL_BATCH_SIZE, calls, seconds, BENCH_MODEL_BATCH_SIZE, "samples_per_second");
+		neuromorph_context* context = neuromorph_context_init(model);
+		calls = 0;
+		start = neuromorph_seconds();
+		seconds = 0;
+		while (seconds < BENCH_MIN_SECONDS*5){
+			neuromorph_predict(context, input, output, samples);
+			calls += 1;
+			seconds = neuromorph_seconds()-start;
+		}
+		bench_entry(out, "model", "predict", bench_models[m][0], samples, calls, seconds, samples, "samples_per_second");
+		neuromorph_context_free(context);
+		bench_free(input);
+		bench_free(expected);
+		bench_free(output);
+		neuromorph_free(model);
+	}
+}
+
+int main(int argc, char** argv){
+	bench_output out = {stdout, 0};
+	if (argc > 1){
+		out.file = fopen(argv[1], "w");
+		if (!out.file){
+			fprintf(stderr, "could not open %s for writing\n", argv[1]);
+			return 1;
+		}
+	}
+	srandom(1);
+	fprintf(out.file, "{\n  \"isa\": \"%s\",\n  \"results\": [", BENCH_ISA);
+	bench_node_pass_run(&out);
+	bench_kernels_run(&out);
+	bench_precision_run(&out);
+	bench_models_run(&out);
+	fprintf(out.file, "\n  ]\n}\n");
+	if (out.file != stdout){
+		fclose(out.file);
+	}
+	return 0;
+}
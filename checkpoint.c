@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkpoint.h"
+
+static size_t checkpoint_align(size_t offset){
+	return (offset+NEUROMORPH_CHECKPOINT_ALIGN-1) & ~((size_t)NEUROMORPH_CHECKPOINT_ALIGN-1);
+}
+
+// whether length bytes at offset lie past the header inside a file of size bytes, without the sum wrapping around
+static uint8_t checkpoint_block_fits(uint64_t offset, uint64_t length, size_t size){
+	uint64_t end;
+	return offset >= sizeof(neuromorph_checkpoint_header) &&
+		!__builtin_add_overflow(offset, length, &end) &&
+		end <= size;
+}
+
+static uint8_t checkpoint_pad(FILE* outfile, size_t from, size_t to){
+	for (;from<to;++from){
+		if (fputc(0, outfile) == EOF){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static uint8_t checkpoint_write(const neuromorph* const model, FILE* outfile){
+	neuromorph_checkpoint_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = NEUROMORPH_CHECKPOINT_MAGIC;
+	header.version = NEUROMORPH_CHECKPOINT_VERSION;
+	header.description_offset = sizeof(header);
+	header.description_length = strlen(model->description)+1;
+	header.parameter_offset = checkpoint_align(header.description_offset+header.description_length);
+	header.parameter_count = model->parameter_count;
+	header.batch_size = model->batch_size;
+	header.learning_rate = model->learning_rate;
+	size_t parameter_bytes = sizeof(float)*model->parameter_count;
+	return (
+		fwrite(&header, sizeof(header), 1, outfile) == 1 &&
+		fwrite(model->description, 1, header.description_length, outfile) == header.description_length &&
+		checkpoint_pad(outfile, header.description_offset+header.description_length, header.parameter_offset) &&
+		fwrite(model->parameters, 1, parameter_bytes, outfile) == parameter_bytes
+	);
+}
+
+uint8_t neuromorph_save(const neuromorph* const model, const char* path){
+	if (!model->description || !model->parameters){
+		fprintf(stderr, "only built models can be saved\n");
+		return 0;
+	}
+	FILE* outfile = fopen(path, "wb");
+	if (!outfile){
+		fprintf(stderr, "could not open checkpoint %s for writing\n", path);
+		return 0;
+	}
+	uint8_t written = checkpoint_write(model, outfile);
+	if (fclose(outfile) != 0 || !written){
+		fprintf(stderr, "failed writing checkpoint %s\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Compiles and builds the stored description, then overwrites the freshly initialized parameters
+ * with the stored ones. Optimizer state is not stored, training resumes with zeroed moments
+*/
+neuromorph* neuromorph_load(const char* path){
+	FILE* infile = fopen(path, "rb");
+	if (!infile){
+		fprintf(stderr, "could not open checkpoint %s\n", path);
+		return NULL;
+	}
+	neuromorph_checkpoint_header header;
+	if (fread(&header, sizeof(header), 1, infile) != 1){
+		fprintf(stderr, "checkpoint %s is too small to contain a header\n", path);
+		fclose(infile);
+		return NULL;
+	}
+	if (header.magic != NEUROMORPH_CHECKPOINT_MAGIC || header.version != NEUROMORPH_CHECKPOINT_VERSION){
+		fprintf(stderr, "%s is not a version %u neuromorph checkpoint\n", path, NEUROMORPH_CHECKPOINT_VERSION);
+		fclose(infile);
+		return NULL;
+	}
+	char* description = malloc(header.description_length+1);
+	if (
+		fseek(infile, header.description_offset, SEEK_SET) != 0 ||
+		fread(description, 1, header.description_length, infile) != header.description_length
+	){
+		fprintf(stderr, "checkpoint %s is truncated\n", path);
+		free(description);
+		fclose(infile);
+		return NULL;
+	}
+	description[header.description_length] = '\0';
+	neuromorph* model = neuromorph_compile(description, header.batch_size, header.learning_rate);
+	free(description);
+	if (!model){
+		fclose(infile);
+		return NULL;
+	}
+	neuromorph_build(model);
+	if (model->parameter_count != header.parameter_count){
+		fprintf(stderr, "checkpoint %s holds %lu parameters, its description builds %lu\n",
+			path, header.parameter_count, model->parameter_count
+		);
+		neuromorph_free(model);
+		fclose(infile);
+		return NULL;
+	}
+	size_t parameter_bytes = sizeof(float)*header.parameter_count;
+	if (
+		fseek(infile, header.parameter_offset, SEEK_SET) != 0 ||
+		fread(model->parameters, 1, parameter_bytes, infile) != parameter_bytes
+	){
+		fprintf(stderr, "checkpoint %s is truncated\n", path);
+		neuromorph_free(model);
+		fclose(infile);
+		return NULL;
+	}
+	fclose(infile);
+	return model;
+}
+
+/*
+ * Maps a checkpoint read only and builds a model whose parameters live in the mapping,
+ * pages are shared with every other process mapping the same file or segment
+*/
+static neuromorph* checkpoint_map(int fd, const char* path){
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(neuromorph_checkpoint_header)){
+		fprintf(stderr, "checkpoint %s is too small to contain a header\n", path);
+		close(fd);
+		return NULL;
+	}
+	size_t map_size = info.st_size;
+	uint8_t* map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED){
+		fprintf(stderr, "could not map checkpoint %s\n", path);
+		return NULL;
+	}
+	neuromorph_checkpoint_header header;
+	memcpy(&header, map, sizeof(header));
+	if (header.magic != NEUROMORPH_CHECKPOINT_MAGIC || header.version != NEUROMORPH_CHECKPOINT_VERSION){
+		fprintf(stderr, "%s is not a version %u neuromorph checkpoint\n", path, NEUROMORPH_CHECKPOINT_VERSION);
+		munmap(map, map_size);
+		return NULL;
+	}
+	uint64_t parameter_bytes;
+	if (
+		header.description_length == 0 ||
+		!checkpoint_block_fits(header.description_offset, header.description_length, map_size) ||
+		__builtin_mul_overflow(header.parameter_count, sizeof(float), &parameter_bytes) ||
+		header.parameter_offset % sizeof(float) != 0 ||
+		!checkpoint_block_fits(header.parameter_offset, parameter_bytes, map_size) ||
+		map[header.description_offset+header.description_length-1] != '\0'
+	){
+		fprintf(stderr, "checkpoint %s is truncated\n", path);
+		munmap(map, map_size);
+		return NULL;
+	}
+	neuromorph* model = neuromorph_compile((const char*)map+header.description_offset, header.batch_size, header.learning_rate);
+	if (!model){
+		munmap(map, map_size);
+		return NULL;
+	}
+	neuromorph_build(model);
+	if (model->parameter_count != header.parameter_count){
+		fprintf(stderr, "checkpoint %s holds %lu parameters, its description builds %lu\n",
+			path, header.parameter_count, model->parameter_count
+		);
+		neuromorph_free(model);
+		munmap(map, map_size);
+		return NULL;
+	}
+	neuromorph_parameter_map(model, map, map_size, (float*)(map+header.parameter_offset));
+	return model;
+}
+
+neuromorph* neuromorph_load_shared(const char* path){
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){
+		fprintf(stderr, "could not open checkpoint %s\n", path);
+		return NULL;
+	}
+	return checkpoint_map(fd, path);
+}
+
+// writes a checkpoint of the model into the named POSIX shared memory segment, replacing its contents
+uint8_t neuromorph_share(const neuromorph* const model, const char* name){
+	if (!model->description || !model->parameters){
+		fprintf(stderr, "only built models can be shared\n");
+		return 0;
+	}
+	int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0){
+		fprintf(stderr, "could not open shared memory segment %s\n", name);
+		return 0;
+	}
+	FILE* outfile = fdopen(fd, "wb");
+	if (!outfile){
+		fprintf(stderr, "could not open shared memory segment %s\n", name);
+		close(fd);
+		return 0;
+	}
+	uint8_t written = checkpoint_write(model, outfile);
+	if (fclose(outfile) != 0 || !written){
+		fprintf(stderr, "failed writing shared memory segment %s\n", name);
+		shm_unlink(name);
+		return 0;
+	}
+	return 1;
+}
+
+neuromorph* neuromorph_attach(const char* name){
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0){
+		fprintf(stderr, "could not open shared memory segment %s\n", name);
+		return NULL;
+	}
+	return checkpoint_map(fd, name);
+}
+
+// removes the segment name, models already attached keep their mapping until freed
+uint8_t neuromorph_unshare(const char* name){
+	if (shm_unlink(name) != 0){
+		fprintf(stderr, "could not remove shared memory segment %s\n", name);
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,37 @@
+#ifndef NEUROMORPH_CHECKPOINT_H
+#define NEUROMORPH_CHECKPOINT_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "NeuroMorph.h"
+
+/* On disk layout
+ * [header, 64 bytes][MDL description][parameter block]
+ * the description is stored with its terminating zero, the parameter block is the model's parameter arena,
+ * parameter_count float32 laid out by neuromorph_parameter_layout, starting on a NEUROMORPH_CHECKPOINT_ALIGN boundary
+ * all values are stored in host byte order
+*/
+#define NEUROMORPH_CHECKPOINT_MAGIC 0x4b434d4e
+#define NEUROMORPH_CHECKPOINT_VERSION 1
+#define NEUROMORPH_CHECKPOINT_ALIGN 64
+
+typedef struct neuromorph_checkpoint_header{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t description_offset;
+	uint64_t description_length;
+	uint64_t parameter_offset;
+	uint64_t parameter_count;
+	uint32_t batch_size;
+	float learning_rate;
+	uint64_t reserved[2];
+}neuromorph_checkpoint_header;
+
+uint8_t neuromorph_save(const neuromorph* const model, const char* path);
+neuromorph* neuromorph_load(const char* path);
+neuromorph* neuromorph_load_shared(const char* path);
+uint8_t neuromorph_share(const neuromorph* const model, const char* name);
+neuromorph* neuromorph_attach(const char* name);
+uint8_t neuromorph_unshare(const char* name);
+
+#endif
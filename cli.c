@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "NeuroMorph.h"
+#include "dataset.h"
+#include "checkpoint.h"
+#include "trace.h"
+#include "cost.h"
+#include "gradcheck.h"
+
+/*
+ * nm, a command line driver for the engine
+ * nm train|eval|bench <model> <dataset> [options]
+ * nm gradcheck [model]
+ * model is either an MDL file or a checkpoint written by save, dataset is a file written by save_dataset
+*/
+
+typedef struct cli_args{
+	const char* command;
+	const char* model;
+	const char* dataset;
+	const char* save;
+	const char* trace;
+	size_t batch_size;
+	float learning_rate;
+	size_t epochs;
+	uint16_t threads;
+	uint8_t precision;
+	uint8_t shuffle;
+	uint8_t verbose;
+}cli_args;
+
+typedef struct cli_phase{
+	const char* name;
+	double seconds;
+}cli_phase;
+
+#define CLI_PHASE_MAX 8
+
+typedef struct cli_timing{
+	cli_phase phases[CLI_PHASE_MAX];
+	size_t count;
+	double started;
+}cli_timing;
+
+void cli_usage(){
+	fprintf(stderr,
+		"usage: nm train|eval|bench <model.mdl|model.nmck> <dataset> [options]\n"
+		"       nm gradcheck [model.mdl|model.nmck]\n"
+		"  --batch N      batch size when compiling MDL, default 32\n"
+		"  --lr F         learning rate when compiling MDL, default 0.01\n"
+		"  --epochs N     training epochs for train and bench, default 1\n"
+		"  --threads N    worker threads, default every online core\n"
+		"  --precision P  exact, accurate or fast exp and tanh kernels, default accurate\n"
+		"  --shuffle      shuffle batch order every epoch\n"
+		"  --save PATH    write a checkpoint after training\n"
+		"  --trace PATH   write a Chrome trace of every thread, needs a build with TRACE=1\n"
+		"  --verbose      print every epoch\n"
+	);
+}
+
+uint8_t cli_parse(cli_args* const args, int argc, char** argv){
+	if (argc < 4){
+		return 0;
+	}
+	args->command = argv[1];
+	args->model = argv[2];
+	args->dataset = argv[3];
+	args->save = NULL;
+	args->trace = NULL;
+	args->batch_size = 32;
+	args->learning_rate = 0.01;
+	args->epochs = 1;
+	args->threads = 0;
+	args->precision = NEUROMORPH_PRECISION_ACCURATE;
+	args->shuffle = 0;
+	args->verbose = 0;
+	for (int i = 4;i<argc;++i){
+		const char* flag = argv[i];
+		if (strcmp(flag, "--shuffle") == 0){
+			args->shuffle = 1;
+			continue;
+		}
+		if (strcmp(flag, "--verbose") == 0){
+			args->verbose = 1;
+			continue;
+		}
+		if (i+1 >= argc){
+			fprintf(stderr, "%s needs a value\n", flag);
+			return 0;
+		}
+		const char* value = argv[++i];
+		if (strcmp(flag, "--batch") == 0){
+			args->batch_size = strtoul(value, NULL, 10);
+		}
+		else if (strcmp(flag, "--lr") == 0){
+			args->learning_rate = atof(value);
+		}
+		else if (strcmp(flag, "--epochs") == 0){
+			args->epochs = strtoul(value, NULL, 10);
+		}
+		else if (strcmp(flag, "--threads") == 0){
+			args->threads = strtoul(value, NULL, 10);
+		}
+		else if (strcmp(flag, "--precision") == 0){
+			args->precision = neuromorph_precision_parse(value);
+			if (args->precision == NEUROMORPH_PRECISIONS){
+				fprintf(stderr, "unknown precision %s, expected exact, accurate or fast\n", value);
+				return 0;
+			}
+		}
+		else if (strcmp(flag, "--save") == 0){
+			args->save = value;
+		}
+		else if (strcmp(flag, "--trace") == 0){
+#ifdef nm_trace
+			args->trace = value;
+#else
+			fprintf(stderr, "nm was built without nm_trace, rebuild with make nm TRACE=1\n");
+			return 0;
+#endif
+		}
+		else{
+			fprintf(stderr, "unknown option %s\n", flag);
+			return 0;
+		}
+	}
+	if (args->batch_size == 0 || args->batch_size > UINT16_MAX){
+		fprintf(stderr, "batch size has to be between 1 and %u\n", UINT16_MAX);
+		return 0;
+	}
+	return 1;
+}
+
+void cli_phase_end(cli_timing* const timing, const char* name){
+	double now = neuromorph_seconds();
+	if (timing->count < CLI_PHASE_MAX){
+		timing->phases[timing->count].name = name;
+		timing->phases[timing->count].seconds = now-timing->started;
+		timing->count += 1;
+	}
+	timing->started = now;
+}
+
+char* cli_read_file(const char* path){
+	FILE* infile = fopen(path, "rb");
+	if (!infile){
+		fprintf(stderr, "could not open %s\n", path);
+		return NULL;
+	}
+	fseek(infile, 0, SEEK_END);
+	long size = ftell(infile);
+	fseek(infile, 0, SEEK_SET);
+	// padded with zeros so the first word can always be compared against a magic
+	char* text = calloc(size+sizeof(uint32_t), 1);
+	if (fread(text, 1, size, infile) != (size_t)size){
+		fprintf(stderr, "could not read %s\n", path);
+		free(text);
+		fclose(infile);
+		return NULL;
+	}
+	fclose(infile);
+	return text;
+}
+
+// checkpoints are told apart from MDL by their magic
+neuromorph* cli_model(const cli_args* const args){
+	char* text = cli_read_file(args->model);
+	if (!text){
+		return NULL;
+	}
+	uint32_t magic = 0;
+	memcpy(&magic, text, sizeof(magic));
+	if (magic == NEUROMORPH_CHECKPOINT_MAGIC){
+		free(text);
+		return neuromorph_load(args->model);
+	}
+	neuromorph* model = neuromorph_compile(text, args->batch_size, args->learning_rate);
+	free(text);
+	if (!model){
+		return NULL;
+	}
+	neuromorph_build(model);
+	return model;
+}
+
+double cli_evaluate(neuromorph* model, const neuromorph_dataset* const data){
+	float* losses = malloc(sizeof(float)*data->header.sample_count);
+	double loss = neuromorph_evaluate(model, data->input, data->expected, data->header.sample_count, losses);
+	free(losses);
+	return loss;
+}
+
+// single context predictions over the whole dataset, the path a serving thread takes
+void cli_predict(neuromorph* model, const neuromorph_dataset* const data){
+	neuromorph_context* context = neuromorph_context_init(model);
+	float* output = malloc(sizeof(float)*data->header.sample_count*model->output->buffer_size);
+	neuromorph_predict(context, data->input, output, data->header.sample_count);
+	free(output);
+	neuromorph_context_free(context);
+}
+
+// where training sits against this machine's roofline, from the static cost and the measured rate
+void cli_roofline(neuromorph* model, double samples_per_second){
+	neuromorph_cost* cost = neuromorph_cost_init(model);
+	if (!cost){
+		return;
+	}
+	size_t threads = neuromorph_batch_workers(model, model->batch_size);
+	neuromorph_roofline roofline;
+	neuromorph_roofline_probe(&roofline, threads);
+	double flops = cost->flops[NEUROMORPH_PROFILE_FORWARD]+cost->flops[NEUROMORPH_PROFILE_BACKWARD];
+	double attainable;
+	double efficiency = neuromorph_roofline_efficiency(&roofline, flops, cost->batch_intensity, samples_per_second, &attainable);
+	printf("cost     %.0f flops per sample, intensity %.2f flops/byte per batch\n", flops, cost->batch_intensity);
+	printf("roofline %.2f GFLOP/s achieved of %.2f attainable, %.0f%% efficiency\n", flops*samples_per_second*1e-9, attainable*1e-9, efficiency*100);
+	neuromorph_cost_free(cost);
+}
+
+void cli_gradcheck_print(const neuromorph_gradcheck* const result){
+	printf("%-4s %-11s %-15s %-8s %4zu checked %3zu skipped  max error %.2e of %.0e  analytic %.6g numeric %.6g\n",
+		result->passed ? "ok" : "FAIL", result->kind, result->name,
+		result->precision < NEUROMORPH_PRECISIONS ? neuromorph_precision_name(result->precision) : "-",
+		result->checked, result->skipped, result->max_error, result->tolerance, result->analytic, result->numeric
+	);
+}
+
+// every kernel, then the given model at each precision tier, exits nonzero when any check fails
+int cli_gradcheck(int argc, char** argv){
+	neuromorph_gradcheck results[NEUROMORPH_GRADCHECK_KERNELS];
+	size_t count = neuromorph_gradcheck_kernels(results, NEUROMORPH_GRADCHECK_KERNELS);
+	size_t failed = 0;
+	for (size_t i = 0;i<count;++i){
+		cli_gradcheck_print(results+i);
+		failed += !results[i].passed;
+	}
+	if (argc > 2){
+		cli_args args = {.model = argv[2], .batch_size = 1, .learning_rate = 0.01};
+		neuromorph* model = cli_model(&args);
+		if (!model){
+			return 1;
+		}
+		for (uint8_t precision = 0;precision<NEUROMORPH_PRECISIONS;++precision){
+			neuromorph_gradcheck result;
+			neuromorph_set_precision(model, precision);
+			if (!neuromorph_gradcheck_model(model, &result)){
+				neuromorph_free(model);
+				return 1;
+			}
+			cli_gradcheck_print(&result);
+			failed += !result.passed;
+		}
+		neuromorph_free(model);
+	}
+	printf("%zu failed\n", failed);
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv){
+	if (argc > 1 && strcmp(argv[1], "gradcheck") == 0){
+		return cli_gradcheck(argc, argv);
+	}
+	cli_args args;
+	if (!cli_parse(&args, argc, argv)){
+		cli_usage();
+		return 2;
+	}
+	uint8_t train = strcmp(args.command, "train") == 0;
+	uint8_t eval = strcmp(args.command, "eval") == 0;
+	uint8_t bench = strcmp(args.command, "bench") == 0;
+	if (!train && !eval && !bench){
+		fprintf(stderr, "unknown command %s\n", args.command);
+		cli_usage();
+		return 2;
+	}
+	cli_timing timing = {.count = 0, .started = neuromorph_seconds()};
+	neuromorph* model = cli_model(&args);
+	if (!model){
+		return 1;
+	}
+	if (args.threads){
+		neuromorph_set_workers(model, args.threads);
+	}
+	neuromorph_set_precision(model, args.precision);
+	cli_phase_end(&timing, "build");
+	neuromorph_dataset* data = neuromorph_dataset_open(args.dataset);
+	if (!data){
+		neuromorph_free(model);
+		return 1;
+	}
+	if (data->header.input_width != model->input->buffer_size || data->header.expected_width != model->output->buffer_size){
+		fprintf(stderr, "dataset is %lu to %lu wide, the model %lu to %lu\n",
+			data->header.input_width, data->header.expected_width, model->input->buffer_size, model->output->buffer_size
+		);
+		neuromorph_dataset_close(data);
+		neuromorph_free(model);
+		return 1;
+	}
+	cli_phase_end(&timing, "open");
+#ifdef nm_trace
+	if (args.trace){
+		neuromorph_trace_start(NEUROMORPH_TRACE_DEFAULT_EVENTS);
+	}
+#endif
+	const size_t samples = data->header.sample_count;
+	double train_seconds = 0;
+	size_t trained = 0;
+	float loss = 0;
+	if (train || bench){
+		for (size_t epoch = 0;epoch<args.epochs;++epoch){
+			loss = neuromorph_train_dataset(model, data, args.shuffle, args.verbose);
+			train_seconds += model->epoch_stats.seconds;
+			trained += model->epoch_stats.batches*model->batch_size;
+		}
+		cli_phase_end(&timing, "train");
+		printf("train    loss %.6f  %zu samples  %.0f samples/s\n", loss, trained, train_seconds > 0 ? trained/train_seconds : 0);
+	}
+	if (eval || bench){
+		double start = neuromorph_seconds();
+		double eval_loss = cli_evaluate(model, data);
+		double seconds = neuromorph_seconds()-start;
+		cli_phase_end(&timing, "evaluate");
+		printf("evaluate loss %.6f  %zu samples  %.0f samples/s\n", eval_loss, samples, seconds > 0 ? samples/seconds : 0);
+	}
+	if (bench){
+		double start = neuromorph_seconds();
+		cli_predict(model, data);
+		double seconds = neuromorph_seconds()-start;
+		cli_phase_end(&timing, "predict");
+		printf("predict  %zu samples  %.0f samples/s on one context\n", samples, seconds > 0 ? samples/seconds : 0);
+	}
+#ifdef nm_trace
+	if (args.trace){
+		neuromorph_trace_stop();
+		neuromorph_trace_dump(args.trace);
+	}
+#endif
+	if (args.save){
+		if (!neuromorph_save(model, args.save)){
+			neuromorph_dataset_close(data);
+			neuromorph_free(model);
+			return 1;
+		}
+		cli_phase_end(&timing, "save");
+	}
+	for (size_t i = 0;i<timing.count;++i){
+		printf("%-8s %.4fs\n", timing.phases[i].name, timing.phases[i].seconds);
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("peak rss %.1f MiB, %zu parameters, %u worker threads\n", usage.ru_maxrss/1024.0, model->parameter_count, model->worker_count);
+	// after the rss report, the probe streams buffers far larger than the model
+	if (bench){
+		cli_roofline(model, train_seconds > 0 ? trained/train_seconds : 0);
+	}
+	neuromorph_dataset_close(data);
+	neuromorph_free(model);
+	return 0;
+}
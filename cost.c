@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cost.h"
+#include "dataset.h"
+
+#define ROOFLINE_LAYER_WIDTH 64
+#define ROOFLINE_LAYER_REPEATS 20000
+#define ROOFLINE_STREAM_FLOATS (16<<20)
+#define ROOFLINE_TRIALS 3
+
+static void cost_node(const neuromorph* const model, const neuromorph_node* const node, neuromorph_node_cost* const cost){
+	const double n = node->buffer_size;
+	memset(cost, 0, sizeof(neuromorph_node_cost));
+	cost->node = node;
+	switch(node->type){
+	case OUTPUT_NODE:
+	case LAYER_NODE:{
+		const double weights = node->weight_buffer_size;
+		const size_t parameters = node->weight_buffer_size+node->bias_buffer_size;
+		// node_pass, bias and activation, the output also runs its loss
+		cost->flops[NEUROMORPH_PROFILE_FORWARD] = (2*weights)+(2*n)+(node->type == OUTPUT_NODE ? n : 0);
+		// activation derivative, the delta or loss derivative, bias and weight gradients, the previous delta unless it is the input
+		cost->flops[NEUROMORPH_PROFILE_BACKWARD] = (3*n)+(2*weights)+(node->previous_input ? 0 : 2*weights);
+		cost->weight_bytes = sizeof(float)*parameters;
+		cost->backlog_bytes = sizeof(float)*2*node->buffer_size*model->batch_size;
+		cost->workspace_bytes = sizeof(float)*parameters*(model->worker_count+model->header.optimizer.moments);
+		break;
+	}
+	case CONVERGENT_NODE:
+		if (node->convergent_owner != NULL){
+			// the convergence, then its partial and the two axpys carrying the gradients back
+			cost->flops[NEUROMORPH_PROFILE_FORWARD] = n;
+			cost->flops[NEUROMORPH_PROFILE_BACKWARD] = 6*n;
+		}
+		else{
+			cost->flops[NEUROMORPH_PROFILE_BACKWARD] = 2*n;
+		}
+		cost->backlog_bytes = sizeof(float)*node->buffer_size*model->batch_size;
+		break;
+	case INPUT_NODE:
+	case DIVERGENT_NODE:
+		break;
+	}
+	for (uint8_t phase = 0;phase<2;++phase){
+		cost->bytes[phase] = neuromorph_node_bytes(node, phase);
+		cost->intensity[phase] = cost->bytes[phase] > 0 ? cost->flops[phase]/cost->bytes[phase] : 0;
+	}
+}
+
+neuromorph_cost* neuromorph_cost_init(const neuromorph* const model){
+	if (model->schedule.size == 0){
+		fprintf(stderr, "only built models have a cost\n");
+		return NULL;
+	}
+	neuromorph_cost* cost = calloc(1, sizeof(neuromorph_cost));
+	cost->node_count = model->schedule.size;
+	cost->nodes = malloc(sizeof(neuromorph_node_cost)*cost->node_count);
+	for (size_t i = 0;i<cost->node_count;++i){
+		neuromorph_node_cost* node = cost->nodes+i;
+		cost_node(model, (const neuromorph_node*)model->schedule.data[i], node);
+		for (uint8_t phase = 0;phase<2;++phase){
+			cost->flops[phase] += node->flops[phase];
+			cost->bytes[phase] += node->bytes[phase];
+		}
+		cost->weight_bytes += node->weight_bytes;
+		cost->backlog_bytes += node->backlog_bytes;
+		cost->workspace_bytes += node->workspace_bytes;
+	}
+	for (uint8_t phase = 0;phase<2;++phase){
+		cost->intensity[phase] = cost->bytes[phase] > 0 ? cost->flops[phase]/cost->bytes[phase] : 0;
+	}
+	double train_bytes = cost->bytes[NEUROMORPH_PROFILE_FORWARD]+cost->bytes[NEUROMORPH_PROFILE_BACKWARD];
+	cost->train_intensity = train_bytes > 0 ? (cost->flops[NEUROMORPH_PROFILE_FORWARD]+cost->flops[NEUROMORPH_PROFILE_BACKWARD])/train_bytes : 0;
+	// every training worker holds scratch for the widest node, a delta row and a carry row
+	cost->workspace_bytes += sizeof(float)*model->worker_count*((2*model->widest_node)+(2*model->backlog_size));
+	size_t workers = neuromorph_batch_workers(model, model->batch_size);
+	double sample_bytes = cost->bytes[NEUROMORPH_PROFILE_FORWARD]+cost->bytes[NEUROMORPH_PROFILE_BACKWARD]-(3.0*cost->weight_bytes);
+	cost->batch_flops = model->batch_size*(cost->flops[NEUROMORPH_PROFILE_FORWARD]+cost->flops[NEUROMORPH_PROFILE_BACKWARD]);
+	cost->batch_bytes = (workers*4.0*cost->weight_bytes)+(model->batch_size*sample_bytes);
+	cost->batch_intensity = cost->batch_bytes > 0 ? cost->batch_flops/cost->batch_bytes : 0;
+	return cost;
+}
+
+void neuromorph_cost_free(neuromorph_cost* cost){
+	free(cost->nodes);
+	free(cost);
+}
+
+typedef struct roofline_args{
+	pthread_barrier_t* barrier; // keeps every thread in the same phase
+	size_t stream_floats;
+	double flops;
+	double bandwidth;
+}roofline_args;
+
+// best of a few trials in flops per second, node_pass over a layer small enough to stay in L1
+static double roofline_node_pass(){
+	const size_t width = ROOFLINE_LAYER_WIDTH;
+	neuromorph_node node;
+	memset(&node, 0, sizeof(node));
+	node.buffer_size = width;
+	node.previous_buffer_size = &width;
+	float* weights = malloc(sizeof(float)*width*width);
+	float* biases = calloc(width, sizeof(float));
+	float* previous = malloc(sizeof(float)*width);
+	float* output = malloc(sizeof(float)*width);
+	for (size_t i = 0;i<width*width;++i){
+		weights[i] = 1e-3f;
+	}
+	for (size_t i = 0;i<width;++i){
+		previous[i] = 1;
+	}
+	double best = 0;
+	for (size_t trial = 0;trial<ROOFLINE_TRIALS;++trial){
+		double start = neuromorph_seconds();
+		for (size_t r = 0;r<ROOFLINE_LAYER_REPEATS;++r){
+			node_pass_weights(&node, weights, biases, previous, output);
+		}
+		double seconds = neuromorph_seconds()-start;
+		double rate = seconds > 0 ? (2.0*width*width*ROOFLINE_LAYER_REPEATS)/seconds : 0;
+		if (rate > best){
+			best = rate;
+		}
+	}
+	free(weights);
+	free(biases);
+	free(previous);
+	free(output);
+	return best;
+}
+
+// best of a few trials in bytes per second, each axpy element reads two floats and writes one
+static double roofline_stream(float* const y, const float* const x, size_t size){
+	double best = 0;
+	for (size_t trial = 0;trial<ROOFLINE_TRIALS;++trial){
+		double start = neuromorph_seconds();
+		neuromorph_axpy(y, x, 1e-7f, size);
+		double seconds = neuromorph_seconds()-start;
+		double rate = seconds > 0 ? (12.0*size)/seconds : 0;
+		if (rate > best){
+			best = rate;
+		}
+	}
+	return best;
+}
+
+static void* roofline_worker(void* args){
+	roofline_args* work = args;
+	float* x = malloc(sizeof(float)*work->stream_floats);
+	float* y = malloc(sizeof(float)*work->stream_floats);
+	for (size_t i = 0;i<work->stream_floats;++i){
+		x[i] = 1;
+		y[i] = 0;
+	}
+	pthread_barrier_wait(work->barrier);
+	work->flops = roofline_node_pass();
+	pthread_barrier_wait(work->barrier);
+	work->bandwidth = roofline_stream(y, x, work->stream_floats);
+	free(x);
+	free(y);
+	return NULL;
+}
+
+// every thread measures at once and the rates are summed, the streamed floats are split so the total stays far beyond cache
+void neuromorph_roofline_probe(neuromorph_roofline* const roofline, size_t threads){
+	if (threads == 0){
+		threads = 1;
+	}
+	pthread_t* ids = malloc(sizeof(pthread_t)*threads);
+	roofline_args* work = malloc(sizeof(roofline_args)*threads);
+	size_t share = ROOFLINE_STREAM_FLOATS/threads;
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, NULL, threads);
+	for (size_t i = 0;i<threads;++i){
+		work[i].barrier = &barrier;
+		work[i].stream_floats = share > ROOFLINE_LAYER_WIDTH ? share : ROOFLINE_LAYER_WIDTH;
+		pthread_create(&ids[i], NULL, roofline_worker, (void*)(work+i));
+	}
+	roofline->peak_flops = 0;
+	roofline->bandwidth = 0;
+	for (size_t i = 0;i<threads;++i){
+		pthread_join(ids[i], NULL);
+		roofline->peak_flops += work[i].flops;
+		roofline->bandwidth += work[i].bandwidth;
+	}
+	pthread_barrier_destroy(&barrier);
+	free(ids);
+	free(work);
+}
+
+/*
+ * Achieved flops over what the roofline allows at the given intensity, the lower of peak compute and intensity times bandwidth.
+ * flops is per sample, the attainable flops per second are written to attainable when it is not NULL
+*/
+double neuromorph_roofline_efficiency(const neuromorph_roofline* const roofline, double flops, double intensity, double samples_per_second, double* const attainable){
+	double bound = intensity*roofline->bandwidth;
+	if (bound > roofline->peak_flops){
+		bound = roofline->peak_flops;
+	}
+	if (attainable != NULL){
+		*attainable = bound;
+	}
+	return bound > 0 ? (flops*samples_per_second)/bound : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef NEUROMORPH_COST_H
+#define NEUROMORPH_COST_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "NeuroMorph.h"
+
+/* Static cost of a built model, from node widths alone
+ * flops and bytes are per sample and indexed by NEUROMORPH_PROFILE_FORWARD or BACKWARD,
+ * a weight counts a multiply and an add, activations, losses and convergences count one flop per element per function applied.
+ * Counts are nominal, backward skips the rows of components that are zero, so sparse activations run fewer
+ * bytes is the traffic estimate of neuromorph_node_bytes, intensity is flops over those bytes.
+ * Memory footprints are whole buffers: weights and biases, the node's share of the batch backlog,
+ * and workspace, its gradients in every worker's buffer plus its optimizer state.
+ * The batch figures are what a training step streams from memory: weights stay in cache across a worker's chunk,
+ * so each worker reads them forward and backward and reads and writes its gradients once, activations move per sample
+*/
+typedef struct neuromorph_node_cost{
+	const neuromorph_node* node;
+	double flops[2];
+	double bytes[2];
+	double intensity[2];
+	size_t weight_bytes;
+	size_t backlog_bytes;
+	size_t workspace_bytes;
+}neuromorph_node_cost;
+
+typedef struct neuromorph_cost{
+	neuromorph_node_cost* nodes;
+	size_t node_count;
+	double flops[2];
+	double bytes[2];
+	double intensity[2];
+	double train_intensity; // forward and backward together, what a training step runs per sample
+	double batch_flops;
+	double batch_bytes;
+	double batch_intensity;
+	size_t weight_bytes;
+	size_t backlog_bytes;
+	size_t workspace_bytes; // node workspace plus every worker's scratch, delta and carry rows
+}neuromorph_cost;
+
+/* Attainable throughput of this machine with the engine's own kernels, on the given number of threads
+ * peak_flops from node_pass over an L1 resident layer, bandwidth from axpy streaming vectors far larger than cache
+*/
+typedef struct neuromorph_roofline{
+	double peak_flops;
+	double bandwidth; // bytes per second
+}neuromorph_roofline;
+
+neuromorph_cost* neuromorph_cost_init(const neuromorph* const model);
+void neuromorph_cost_free(neuromorph_cost* cost);
+void neuromorph_roofline_probe(neuromorph_roofline* const roofline, size_t threads);
+double neuromorph_roofline_efficiency(const neuromorph_roofline* const roofline, double flops, double intensity, double samples_per_second, double* const attainable);
+
+#endif
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <math.h>
+
+#include "dataset.h"
+#include "trace.h"
+
+#ifdef nm_sse
+#include <mm_malloc.h>
+#endif
+
+static size_t dataset_align(size_t offset){
+	return (offset+NEUROMORPH_DATASET_ALIGN-1) & ~((size_t)NEUROMORPH_DATASET_ALIGN-1);
+}
+
+/*
+ * Whether a block of count rows of width floats at offset lies past the header inside a file of size bytes,
+ * float aligned, with none of the sums wrapping around on a corrupt header
+*/
+static uint8_t dataset_block_fits(uint64_t offset, uint64_t count, uint64_t width, size_t size){
+	uint64_t bytes;
+	uint64_t end;
+	return offset >= sizeof(neuromorph_dataset_header) &&
+		offset % sizeof(float) == 0 &&
+		!__builtin_mul_overflow(count, width, &bytes) &&
+		!__builtin_mul_overflow(bytes, sizeof(float), &bytes) &&
+		!__builtin_add_overflow(offset, bytes, &end) &&
+		end <= size;
+}
+
+static uint8_t dataset_pad(FILE* outfile, size_t from, size_t to){
+	for (;from<to;++from){
+		if (fputc(0, outfile) == EOF){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint8_t neuromorph_dataset_write(const char* path, const float* const input, const float* const expected, size_t sample_count, size_t input_width, size_t expected_width){
+	FILE* outfile = fopen(path, "wb");
+	if (!outfile){
+		fprintf(stderr, "could not open dataset %s for writing\n", path);
+		return 0;
+	}
+	neuromorph_dataset_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = NEUROMORPH_DATASET_MAGIC;
+	header.version = NEUROMORPH_DATASET_VERSION;
+	header.sample_count = sample_count;
+	header.input_width = input_width;
+	header.expected_width = expected_width;
+	header.input_offset = dataset_align(sizeof(header));
+	size_t input_bytes = sizeof(float)*sample_count*input_width;
+	size_t expected_bytes = sizeof(float)*sample_count*expected_width;
+	header.expected_offset = dataset_align(header.input_offset+input_bytes);
+	uint8_t written = (
+		fwrite(&header, sizeof(header), 1, outfile) == 1 &&
+		dataset_pad(outfile, sizeof(header), header.input_offset) &&
+		fwrite(input, 1, input_bytes, outfile) == input_bytes &&
+		dataset_pad(outfile, header.input_offset+input_bytes, header.expected_offset) &&
+		fwrite(expected, 1, expected_bytes, outfile) == expected_bytes
+	);
+	if (fclose(outfile) != 0 || !written){
+		fprintf(stderr, "failed writing dataset %s\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+neuromorph_dataset* neuromorph_dataset_open(const char* path){
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){
+		fprintf(stderr, "could not open dataset %s\n", path);
+		return NULL;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(neuromorph_dataset_header)){
+		fprintf(stderr, "dataset %s is too small to contain a header\n", path);
+		close(fd);
+		return NULL;
+	}
+	uint8_t* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED){
+		fprintf(stderr, "could not map dataset %s\n", path);
+		close(fd);
+		return NULL;
+	}
+	neuromorph_dataset_header header;
+	memcpy(&header, map, sizeof(header));
+	if (header.magic != NEUROMORPH_DATASET_MAGIC || header.version != NEUROMORPH_DATASET_VERSION){
+		fprintf(stderr, "%s is not a version %u neuromorph dataset\n", path, NEUROMORPH_DATASET_VERSION);
+		munmap(map, info.st_size);
+		close(fd);
+		return NULL;
+	}
+	if (
+		!dataset_block_fits(header.input_offset, header.sample_count, header.input_width, info.st_size) ||
+		!dataset_block_fits(header.expected_offset, header.sample_count, header.expected_width, info.st_size)
+	){
+		fprintf(stderr, "dataset %s is truncated\n", path);
+		munmap(map, info.st_size);
+		close(fd);
+		return NULL;
+	}
+	neuromorph_dataset* data = malloc(sizeof(neuromorph_dataset));
+	data->header = header;
+	data->fd = fd;
+	data->map = map;
+	data->map_size = info.st_size;
+	data->input = (const float*)(map+header.input_offset);
+	data->expected = (const float*)(map+header.expected_offset);
+	return data;
+}
+
+void neuromorph_dataset_close(neuromorph_dataset* data){
+	munmap(data->map, data->map_size);
+	close(data->fd);
+	free(data);
+}
+
+size_t neuromorph_dataset_batch_count(const neuromorph_dataset* const data, size_t batch_size){
+	return data->header.sample_count/batch_size;
+}
+
+const float* neuromorph_dataset_input_batch(const neuromorph_dataset* const data, size_t batch, size_t batch_size){
+	return data->input+(batch*batch_size*data->header.input_width);
+}
+
+const float* neuromorph_dataset_expected_batch(const neuromorph_dataset* const data, size_t batch, size_t batch_size){
+	return data->expected+(batch*batch_size*data->header.expected_width);
+}
+
+static void dataset_advise(const float* start, size_t bytes, int advice){
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t begin = ((uintptr_t)start) & ~(page-1);
+	uintptr_t end = ((uintptr_t)start)+bytes;
+	madvise((void*)begin, end-begin, advice);
+}
+
+void neuromorph_dataset_readahead(const neuromorph_dataset* const data, size_t batch, size_t batch_size){
+	dataset_advise(
+		neuromorph_dataset_input_batch(data, batch, batch_size),
+		sizeof(float)*batch_size*data->header.input_width,
+		MADV_WILLNEED
+	);
+	dataset_advise(
+		neuromorph_dataset_expected_batch(data, batch, batch_size),
+		sizeof(float)*batch_size*data->header.expected_width,
+		MADV_WILLNEED
+	);
+}
+
+void neuromorph_shuffle_batches(size_t* const order, size_t count){
+	for (size_t i = count;i>1;--i){
+		size_t k = random()%i;
+		size_t temp = order[i-1];
+		order[i-1] = order[k];
+		order[k] = temp;
+	}
+}
+
+uint8_t neuromorph_memory_fill(void* view, size_t batch, float* const input, float* const expected){
+	neuromorph_memory_view* source = view;
+	memcpy(input, source->input+(batch*source->input_batch_size), sizeof(float)*source->input_batch_size);
+	memcpy(expected, source->expected+(batch*source->expected_batch_size), sizeof(float)*source->expected_batch_size);
+	return 1;
+}
+
+uint8_t neuromorph_dataset_fill(void* view, size_t batch, float* const input, float* const expected){
+	neuromorph_dataset_view* source = view;
+	memcpy(
+		input,
+		neuromorph_dataset_input_batch(source->data, batch, source->batch_size),
+		sizeof(float)*source->batch_size*source->data->header.input_width
+	);
+	memcpy(
+		expected,
+		neuromorph_dataset_expected_batch(source->data, batch, source->batch_size),
+		sizeof(float)*source->batch_size*source->data->header.expected_width
+	);
+	return 1;
+}
+
+void neuromorph_dataset_source_readahead(void* view, size_t batch){
+	neuromorph_dataset_view* source = view;
+	neuromorph_dataset_readahead(source->data, batch, source->batch_size);
+}
+
+double neuromorph_seconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec+(now.tv_nsec*1e-9);
+}
+
+void neuromorph_prefetcher_init(neuromorph_prefetcher* prefetch, neuromorph_batch_source* source, const size_t* const order, size_t input_size, size_t expected_size){
+	prefetch->source = source;
+	prefetch->order = order;
+	for (size_t slot = 0;slot<2;++slot){
+#ifdef nm_sse
+		prefetch->input[slot] = _mm_malloc(sizeof(float)*input_size, 16);
+		prefetch->expected[slot] = _mm_malloc(sizeof(float)*expected_size, 16);
+#else
+		prefetch->input[slot] = malloc(sizeof(float)*input_size);
+		prefetch->expected[slot] = malloc(sizeof(float)*expected_size);
+#endif
+		prefetch->full[slot] = 0;
+	}
+	prefetch->failed = 0;
+	prefetch->stopped = 0;
+	pthread_mutex_init(&prefetch->mutex, NULL);
+	pthread_cond_init(&prefetch->cond, NULL);
+	pthread_create(&prefetch->thread, NULL, neuromorph_prefetch_thread, (void*)prefetch);
+}
+
+void neuromorph_prefetcher_free(neuromorph_prefetcher* prefetch){
+	pthread_mutex_lock(&prefetch->mutex);
+	prefetch->stopped = 1;
+	pthread_cond_broadcast(&prefetch->cond);
+	pthread_mutex_unlock(&prefetch->mutex);
+	pthread_join(prefetch->thread, NULL);
+	for (size_t slot = 0;slot<2;++slot){
+#ifdef nm_sse
+		_mm_free(prefetch->input[slot]);
+		_mm_free(prefetch->expected[slot]);
+#else
+		free(prefetch->input[slot]);
+		free(prefetch->expected[slot]);
+#endif
+	}
+	pthread_mutex_destroy(&prefetch->mutex);
+	pthread_cond_destroy(&prefetch->cond);
+}
+
+void* neuromorph_prefetch_thread(void* args){
+	neuromorph_prefetcher* prefetch = args;
+	neuromorph_batch_source* source = prefetch->source;
+	for (size_t i = 0;i<source->batch_count;++i){
+		size_t slot = i%2;
+		pthread_mutex_lock(&prefetch->mutex);
+		while (prefetch->full[slot] && !prefetch->stopped){
+			pthread_cond_wait(&prefetch->cond, &prefetch->mutex);
+		}
+		uint8_t stopped = prefetch->stopped;
+		pthread_mutex_unlock(&prefetch->mutex);
+		if (stopped){
+			break;
+		}
+		size_t batch = prefetch->order ? prefetch->order[i] : i;
+		NEUROMORPH_TRACE_BEGIN(load);
+		uint8_t filled = source->fill(source->data, batch, prefetch->input[slot], prefetch->expected[slot]);
+		NEUROMORPH_TRACE_END("load batch", "input", load, 0);
+		if (source->readahead && i+1<source->batch_count){
+			source->readahead(source->data, prefetch->order ? prefetch->order[i+1] : i+1);
+		}
+		pthread_mutex_lock(&prefetch->mutex);
+		if (!filled){
+			prefetch->failed = 1;
+			pthread_cond_broadcast(&prefetch->cond);
+			pthread_mutex_unlock(&prefetch->mutex);
+			break;
+		}
+		prefetch->full[slot] = 1;
+		pthread_cond_broadcast(&prefetch->cond);
+		pthread_mutex_unlock(&prefetch->mutex);
+	}
+	return NULL;
+}
+
+uint8_t neuromorph_prefetcher_acquire(neuromorph_prefetcher* prefetch, size_t index, double* const stall_seconds){
+	size_t slot = index%2;
+	double start = neuromorph_seconds();
+	NEUROMORPH_TRACE_BEGIN(wait);
+	pthread_mutex_lock(&prefetch->mutex);
+	while (!prefetch->full[slot] && !prefetch->failed){
+		pthread_cond_wait(&prefetch->cond, &prefetch->mutex);
+	}
+	uint8_t ready = prefetch->full[slot];
+	pthread_mutex_unlock(&prefetch->mutex);
+	NEUROMORPH_TRACE_END("input stall", "wait", wait, 0);
+	*stall_seconds += neuromorph_seconds()-start;
+	return ready;
+}
+
+void neuromorph_prefetcher_release(neuromorph_prefetcher* prefetch, size_t index){
+	pthread_mutex_lock(&prefetch->mutex);
+	prefetch->full[index%2] = 0;
+	pthread_cond_broadcast(&prefetch->cond);
+	pthread_mutex_unlock(&prefetch->mutex);
+}
+
+float neuromorph_train_source(neuromorph* model, neuromorph_batch_source* source, const size_t* const order, uint8_t verbose){
+	neuromorph_prefetcher prefetch;
+	neuromorph_prefetcher_init(
+		&prefetch,
+		source,
+		order,
+		model->batch_size*model->input->buffer_size,
+		model->batch_size*model->output->buffer_size
+	);
+	double stall_seconds = 0;
+	double start = neuromorph_seconds();
+	float cum_loss = 0;
+	size_t i;
+	for (i = 0;i<source->batch_count;++i){
+		if (!neuromorph_prefetcher_acquire(&prefetch, i, &stall_seconds)){
+			fprintf(stderr, "batch %lu could not be loaded, ending epoch early\n", i);
+			break;
+		}
+		cum_loss += neuromorph_train_batch(model, prefetch.input[i%2], prefetch.expected[i%2], verbose);
+		neuromorph_prefetcher_release(&prefetch, i);
+	}
+	neuromorph_prefetcher_free(&prefetch);
+	neuromorph_flush_gradients(model);
+	model->epoch_stats.batches = i;
+	model->epoch_stats.loss = i ? cum_loss/i : 0;
+	model->epoch_stats.seconds = neuromorph_seconds()-start;
+	model->epoch_stats.stall_seconds = stall_seconds;
+	if (verbose >= 1){
+		printf("Epoch: %lu batches, loss %.4f, %.3fs, %.3fs stalled on input\n",
+			i, model->epoch_stats.loss, model->epoch_stats.seconds, stall_seconds
+		);
+	}
+	return model->epoch_stats.loss;
+}
+
+float neuromorph_train_dataset(neuromorph* model, const neuromorph_dataset* const data, uint8_t shuffle, uint8_t verbose){
+	if (data->header.input_width != model->input->buffer_size){
+		fprintf(stderr, "Dataset input width %lu does not match model input vector size %lu\n",
+			data->header.input_width, model->input->buffer_size
+		);
+		return 0;
+	}
+	if (data->header.expected_width != model->output->buffer_size){
+		fprintf(stderr, "Dataset expected width %lu does not match model output vector size %lu\n",
+			data->header.expected_width, model->output->buffer_size
+		);
+		return 0;
+	}
+	size_t batch_count = neuromorph_dataset_batch_count(data, model->batch_size);
+	if (batch_count == 0){
+		fprintf(stderr, "Dataset holds fewer samples than one batch of %u\n", model->batch_size);
+		return 0;
+	}
+	size_t* order = malloc(sizeof(size_t)*batch_count);
+	for (size_t i = 0;i<batch_count;++i){
+		order[i] = i;
+	}
+	if (shuffle){
+		neuromorph_shuffle_batches(order, batch_count);
+		madvise(data->map, data->map_size, MADV_RANDOM);
+	}
+	else{
+		madvise(data->map, data->map_size, MADV_SEQUENTIAL);
+	}
+	neuromorph_dataset_readahead(data, order[0], model->batch_size);
+	neuromorph_dataset_view view = {data, model->batch_size};
+	neuromorph_batch_source source = {
+		&view,
+		batch_count,
+		neuromorph_dataset_fill,
+		neuromorph_dataset_source_readahead
+	};
+	float loss = neuromorph_train_source(model, &source, order, verbose);
+	free(order);
+	return loss;
+}
+
+float schedule_constant(const float base, const size_t epoch, const size_t epochs, const float a, const float b){
+	return base;
+}
+
+float schedule_step(const float base, const size_t epoch, const size_t epochs, const float a, const float b){
+	size_t period = a < 1 ? 1 : (size_t)a;
+	return base*powf(b, epoch/period);
+}
+
+float schedule_exponential(const float base, const size_t epoch, const size_t epochs, const float a, const float b){
+	return base*powf(a, epoch);
+}
+
+float schedule_cosine(const float base, const size_t epoch, const size_t epochs, const float a, const float b){
+	if (epochs <= 1){
+		return base;
+	}
+	float progress = ((float)epoch)/(epochs-1);
+	return a+(0.5*(base-a)*(1+cosf(M_PI*progress)));
+}
+
+float schedule_warmup(const float base, const size_t epoch, const size_t epochs, const float a, const float b){
+	if (a >= 1 && epoch < (size_t)a){
+		return base*(epoch+1)/a;
+	}
+	return base;
+}
+
+/*
+ * schedules are described like header functions, a name followed by up to two whitespace separated parameters,
+ * left out parameters take the defaults in brackets
+ * constant
+ * step <period [10]> <factor [0.1]>
+ * exponential <factor [0.95]>
+ * cosine <minimum [0]>
+ * warmup <epochs [5]>
+*/
+uint8_t neuromorph_parse_schedule(neuromorph_schedule* const schedule, const char* description){
+	schedule_record function_list[] = {
+		{"constant", schedule_constant, 0, 0},
+		{"step", schedule_step, 10, 0.1},
+		{"exponential", schedule_exponential, 0.95, 0},
+		{"cosine", schedule_cosine, 0, 0},
+		{"warmup", schedule_warmup, 5, 0}
+	};
+	char token[NODE_NAME_TOKEN_MAX];
+	size_t index = 0;
+	while (description[index] != '\0' && description[index] != ' ' && index != NODE_NAME_TOKEN_MAX-1){
+		token[index] = description[index];
+		index++;
+	}
+	token[index] = '\0';
+	schedule->function = NULL;
+	schedule->parameter_a = 0;
+	schedule->parameter_b = 0;
+	for (size_t i = 0;i<SCHEDULE_FUNCTION_COUNT;++i){
+		if (!strcmp(token, function_list[i].name)){
+			schedule->function = function_list[i].function;
+			schedule->parameter_a = function_list[i].parameter_a;
+			schedule->parameter_b = function_list[i].parameter_b;
+			break;
+		}
+	}
+	if (schedule->function == NULL){
+		fprintf(stderr, "no valid learning rate schedule %s\n", token);
+		return 0;
+	}
+	char* end;
+	const char* c = description+index;
+	float parameter = strtof(c, &end);
+	if (end == c){
+		return 1;
+	}
+	schedule->parameter_a = parameter;
+	c = end;
+	parameter = strtof(c, &end);
+	if (end != c){
+		schedule->parameter_b = parameter;
+	}
+	return 1;
+}
+
+uint8_t neuromorph_fit(neuromorph* model, neuromorph_batch_source* train, const neuromorph_sample_view* const validation, const neuromorph_fit_args* const args, neuromorph_fit_history* const history){
+	history->epochs = 0;
+	history->best_epoch = 0;
+	history->stopped_early = 0;
+	history->loss = malloc(sizeof(float)*args->epochs);
+	history->validation_loss = malloc(sizeof(float)*args->epochs);
+	history->learning_rate = malloc(sizeof(float)*args->epochs);
+	if (train->batch_count == 0){
+		fprintf(stderr, "no training batches to fit\n");
+		return 0;
+	}
+	size_t* order = malloc(sizeof(size_t)*train->batch_count);
+	for (size_t i = 0;i<train->batch_count;++i){
+		order[i] = i;
+	}
+	const float base_rate = model->learning_rate;
+	float best = INFINITY;
+	size_t stale = 0;
+	for (size_t epoch = 0;epoch<args->epochs;++epoch){
+		model->learning_rate = args->schedule.function(
+			base_rate,
+			epoch,
+			args->epochs,
+			args->schedule.parameter_a,
+			args->schedule.parameter_b
+		);
+		if (args->shuffle){
+			neuromorph_shuffle_batches(order, train->batch_count);
+		}
+		float loss = neuromorph_train_source(model, train, order, args->verbose);
+		float monitored = loss;
+		history->validation_loss[epoch] = NAN;
+		if (validation != NULL){
+			monitored = neuromorph_evaluate(model, validation->input, validation->expected, validation->sample_count, NULL);
+			history->validation_loss[epoch] = monitored;
+		}
+		history->loss[epoch] = loss;
+		history->learning_rate[epoch] = model->learning_rate;
+		history->epochs = epoch+1;
+		if (args->verbose >= 1){
+			printf("Fit epoch %lu/%lu: learning rate %g, loss %.4f", epoch+1, args->epochs, model->learning_rate, loss);
+			if (validation != NULL){
+				printf(", validation loss %.4f", monitored);
+			}
+			printf("\n");
+		}
+		if (monitored < best){
+			best = monitored;
+			history->best_epoch = epoch;
+			stale = 0;
+			continue;
+		}
+		if (args->patience != 0 && ++stale >= args->patience){
+			history->stopped_early = 1;
+			break;
+		}
+	}
+	model->learning_rate = base_rate;
+	free(order);
+	return 1;
+}
+
+void neuromorph_fit_history_free(neuromorph_fit_history* history){
+	free(history->loss);
+	free(history->validation_loss);
+	free(history->learning_rate);
+}
@@ -0,0 +1,147 @@
+#ifndef NEUROMORPH_DATASET_H
+#define NEUROMORPH_DATASET_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "NeuroMorph.h"
+
+/* On disk layout
+ * [header, 64 bytes][input block][expected block]
+ * input block is sample_count*input_width float32, expected block is sample_count*expected_width float32
+ * both blocks start on a NEUROMORPH_DATASET_ALIGN boundary, offsets are stored in the header
+ * all values are stored in host byte order
+*/
+#define NEUROMORPH_DATASET_MAGIC 0x53444d4e
+#define NEUROMORPH_DATASET_VERSION 1
+#define NEUROMORPH_DATASET_ALIGN 64
+
+typedef struct neuromorph_dataset_header{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sample_count;
+	uint64_t input_width;
+	uint64_t expected_width;
+	uint64_t input_offset;
+	uint64_t expected_offset;
+	uint64_t reserved[2];
+}neuromorph_dataset_header;
+
+typedef struct neuromorph_dataset{
+	neuromorph_dataset_header header;
+	int fd;
+	uint8_t* map;
+	size_t map_size;
+	const float* input;
+	const float* expected;
+}neuromorph_dataset;
+
+uint8_t neuromorph_dataset_write(const char* path, const float* const input, const float* const expected, size_t sample_count, size_t input_width, size_t expected_width);
+neuromorph_dataset* neuromorph_dataset_open(const char* path);
+void neuromorph_dataset_close(neuromorph_dataset* data);
+
+size_t neuromorph_dataset_batch_count(const neuromorph_dataset* const data, size_t batch_size);
+const float* neuromorph_dataset_input_batch(const neuromorph_dataset* const data, size_t batch, size_t batch_size);
+const float* neuromorph_dataset_expected_batch(const neuromorph_dataset* const data, size_t batch, size_t batch_size);
+void neuromorph_dataset_readahead(const neuromorph_dataset* const data, size_t batch, size_t batch_size);
+
+/* Batch sources
+ * fill copies batch number `batch` into the staging buffers, returns 0 on failure
+ * readahead is optional, it is told which batch will be filled after the current one
+ * both are called from the prefetch thread, so sources backed by interpreter objects have to take their own locks
+*/
+typedef struct neuromorph_batch_source{
+	void* data;
+	size_t batch_count;
+	uint8_t (*fill)(void* data, size_t batch, float* const input, float* const expected);
+	void (*readahead)(void* data, size_t batch);
+}neuromorph_batch_source;
+
+typedef struct neuromorph_dataset_view{
+	const neuromorph_dataset* data;
+	size_t batch_size;
+}neuromorph_dataset_view;
+
+typedef struct neuromorph_memory_view{
+	const float* input;
+	const float* expected;
+	size_t input_batch_size;
+	size_t expected_batch_size;
+}neuromorph_memory_view;
+
+typedef struct neuromorph_sample_view{
+	const float* input;
+	const float* expected;
+	size_t sample_count;
+}neuromorph_sample_view;
+
+typedef struct neuromorph_prefetcher{
+	neuromorph_batch_source* source;
+	const size_t* order;
+	float* input[2];
+	float* expected[2];
+	uint8_t full[2];
+	uint8_t failed;
+	uint8_t stopped;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+}neuromorph_prefetcher;
+
+void neuromorph_prefetcher_init(neuromorph_prefetcher* prefetch, neuromorph_batch_source* source, const size_t* const order, size_t input_size, size_t expected_size);
+void neuromorph_prefetcher_free(neuromorph_prefetcher* prefetch);
+void* neuromorph_prefetch_thread(void* args);
+uint8_t neuromorph_prefetcher_acquire(neuromorph_prefetcher* prefetch, size_t index, double* const stall_seconds);
+void neuromorph_prefetcher_release(neuromorph_prefetcher* prefetch, size_t index);
+float neuromorph_train_source(neuromorph* model, neuromorph_batch_source* source, const size_t* const order, uint8_t verbose);
+
+double neuromorph_seconds();
+
+uint8_t neuromorph_memory_fill(void* view, size_t batch, float* const input, float* const expected);
+uint8_t neuromorph_dataset_fill(void* view, size_t batch, float* const input, float* const expected);
+void neuromorph_dataset_source_readahead(void* view, size_t batch);
+void neuromorph_shuffle_batches(size_t* const order, size_t count);
+float neuromorph_train_dataset(neuromorph* model, const neuromorph_dataset* const data, uint8_t shuffle, uint8_t verbose);
+
+#define SCHEDULE_FUNCTION_COUNT 5
+
+typedef struct neuromorph_schedule{
+	float (*function)(const float base, const size_t epoch, const size_t epochs, const float a, const float b);
+	float parameter_a;
+	float parameter_b;
+}neuromorph_schedule;
+
+typedef struct schedule_record{
+	const char* name;
+	float (*function)(const float, const size_t, const size_t, const float, const float);
+	float parameter_a; // used when the description leaves the parameter out
+	float parameter_b;
+}schedule_record;
+
+uint8_t neuromorph_parse_schedule(neuromorph_schedule* const schedule, const char* description);
+float schedule_constant(const float base, const size_t epoch, const size_t epochs, const float a, const float b);
+float schedule_step(const float base, const size_t epoch, const size_t epochs, const float a, const float b);
+float schedule_exponential(const float base, const size_t epoch, const size_t epochs, const float a, const float b);
+float schedule_cosine(const float base, const size_t epoch, const size_t epochs, const float a, const float b);
+float schedule_warmup(const float base, const size_t epoch, const size_t epochs, const float a, const float b);
+
+typedef struct neuromorph_fit_args{
+	size_t epochs;
+	uint8_t shuffle;
+	size_t patience; // epochs without improvement before stopping, 0 never stops early
+	neuromorph_schedule schedule;
+	uint8_t verbose;
+}neuromorph_fit_args;
+
+typedef struct neuromorph_fit_history{
+	size_t epochs;
+	float* loss;
+	float* validation_loss;
+	float* learning_rate;
+	size_t best_epoch;
+	uint8_t stopped_early;
+}neuromorph_fit_history;
+
+uint8_t neuromorph_fit(neuromorph* model, neuromorph_batch_source* train, const neuromorph_sample_view* const validation, const neuromorph_fit_args* const args, neuromorph_fit_history* const history);
+void neuromorph_fit_history_free(neuromorph_fit_history* history);
+
+#endif
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gradcheck.h"
+
+// 3 SIMD vectors and a scalar tail
+#define GRADCHECK_WIDTH 13
+#define GRADCHECK_FLOOR 1e-2
+// one sided differences further apart than this, relative to the steeper one, mark a kink
+#define GRADCHECK_KINK 0.25
+#define GRADCHECK_MODEL_STEP 1e-2f
+#define GRADCHECK_MODEL_TOLERANCE 2e-2
+
+// the fast tier's approximate exp adds its own error to every difference, so it gets a wider step and tolerance
+static const float gradcheck_steps[NEUROMORPH_PRECISIONS] = {1e-2f, 1e-2f, 5e-2f};
+static const double gradcheck_tolerances[NEUROMORPH_PRECISIONS] = {2e-3, 2e-3, 5e-2};
+
+typedef struct gradcheck_activation{
+	const char* name;
+	void (*function)(float* const, const size_t, const float);
+	void (*derivative)(float* const, const float* const, const size_t, const float);
+	float parameter;
+}gradcheck_activation;
+
+typedef struct gradcheck_loss{
+	const char* name;
+	float (*function)(float* const, const float* const, const float* const, const size_t, const float);
+	void (*derivative)(float* const, const float* const, const float* const, const size_t, const float);
+	float parameter;
+	uint8_t distribution; // expected is scaled to sum to 1, as a class distribution
+}gradcheck_loss;
+
+typedef struct gradcheck_convergence{
+	const char* name;
+	void (*function)(const float* const, const float* const, float* const, const size_t);
+	void (*derivative)(const float* const, const float* const, const float* const, float* const, float* const, const size_t);
+}gradcheck_convergence;
+
+// binary_step has no derivative and selu no implementation, softmax is checked on the diagonal of its Jacobian
+static const gradcheck_activation gradcheck_activations[] = {
+	{"sigmoid", activation_sigmoid, activation_sigmoid_partial, 0},
+	{"relu", activation_relu, activation_relu_partial, 0},
+	{"tanh", activation_tanh, activation_tanh_partial, 0},
+	{"linear", activation_linear, activation_linear_partial, 0},
+	{"relu_leaky", activation_relu_leaky, activation_relu_leaky_partial, 0},
+	{"relu_parametric", activation_relu_parametric, activation_relu_parametric_partial, 0.2},
+	{"elu", activation_elu, activation_elu_partial, 0.7},
+	{"softmax", activation_softmax, activation_softmax_partial, 0},
+	{"swish", activation_swish, activation_swish_partial, 0},
+	{"gelu", activation_gelu, activation_gelu_partial, 0}
+};
+
+// the fused output kernel takes logits forward and the softmax of them backward, as backward_row hands it
+static void gradcheck_softmax_cross_entropy_partial(float* const gradient, const float* const logits, const float* const expected, const size_t size, const float parameter){
+	float activated[GRADCHECK_WIDTH];
+	memcpy(activated, logits, sizeof(float)*size);
+	activation_softmax(activated, size, 0);
+	loss_softmax_cross_entropy_partial(gradient, activated, expected, size, parameter);
+}
+
+// the huber threshold sits inside the range of errors so both of its pieces are checked
+static const gradcheck_loss gradcheck_losses[] = {
+	{"mse", loss_mse, loss_mse_partial, 0, 0},
+	{"mae", loss_mae, loss_mae_partial, 0, 0},
+	{"mape", loss_mape, loss_mape_partial, 0, 0},
+	{"huber", loss_huber, loss_huber_partial, 0.25, 0},
+	{"huber_modified", loss_huber_modified, loss_huber_modified_partial, 0, 0},
+	{"cross_entropy", loss_cross_entropy, loss_cross_entropy_partial, 0, 0},
+	{"hinge", loss_hinge, loss_hinge_partial, 0, 0},
+	{"softmax_cross_entropy", loss_softmax_cross_entropy, gradcheck_softmax_cross_entropy_partial, 0, 1}
+};
+
+static const gradcheck_convergence gradcheck_convergences[] = {
+	{"additive", convergence_additive, convergence_additive_partial},
+	{"multiplicative", convergence_multiplicative, convergence_multiplicative_partial},
+	{"average", convergence_average, convergence_average_partial}
+};
+
+#define GRADCHECK_ACTIVATION_COUNT (sizeof(gradcheck_activations)/sizeof(gradcheck_activations[0]))
+#define GRADCHECK_LOSS_COUNT (sizeof(gradcheck_losses)/sizeof(gradcheck_losses[0]))
+#define GRADCHECK_CONVERGENCE_COUNT (sizeof(gradcheck_convergences)/sizeof(gradcheck_convergences[0]))
+
+// a private generator, so checks do not move the seed models initialize from
+static float gradcheck_uniform(uint64_t* const state, float low, float high){
+	*state = (*state*6364136223846793005ULL)+1442695040888963407ULL;
+	return low+((high-low)*(float)(*state>>40)/(float)(1<<24));
+}
+
+static void gradcheck_fill(uint64_t* const state, float* const buffer, size_t size, float low, float high){
+	for (size_t i = 0;i<size;++i){
+		buffer[i] = gradcheck_uniform(state, low, high);
+	}
+}
+
+static void gradcheck_begin(neuromorph_gradcheck* const result, const char* kind, const char* name, uint8_t precision, double tolerance){
+	memset(result, 0, sizeof(neuromorph_gradcheck));
+	result->kind = kind;
+	result->name = name;
+	result->precision = precision;
+	result->tolerance = tolerance;
+}
+
+/*
+ * low, center and high are the function at x-step, x and x+step, below and above are those steps as actually taken in float.
+ * Kinks are skipped, otherwise the central difference is compared to the analytic gradient
+*/
+static void gradcheck_point(neuromorph_gradcheck* const result, double analytic, double low, double center, double high, double below, double above){
+	double numeric = (high-low)/(above+below);
+	double forward = (high-center)/above;
+	double backward = (center-low)/below;
+	if (fabs(forward-backward) > GRADCHECK_KINK*fmax(fmax(fabs(forward), fabs(backward)), GRADCHECK_FLOOR)){
+		result->skipped += 1;
+		return;
+	}
+	double error = fabs(analytic-numeric)/fmax(fmax(fabs(analytic), fabs(numeric)), GRADCHECK_FLOOR);
+	if (isnan(error)){
+		error = INFINITY;
+	}
+	if (error > result->max_error || result->checked == 0){
+		result->max_error = error;
+		result->analytic = analytic;
+		result->numeric = numeric;
+	}
+	result->checked += 1;
+}
+
+static void gradcheck_end(neuromorph_gradcheck* const result){
+	result->passed = result->checked > 0 && result->max_error <= result->tolerance;
+}
+
+static float gradcheck_activation_at(const gradcheck_activation* const kernel, const float* const x, float* const work, size_t index, float value){
+	memcpy(work, x, sizeof(float)*GRADCHECK_WIDTH);
+	work[index] = value;
+	kernel->function(work, GRADCHECK_WIDTH, kernel->parameter);
+	return work[index];
+}
+
+static void gradcheck_activation_run(const gradcheck_activation* const kernel, uint8_t precision, uint64_t* const state, neuromorph_gradcheck* const result){
+	float x[GRADCHECK_WIDTH];
+	float work[GRADCHECK_WIDTH];
+	float analytic[GRADCHECK_WIDTH];
+	const float step = gradcheck_steps[precision];
+	gradcheck_begin(result, "activation", kernel->name, precision, gradcheck_tolerances[precision]);
+	neuromorph_use_precision(precision);
+	gradcheck_fill(state, x, GRADCHECK_WIDTH, -3, 3);
+	kernel->derivative(analytic, x, GRADCHECK_WIDTH, kernel->parameter);
+	for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+		float low = x[i]-step;
+		float high = x[i]+step;
+		gradcheck_point(
+			result,
+			analytic[i],
+			gradcheck_activation_at(kernel, x, work, i, low),
+			gradcheck_activation_at(kernel, x, work, i, x[i]),
+			gradcheck_activation_at(kernel, x, work, i, high),
+			x[i]-low,
+			high-x[i]
+		);
+	}
+	neuromorph_use_precision(NEUROMORPH_PRECISION_ACCURATE);
+	gradcheck_end(result);
+}
+
+static float gradcheck_loss_at(const gradcheck_loss* const kernel, const float* const result, const float* const expected, float* const work, size_t index, float value){
+	float buffer[GRADCHECK_WIDTH];
+	memcpy(work, result, sizeof(float)*GRADCHECK_WIDTH);
+	work[index] = value;
+	return kernel->function(buffer, work, expected, GRADCHECK_WIDTH, kernel->parameter);
+}
+
+static void gradcheck_loss_run(const gradcheck_loss* const kernel, uint64_t* const state, neuromorph_gradcheck* const result){
+	float output[GRADCHECK_WIDTH];
+	float expected[GRADCHECK_WIDTH];
+	float work[GRADCHECK_WIDTH];
+	float analytic[GRADCHECK_WIDTH];
+	const float step = gradcheck_steps[NEUROMORPH_PRECISION_EXACT];
+	gradcheck_begin(result, "loss", kernel->name, NEUROMORPH_PRECISIONS, gradcheck_tolerances[NEUROMORPH_PRECISION_EXACT]);
+	gradcheck_fill(state, expected, GRADCHECK_WIDTH, 0.5, 0.9);
+	// outputs stay clear of the kinks at the expected value and at the huber threshold, a kink just inside one step is not caught
+	for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+		float offset = i%2 ? gradcheck_uniform(state, 0.3, 0.45) : gradcheck_uniform(state, 0.05, 0.2);
+		output[i] = gradcheck_uniform(state, -1, 1) < 0 ? expected[i]-offset : expected[i]+offset;
+	}
+	if (kernel->distribution){
+		float mass = 0;
+		for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+			mass += expected[i];
+		}
+		// logits spread wide enough that p-y is not lost under the float rounding of the log sum
+		for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+			expected[i] /= mass;
+			output[i] *= 4;
+		}
+	}
+	// loss derivatives scale the activation derivative already in the buffer
+	for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+		analytic[i] = 1;
+	}
+	kernel->derivative(analytic, output, expected, GRADCHECK_WIDTH, kernel->parameter);
+	for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+		float low = output[i]-step;
+		float high = output[i]+step;
+		gradcheck_point(
+			result,
+			analytic[i],
+			gradcheck_loss_at(kernel, output, expected, work, i, low),
+			gradcheck_loss_at(kernel, output, expected, work, i, output[i]),
+			gradcheck_loss_at(kernel, output, expected, work, i, high),
+			output[i]-low,
+			high-output[i]
+		);
+	}
+	gradcheck_end(result);
+}
+
+// the convergence weighted by upstream and summed, so its gradient at each input is what the partial returns
+static double gradcheck_convergence_at(const gradcheck_convergence* const kernel, const float* const path, const float* const previous, const float* const upstream){
+	float output[GRADCHECK_WIDTH];
+	kernel->function(path, previous, output, GRADCHECK_WIDTH);
+	double sum = 0;
+	for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+		sum += (double)upstream[i]*output[i];
+	}
+	return sum;
+}
+
+static void gradcheck_convergence_run(const gradcheck_convergence* const kernel, uint64_t* const state, neuromorph_gradcheck* const result){
+	float path[GRADCHECK_WIDTH];
+	float previous[GRADCHECK_WIDTH];
+	float upstream[GRADCHECK_WIDTH];
+	float analytic[2][GRADCHECK_WIDTH];
+	const float step = gradcheck_steps[NEUROMORPH_PRECISION_EXACT];
+	gradcheck_begin(result, "convergence", kernel->name, NEUROMORPH_PRECISIONS, gradcheck_tolerances[NEUROMORPH_PRECISION_EXACT]);
+	gradcheck_fill(state, path, GRADCHECK_WIDTH, -2, 2);
+	gradcheck_fill(state, previous, GRADCHECK_WIDTH, -2, 2);
+	gradcheck_fill(state, upstream, GRADCHECK_WIDTH, -1, 1);
+	kernel->derivative(upstream, previous, path, analytic[0], analytic[1], GRADCHECK_WIDTH);
+	float* inputs[2] = {previous, path};
+	for (size_t input = 0;input<2;++input){
+		float* x = inputs[input];
+		for (size_t i = 0;i<GRADCHECK_WIDTH;++i){
+			float center = x[i];
+			float low = center-step;
+			float high = center+step;
+			x[i] = low;
+			double f_low = gradcheck_convergence_at(kernel, path, previous, upstream);
+			x[i] = high;
+			double f_high = gradcheck_convergence_at(kernel, path, previous, upstream);
+			x[i] = center;
+			double f_center = gradcheck_convergence_at(kernel, path, previous, upstream);
+			gradcheck_point(result, analytic[input][i], f_low, f_center, f_high, center-low, high-center);
+		}
+	}
+	gradcheck_end(result);
+}
+
+// every activation at every precision tier, then every loss and convergence, returns the number of results written
+size_t neuromorph_gradcheck_kernels(neuromorph_gradcheck* const results, size_t capacity){
+	uint64_t state = 1;
+	size_t count = 0;
+	for (uint8_t precision = 0;precision<NEUROMORPH_PRECISIONS;++precision){
+		for (size_t i = 0;i<GRADCHECK_ACTIVATION_COUNT && count<capacity;++i){
+			gradcheck_activation_run(gradcheck_activations+i, precision, &state, results+count);
+			count += 1;
+		}
+	}
+	for (size_t i = 0;i<GRADCHECK_LOSS_COUNT && count<capacity;++i){
+		gradcheck_loss_run(gradcheck_losses+i, &state, results+count);
+		count += 1;
+	}
+	for (size_t i = 0;i<GRADCHECK_CONVERGENCE_COUNT && count<capacity;++i){
+		gradcheck_convergence_run(gradcheck_convergences+i, &state, results+count);
+		count += 1;
+	}
+	return count;
+}
+
+// the fused loss again from the output logits, summed in double so a wide head's change is not lost under the rounding of its log sum
+static double gradcheck_softmax_cross_entropy(const float* const logits, const float* const expected, size_t size){
+	double max = logits[0];
+	for (size_t i = 1;i<size;++i){
+		max = logits[i] > max ? logits[i] : max;
+	}
+	double total = 0;
+	double sum = 0;
+	double mass = 0;
+	for (size_t i = 0;i<size;++i){
+		total += exp(logits[i]-max);
+		sum += expected[i]*(logits[i]-max);
+		mass += expected[i];
+	}
+	return (mass*log(total))-sum;
+}
+
+static double gradcheck_model_loss(neuromorph* model, float* const row, const float* const recurrent_row, float* const scratch, const float* const input, const float* const expected){
+	neuromorph_node* out = model->output;
+	if (!out->softmax_cross_entropy){
+		return neuromorph_forward_row_from(model, model->parameters, row, recurrent_row, scratch, input, expected);
+	}
+	neuromorph_forward_row_from(model, model->parameters, row, recurrent_row, scratch, input, NULL);
+	return gradcheck_softmax_cross_entropy(row+out->backlog_offset, expected, out->buffer_size);
+}
+
+/*
+ * Gradient of the loss of one random sample with respect to every weight and bias, from neuromorph_backward_row,
+ * against the loss of neuromorph_forward_row with that parameter moved either way. Recurrent convergences read a fixed
+ * random row standing in for the previous step, which the gradient does not flow into, at the model's precision tier
+*/
+uint8_t neuromorph_gradcheck_model(neuromorph* model, neuromorph_gradcheck* const result){
+	gradcheck_begin(result, "model", "model", model->precision, GRADCHECK_MODEL_TOLERANCE);
+	if (model->schedule.size == 0){
+		fprintf(stderr, "only built models can be gradient checked\n");
+		return 0;
+	}
+	if (model->parameter_map != NULL){
+		fprintf(stderr, "gradient checks move the weights in place, shared weights are read only\n");
+		return 0;
+	}
+	const size_t input_width = model->input->buffer_size;
+	const size_t output_width = model->output->buffer_size;
+	uint64_t state = 7;
+	float* input = malloc(sizeof(float)*input_width);
+	float* expected = malloc(sizeof(float)*output_width);
+	float* row = calloc(model->backlog_size, sizeof(float));
+	float* recurrent_row = malloc(sizeof(float)*model->backlog_size);
+	float* delta = calloc(model->backlog_size, sizeof(float));
+	float* scratch = malloc(sizeof(float)*((2*model->widest_node)+output_width));
+	float* analytic = calloc(model->parameter_count, sizeof(float));
+	gradcheck_fill(&state, input, input_width, 0, 1);
+	gradcheck_fill(&state, expected, output_width, 0.1, 0.9);
+	if (model->output->softmax_cross_entropy){
+		float mass = 0;
+		for (size_t i = 0;i<output_width;++i){
+			mass += expected[i];
+		}
+		for (size_t i = 0;i<output_width;++i){
+			expected[i] /= mass;
+		}
+	}
+	gradcheck_fill(&state, recurrent_row, model->backlog_size, -1, 1);
+	float* parameters = model->parameters;
+	neuromorph_forward_row_from(model, model->parameters, row, recurrent_row, scratch, input, expected);
+	neuromorph_backward_row(model, row, recurrent_row, delta, NULL, scratch, input, expected, analytic);
+	for (size_t i = 0;i<model->parameter_count;++i){
+		const float center = parameters[i];
+		const float low = center-GRADCHECK_MODEL_STEP;
+		const float high = center+GRADCHECK_MODEL_STEP;
+		parameters[i] = low;
+		double f_low = gradcheck_model_loss(model, row, recurrent_row, scratch, input, expected);
+		parameters[i] = high;
+		double f_high = gradcheck_model_loss(model, row, recurrent_row, scratch, input, expected);
+		parameters[i] = center;
+		double f_center = gradcheck_model_loss(model, row, recurrent_row, scratch, input, expected);
+		gradcheck_point(result, analytic[i], f_low, f_center, f_high, center-low, high-center);
+	}
+	gradcheck_end(result);
+	free(input);
+	free(expected);
+	free(row);
+	free(recurrent_row);
+	free(delta);
+	free(scratch);
+	free(analytic);
+	return 1;
+}
@@ -0,0 +1,32 @@
+#ifndef NEUROMORPH_GRADCHECK_H
+#define NEUROMORPH_GRADCHECK_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "NeuroMorph.h"
+
+/* Analytic gradients against central finite differences
+ * kernels are checked on vectors wide enough to run both the SIMD body and the scalar tail of whichever path was compiled,
+ * activations once per precision tier. A model is checked on every parameter for one random sample.
+ * The error at a point is |analytic-numeric| over the larger of the two and 1e-2, points whose one sided differences
+ * disagree sit on a kink, relu at zero or a hinge, and are skipped rather than compared
+*/
+#define NEUROMORPH_GRADCHECK_KERNELS 41
+
+typedef struct neuromorph_gradcheck{
+	const char* kind; // activation, loss, convergence or model
+	const char* name;
+	uint8_t precision; // NEUROMORPH_PRECISIONS for kernels that do not depend on it
+	size_t checked;
+	size_t skipped;
+	double max_error;
+	double analytic; // both gradients at the worst point
+	double numeric;
+	double tolerance;
+	uint8_t passed;
+}neuromorph_gradcheck;
+
+size_t neuromorph_gradcheck_kernels(neuromorph_gradcheck* const results, size_t capacity);
+uint8_t neuromorph_gradcheck_model(neuromorph* model, neuromorph_gradcheck* const result);
+
+#endif
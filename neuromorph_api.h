@@ -0,0 +1,66 @@
+#ifndef NEUROMORPH_API_H
+#define NEUROMORPH_API_H
+
+/* Public interface of libneuromorph, the engine without the Python module
+ * models, contexts and sessions are opaque, all tensors are float32 laid out sample after sample
+ * functions returning uint8_t return 1 on success and report failures on stderr
+*/
+#include <stddef.h>
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct neuromorph neuromorph;
+typedef struct neuromorph_context neuromorph_context;
+typedef struct neuromorph_session neuromorph_session;
+
+neuromorph* neuromorph_compile(const char* const description, size_t batch_size, float learning_rate);
+void neuromorph_build(neuromorph* model);
+void neuromorph_free(neuromorph* model);
+
+size_t neuromorph_input_width(const neuromorph* model);
+size_t neuromorph_output_width(const neuromorph* model);
+size_t neuromorph_batch_size(const neuromorph* model);
+size_t neuromorph_parameter_count(const neuromorph* model);
+void neuromorph_get_parameters(neuromorph* model, float* const out);
+uint16_t neuromorph_set_workers(neuromorph* model, uint16_t workers);
+
+/* Precision tiers of the exp and tanh behind the sigmoid, tanh, elu, softmax, swish and gelu kernels
+ * exact calls libm per element, accurate is SIMD within a few ulp and the default, fast is SIMD to around 1e-4 relative.
+ * Builds without SIMD run libm at every tier, backward passes always take their derivatives from libm
+*/
+#define NEUROMORPH_PRECISION_EXACT 0
+#define NEUROMORPH_PRECISION_ACCURATE 1
+#define NEUROMORPH_PRECISION_FAST 2
+#define NEUROMORPH_PRECISIONS 3
+
+uint8_t neuromorph_set_precision(neuromorph* model, uint8_t precision);
+uint8_t neuromorph_set_default_precision(uint8_t precision);
+
+// input and expected hold one batch, returns the mean loss
+float neuromorph_train_batch(neuromorph* model, const float* input, const float* expected, uint8_t verbose);
+uint8_t neuromorph_set_accumulation(neuromorph* model, size_t steps);
+float neuromorph_evaluate(neuromorph* model, const float* input, const float* expected, size_t sample_count, float* const losses);
+
+// a context holds the activations of one caller, any number of contexts can predict on one model at once
+neuromorph_context* neuromorph_context_init(neuromorph* model);
+void neuromorph_context_free(neuromorph_context* context);
+void neuromorph_predict(neuromorph_context* context, const float* input, float* output, size_t sample_count);
+
+neuromorph_session* neuromorph_session_init(neuromorph* model);
+void neuromorph_session_free(neuromorph_session* session);
+void neuromorph_session_reset(neuromorph_session* session);
+void neuromorph_session_step(neuromorph_session* session, neuromorph_context* context, const float* const input, float* const output);
+
+uint8_t neuromorph_save(const neuromorph* const model, const char* path);
+neuromorph* neuromorph_load(const char* path);
+neuromorph* neuromorph_load_shared(const char* path);
+uint8_t neuromorph_publish(neuromorph* model, const float* const parameters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
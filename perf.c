@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf.h"
+
+static const uint64_t perf_configs[NEUROMORPH_PERF_COUNTERS] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static const char* perf_names[NEUROMORPH_PERF_COUNTERS] = {
+	"cycles",
+	"instructions",
+	"llc_misses",
+	"branch_misses"
+};
+
+#define PERF_UNTRIED 0
+#define PERF_OPEN 1
+#define PERF_FAILED 2
+
+static uint8_t perf_enabled = 0;
+static pthread_key_t perf_key;
+static pthread_once_t perf_key_once = PTHREAD_ONCE_INIT;
+
+static __thread int perf_fds[NEUROMORPH_PERF_COUNTERS];
+static __thread uint8_t perf_present = 0;
+static __thread uint8_t perf_state = PERF_UNTRIED;
+static __thread int perf_error = 0;
+
+// runs when a thread that opened counters exits
+static void perf_close(void* unused){
+	for (size_t i = 0;i<NEUROMORPH_PERF_COUNTERS;++i){
+		if (perf_present & (1<<i)){
+			close(perf_fds[i]);
+		}
+	}
+	perf_present = 0;
+	perf_state = PERF_UNTRIED;
+}
+
+static void perf_key_init(){
+	pthread_key_create(&perf_key, perf_close);
+}
+
+// user space only, so it works with perf_event_paranoid up to 2
+static int perf_open_counter(uint64_t config, int leader){
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+// opens one group for the calling thread, the first counter that opens leads it
+static void perf_open(){
+	pthread_once(&perf_key_once, perf_key_init);
+	int leader = -1;
+	perf_present = 0;
+	for (size_t i = 0;i<NEUROMORPH_PERF_COUNTERS;++i){
+		int fd = perf_open_counter(perf_configs[i], leader);
+		if (fd < 0){
+			perf_error = errno;
+			continue;
+		}
+		if (leader < 0){
+			leader = fd;
+		}
+		perf_fds[i] = fd;
+		perf_present |= 1<<i;
+	}
+	if (leader < 0){
+		perf_state = PERF_FAILED;
+		return;
+	}
+	perf_state = PERF_OPEN;
+	pthread_setspecific(perf_key, (void*)1);
+}
+
+/*
+ * Turns counting on for every thread, returns whether counters are being read.
+ * The calling thread opens its group right away, if not a single counter opens it reports why and counting stays off
+*/
+uint8_t neuromorph_perf_enable(uint8_t enable){
+	if (!enable){
+		__atomic_store_n(&perf_enabled, 0, __ATOMIC_RELEASE);
+		return 0;
+	}
+	if (perf_state == PERF_UNTRIED){
+		perf_open();
+	}
+	if (perf_state != PERF_OPEN){
+		fprintf(stderr, "hardware counters are not available, perf_event_open failed with %s, see /proc/sys/kernel/perf_event_paranoid\n", strerror(perf_error));
+		return 0;
+	}
+	for (size_t i = 0;i<NEUROMORPH_PERF_COUNTERS;++i){
+		if (!(perf_present & (1<<i))){
+			fprintf(stderr, "counter %s is not available, it will read as missing\n", perf_names[i]);
+		}
+	}
+	__atomic_store_n(&perf_enabled, 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+uint8_t neuromorph_perf_enabled(){
+	return __atomic_load_n(&perf_enabled, __ATOMIC_ACQUIRE);
+}
+
+void neuromorph_perf_read(neuromorph_perf_sample* const sample){
+	sample->present = 0;
+	if (!__atomic_load_n(&perf_enabled, __ATOMIC_RELAXED)){
+		return;
+	}
+	if (perf_state == PERF_UNTRIED){
+		perf_open();
+	}
+	if (perf_state != PERF_OPEN){
+		return;
+	}
+	uint64_t group[1+NEUROMORPH_PERF_COUNTERS];
+	int leader = perf_fds[__builtin_ctz(perf_present)];
+	if (read(leader, group, sizeof(group)) < (ssize_t)sizeof(uint64_t)){
+		return;
+	}
+	// values come in the order the counters joined the group
+	size_t index = 1;
+	for (size_t i = 0;i<NEUROMORPH_PERF_COUNTERS;++i){
+		if (perf_present & (1<<i)){
+			sample->values[i] = group[index++];
+		}
+	}
+	sample->present = perf_present;
+}
+
+const char* neuromorph_perf_name(size_t counter){
+	return counter < NEUROMORPH_PERF_COUNTERS ? perf_names[counter] : "unknown";
+}
@@ -0,0 +1,28 @@
+#ifndef NEUROMORPH_PERF_H
+#define NEUROMORPH_PERF_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/* Hardware counters through perf_event_open, read around every node when built with nm_profile
+ * each thread opens its own counter group the first time it reads one and closes it when it exits,
+ * so counts belong to the thread running the node. Counters the kernel or the machine refuse are left out,
+ * a thread that can open none reads invalid samples and its nodes keep only their wall time
+*/
+#define NEUROMORPH_PERF_CYCLES 0
+#define NEUROMORPH_PERF_INSTRUCTIONS 1
+#define NEUROMORPH_PERF_LLC_MISSES 2
+#define NEUROMORPH_PERF_BRANCH_MISSES 3
+#define NEUROMORPH_PERF_COUNTERS 4
+
+typedef struct neuromorph_perf_sample{
+	uint64_t values[NEUROMORPH_PERF_COUNTERS];
+	uint8_t present; // bit per counter that was read
+}neuromorph_perf_sample;
+
+uint8_t neuromorph_perf_enable(uint8_t enable);
+uint8_t neuromorph_perf_enabled();
+void neuromorph_perf_read(neuromorph_perf_sample* const sample);
+const char* neuromorph_perf_name(size_t counter);
+
+#endif
@@ -0,0 +1,1451 @@
+#include <Python.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "NeuroMorph.h"
+#include "dataset.h"
+#include "checkpoint.h"
+#include "server.h"
+#include "trace.h"
+#include "cost.h"
+#include "gradcheck.h"
+
+static PyObject* nm_compile(PyObject* self, PyObject* args){
+	const char* mdl;
+	uint16_t batch_size;
+	float learning_rate;
+	if (!PyArg_ParseTuple(args, "sIf", &mdl, &batch_size, &learning_rate)){
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = neuromorph_compile(mdl, batch_size, learning_rate);
+	if (sizeof(uintptr_t) == sizeof(long)){
+		return Py_BuildValue("k", (uintptr_t)model);
+	}
+	else if (sizeof(uintptr_t) == sizeof(long long)){
+		return Py_BuildValue("K", (uintptr_t)model);
+	}
+	fprintf(stderr, "Unsupported sizeof uintptr_t\n");
+	Py_RETURN_NONE;
+}
+
+static PyObject* nm_build(PyObject* self, PyObject* args){
+	uintptr_t id;
+	if (sizeof(uintptr_t) == sizeof(long)){
+		if (!PyArg_ParseTuple(args,"k", &id)){
+			fprintf(stderr, "invalid model passed\n");
+			Py_RETURN_NONE;
+		}
+	}
+	else{
+		if (!PyArg_ParseTuple(args,"K", &id)){
+			fprintf(stderr, "invalid model passed\n");
+			Py_RETURN_NONE;
+		}
+	}
+	neuromorph* model = (neuromorph*)id;
+	neuromorph_build(model);
+	if (sizeof(uintptr_t) == sizeof(long)){
+		return Py_BuildValue("k", (uintptr_t)model);
+	}
+	if (sizeof(uintptr_t) == sizeof(long long)){
+		return Py_BuildValue("K", (uintptr_t)model);
+	}
+	fprintf(stderr, "Unsupported sizeof uintptr_t\n");
+	Py_RETURN_NONE;
+}
+
+uint8_t nm_fill_vector(float* v, size_t middle_size, size_t inner_size, PyObject* batch){
+	for (size_t k = 0;k<middle_size;++k){
+		PyObject* inner_list = PyList_GetItem(batch, k);
+		if (!PyList_Check(inner_list)){
+			fprintf(stderr, "non list encountered in batch\n");
+			return 0;
+		}
+		for (size_t j = 0;j<inner_size;++j){
+			PyObject* scalar = PyList_GetItem(inner_list, j);
+			if (!PyFloat_Check(scalar)){
+				fprintf(stderr, "Non float encountered in vector\n");
+				return 0;
+			}
+			v[(k*inner_size)+j] = (float)PyFloat_AsDouble(scalar);
+		}
+	}
+	return 1;
+}
+
+typedef struct nm_list_source{
+	PyObject* input;
+	PyObject* expected;
+	size_t middle_size;
+	size_t input_inner_size;
+	size_t expected_inner_size;
+}nm_list_source;
+
+uint8_t nm_list_source_fill(void* data, size_t batch, float* const input, float* const expected){
+	nm_list_source* source = data;
+	PyGILState_STATE state = PyGILState_Ensure();
+	PyObject* input_mid_list = PyList_GetItem(source->input, batch);
+	PyObject* expected_mid_list = PyList_GetItem(source->expected, batch);
+	uint8_t filled = 0;
+	if (!PyList_Check(input_mid_list) || !PyList_Check(expected_mid_list)){
+		fprintf(stderr, "non list encountered in batch list\n");
+	}
+	else{
+		filled = (
+			nm_fill_vector(input, source->middle_size, source->input_inner_size, input_mid_list) &&
+			nm_fill_vector(expected, source->middle_size, source->expected_inner_size, expected_mid_list)
+		);
+	}
+	PyGILState_Release(state);
+	return filled;
+}
+
+typedef struct nm_buffer_source{
+	Py_buffer input;
+	Py_buffer expected;
+	neuromorph_memory_view view;
+}nm_buffer_source;
+
+uint8_t nm_buffer_check(Py_buffer* view, size_t batch_floats, size_t* const batch_count){
+	if (view->itemsize != sizeof(float) || (view->format && strcmp(view->format, "f"))){
+		fprintf(stderr, "Expected float32 buffer, found format %s\n", view->format ? view->format : "B");
+		return 0;
+	}
+	size_t count = view->len/sizeof(float);
+	if (count % batch_floats != 0){
+		fprintf(stderr, "Buffer of %lu floats is not a whole number of batches of %lu floats\n", count, batch_floats);
+		return 0;
+	}
+	*batch_count = count/batch_floats;
+	return 1;
+}
+
+uint8_t nm_buffer_source_init(nm_buffer_source* data, neuromorph* model, PyObject* input, PyObject* expected, size_t* const batch_count){
+	if (PyObject_GetBuffer(input, &data->input, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0){
+		PyErr_Clear();
+		fprintf(stderr, "Input buffer must be C contiguous\n");
+		return 0;
+	}
+	if (PyObject_GetBuffer(expected, &data->expected, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0){
+		PyErr_Clear();
+		PyBuffer_Release(&data->input);
+		fprintf(stderr, "Expected buffer must be C contiguous\n");
+		return 0;
+	}
+	data->view.input = data->input.buf;
+	data->view.expected = data->expected.buf;
+	data->view.input_batch_size = model->batch_size*model->input->buffer_size;
+	data->view.expected_batch_size = model->batch_size*model->output->buffer_size;
+	size_t input_batches, expected_batches;
+	if (
+		!nm_buffer_check(&data->input, data->view.input_batch_size, &input_batches) ||
+		!nm_buffer_check(&data->expected, data->view.expected_batch_size, &expected_batches)
+	){
+		PyBuffer_Release(&data->input);
+		PyBuffer_Release(&data->expected);
+		return 0;
+	}
+	if (input_batches != expected_batches){
+		fprintf(stderr, "Input batch count does not match Expected batch count: %lu != %lu\n",
+			input_batches, expected_batches
+		);
+		PyBuffer_Release(&data->input);
+		PyBuffer_Release(&data->expected);
+		return 0;
+	}
+	*batch_count = input_batches;
+	return 1;
+}
+
+void nm_buffer_source_free(nm_buffer_source* data){
+	PyBuffer_Release(&data->input);
+	PyBuffer_Release(&data->expected);
+}
+
+PyObject* nm_train_buffer(neuromorph* model, PyObject* input, PyObject* expected, uint16_t verbosity){
+	nm_buffer_source data;
+	size_t batch_count;
+	if (!nm_buffer_source_init(&data, model, input, expected, &batch_count)){
+		Py_RETURN_NONE;
+	}
+	neuromorph_batch_source source = {&data.view, batch_count, neuromorph_memory_fill, NULL};
+	float loss;
+	Py_BEGIN_ALLOW_THREADS
+	loss = neuromorph_train_source(model, &source, NULL, verbosity);
+	Py_END_ALLOW_THREADS
+	nm_buffer_source_free(&data);
+	return Py_BuildValue("f", loss);
+}
+
+static PyObject* nm_train(PyObject* self, PyObject* args){
+	uintptr_t id;
+	uint16_t verbosity;
+	PyObject* intptr = PyTuple_GetItem(args, 0);
+	PyObject* input = PyTuple_GetItem(args, 1);
+	PyObject* expected = PyTuple_GetItem(args, 2);
+	PyObject* int16 = PyTuple_GetItem(args, 3);
+	if (sizeof(uintptr_t) == sizeof(long) && (!intptr || !(id = PyLong_AsUnsignedLong(intptr)))){
+		fprintf(stderr, "Unable to parse model in train\n");
+		Py_RETURN_NONE;
+	}
+	if (sizeof(uintptr_t) == sizeof(long long) && (!intptr || !(id = PyLong_AsUnsignedLongLong(intptr)))){
+		fprintf(stderr, "Unable to parse model in train\n");
+		Py_RETURN_NONE;
+	}
+	if (!int16 || !(verbosity = PyLong_AsUnsignedLong(int16))){
+		fprintf(stderr, "Unable to parse verbisity in train\n");
+		Py_RETURN_NONE;
+	}
+	if (!PyList_Check(input) && PyObject_CheckBuffer(input) && PyObject_CheckBuffer(expected)){
+		return nm_train_buffer((neuromorph*)id, input, expected, verbosity);
+	}
+	if (!PyList_Check(input) || !PyList_Check(expected)){
+		fprintf(stderr, "Expected list\n");
+		Py_RETURN_NONE;
+	}
+	size_t input_outer_size = PyList_Size(input);
+	size_t expected_outer_size = PyList_Size(input);
+	if (!PyList_Check(PyList_GetItem(input, 0)) || !PyList_Check(PyList_GetItem(expected, 0))){
+		fprintf(stderr, "Expected batch, found other type\n");
+		Py_RETURN_NONE;
+	}
+	size_t input_middle_size = PyList_Size(PyList_GetItem(input, 0));
+	size_t expected_middle_size = PyList_Size(PyList_GetItem(input, 0));
+	if (
+		!PyList_Check(PyList_GetItem(PyList_GetItem(input, 0), 0)) ||
+		!PyList_Check(PyList_GetItem(PyList_GetItem(expected, 0), 0))
+	){
+		fprintf(stderr, "Expected vector, found other type\n");
+		Py_RETURN_NONE;
+	}
+	size_t input_inner_size = PyList_Size(PyList_GetItem(PyList_GetItem(input, 0), 0));
+	size_t expected_inner_size = PyList_Size(PyList_GetItem(PyList_GetItem(expected, 0), 0));
+	neuromorph* model = (neuromorph*)id;
+	if (model->input->buffer_size != input_inner_size){
+		fprintf(stderr, "Input vector size %lu does not match model input vector size %lu\n",
+			input_inner_size, model->input->buffer_size
+		);
+		Py_RETURN_NONE;
+	}
+	if (model->output->buffer_size != expected_inner_size){
+		fprintf(stderr, "Expected vector size %lu does not match model output vector size %lu\n",
+			expected_inner_size, model->output->buffer_size
+		);
+		Py_RETURN_NONE;
+	}
+	if (input_outer_size != expected_outer_size){
+		fprintf(stderr, "Input batch count does not match Expected batch count: %lu != %lu\n",
+			input_outer_size, expected_outer_size
+		);
+		Py_RETURN_NONE;
+	}
+	if (input_middle_size != expected_middle_size || input_middle_size != model->batch_size){
+		fprintf(stderr, "Batches dont match model batch size: %u\n", model->batch_size);
+		Py_RETURN_NONE;
+	}
+	nm_list_source data = {
+		input,
+		expected,
+		input_middle_size,
+		input_inner_size,
+		expected_inner_size
+	};
+	neuromorph_batch_source source = {&data, input_outer_size, nm_list_source_fill, NULL};
+	float loss;
+	Py_BEGIN_ALLOW_THREADS
+	loss = neuromorph_train_source(model, &source, NULL, verbosity);
+	Py_END_ALLOW_THREADS
+	return Py_BuildValue("f", loss);
+}
+
+uint8_t nm_parse_model_id(PyObject* intptr, uintptr_t* id){
+	if (!intptr){
+		return 0;
+	}
+	if (sizeof(uintptr_t) == sizeof(long)){
+		*id = PyLong_AsUnsignedLong(intptr);
+	}
+	else{
+		*id = PyLong_AsUnsignedLongLong(intptr);
+	}
+	if (PyErr_Occurred() || *id == 0){
+		PyErr_Clear();
+		return 0;
+	}
+	return 1;
+}
+
+float* nm_flatten_tensor(PyObject* tensor, size_t* const sample_count, size_t* const inner_size){
+	if (!PyList_Check(tensor) || PyList_Size(tensor) == 0){
+		fprintf(stderr, "Expected non empty list\n");
+		return NULL;
+	}
+	PyObject* first_batch = PyList_GetItem(tensor, 0);
+	if (!PyList_Check(first_batch) || PyList_Size(first_batch) == 0){
+		fprintf(stderr, "Expected batch, found other type\n");
+		return NULL;
+	}
+	PyObject* first_vector = PyList_GetItem(first_batch, 0);
+	if (!PyList_Check(first_vector)){
+		fprintf(stderr, "Expected vector, found other type\n");
+		return NULL;
+	}
+	size_t outer_size = PyList_Size(tensor);
+	size_t middle_size = PyList_Size(first_batch);
+	*inner_size = PyList_Size(first_vector);
+	*sample_count = outer_size*middle_size;
+	float* flat = malloc(sizeof(float)*(*sample_count)*(*inner_size));
+	for (size_t i = 0;i<outer_size;++i){
+		PyObject* batch = PyList_GetItem(tensor, i);
+		if (!PyList_Check(batch) || (size_t)PyList_Size(batch) != middle_size){
+			fprintf(stderr, "non list or uneven batch encountered in batch list\n");
+			free(flat);
+			return NULL;
+		}
+		if (!nm_fill_vector(flat+(i*middle_size*(*inner_size)), middle_size, *inner_size, batch)){
+			free(flat);
+			return NULL;
+		}
+	}
+	return flat;
+}
+
+static PyObject* nm_save_dataset(PyObject* self, PyObject* args){
+	const char* path;
+	PyObject* input;
+	PyObject* expected;
+	if (!PyArg_ParseTuple(args, "sOO", &path, &input, &expected)){
+		Py_RETURN_NONE;
+	}
+	size_t input_samples, input_width, expected_samples, expected_width;
+	float* flat_input = nm_flatten_tensor(input, &input_samples, &input_width);
+	if (!flat_input){
+		Py_RETURN_FALSE;
+	}
+	float* flat_expected = nm_flatten_tensor(expected, &expected_samples, &expected_width);
+	if (!flat_expected){
+		free(flat_input);
+		Py_RETURN_FALSE;
+	}
+	if (input_samples != expected_samples){
+		fprintf(stderr, "Input sample count does not match Expected sample count: %lu != %lu\n",
+			input_samples, expected_samples
+		);
+		free(flat_input);
+		free(flat_expected);
+		Py_RETURN_FALSE;
+	}
+	uint8_t written = neuromorph_dataset_write(path, flat_input, flat_expected, input_samples, input_width, expected_width);
+	free(flat_input);
+	free(flat_expected);
+	if (!written){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_train_file(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	const char* path;
+	uint16_t verbosity = 0;
+	int shuffle = 0;
+	if (!PyArg_ParseTuple(args, "Os|Hp", &intptr, &path, &verbosity, &shuffle)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in train_file\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	neuromorph_dataset* data = neuromorph_dataset_open(path);
+	if (!data){
+		Py_RETURN_NONE;
+	}
+	float loss;
+	Py_BEGIN_ALLOW_THREADS
+	loss = neuromorph_train_dataset(model, data, shuffle, verbosity);
+	Py_END_ALLOW_THREADS
+	neuromorph_dataset_close(data);
+	return Py_BuildValue("f", loss);
+}
+
+/*
+ * Data handed to fit is converted or mapped once up front
+ * lists are flattened into contiguous memory, buffers are used in place, and strings are opened as dataset files
+*/
+typedef struct nm_fit_data{
+	float* flat_input;
+	float* flat_expected;
+	nm_buffer_source buffers;
+	uint8_t buffered;
+	neuromorph_dataset* dataset;
+	neuromorph_dataset_view dataset_view;
+	neuromorph_memory_view memory_view;
+	neuromorph_batch_source source;
+	neuromorph_sample_view samples;
+}nm_fit_data;
+
+void nm_fit_data_free(nm_fit_data* data){
+	free(data->flat_input);
+	free(data->flat_expected);
+	if (data->buffered){
+		nm_buffer_source_free(&data->buffers);
+	}
+	if (data->dataset){
+		neuromorph_dataset_close(data->dataset);
+	}
+}
+
+uint8_t nm_fit_data_init(nm_fit_data* data, neuromorph* model, PyObject* input, PyObject* expected){
+	data->flat_input = NULL;
+	data->flat_expected = NULL;
+	data->buffered = 0;
+	data->dataset = NULL;
+	if (PyUnicode_Check(input)){
+		data->dataset = neuromorph_dataset_open(PyUnicode_AsUTF8(input));
+		if (!data->dataset){
+			return 0;
+		}
+		if (
+			data->dataset->header.input_width != model->input->buffer_size ||
+			data->dataset->header.expected_width != model->output->buffer_size
+		){
+			fprintf(stderr, "Dataset widths do not match the model input and output\n");
+			return 0;
+		}
+		data->dataset_view.data = data->dataset;
+		data->dataset_view.batch_size = model->batch_size;
+		data->source.data = &data->dataset_view;
+		data->source.batch_count = neuromorph_dataset_batch_count(data->dataset, model->batch_size);
+		data->source.fill = neuromorph_dataset_fill;
+		data->source.readahead = neuromorph_dataset_source_readahead;
+		data->samples.input = data->dataset->input;
+		data->samples.expected = data->dataset->expected;
+		data->samples.sample_count = data->dataset->header.sample_count;
+		return 1;
+	}
+	if (!PyList_Check(input) && PyObject_CheckBuffer(input) && PyObject_CheckBuffer(expected)){
+		size_t batch_count;
+		if (!nm_buffer_source_init(&data->buffers, model, input, expected, &batch_count)){
+			return 0;
+		}
+		data->buffered = 1;
+		data->source.data = &data->buffers.view;
+		data->source.batch_count = batch_count;
+		data->source.fill = neuromorph_memory_fill;
+		data->source.readahead = NULL;
+		data->samples.input = data->buffers.view.input;
+		data->samples.expected = data->buffers.view.expected;
+		data->samples.sample_count = batch_count*model->batch_size;
+		return 1;
+	}
+	size_t input_samples, input_width, expected_samples, expected_width;
+	data->flat_input = nm_flatten_tensor(input, &input_samples, &input_width);
+	if (!data->flat_input){
+		return 0;
+	}
+	data->flat_expected = nm_flatten_tensor(expected, &expected_samples, &expected_width);
+	if (!data->flat_expected){
+		return 0;
+	}
+	if (input_width != model->input->buffer_size || expected_width != model->output->buffer_size){
+		fprintf(stderr, "Tensor widths do not match the model input and output\n");
+		return 0;
+	}
+	if (input_samples != expected_samples){
+		fprintf(stderr, "Input sample count does not match Expected sample count: %lu != %lu\n",
+			input_samples, expected_samples
+		);
+		return 0;
+	}
+	data->memory_view.input = data->flat_input;
+	data->memory_view.expected = data->flat_expected;
+	data->memory_view.input_batch_size = model->batch_size*model->input->buffer_size;
+	data->memory_view.expected_batch_size = model->batch_size*model->output->buffer_size;
+	data->source.data = &data->memory_view;
+	data->source.batch_count = input_samples/model->batch_size;
+	data->source.fill = neuromorph_memory_fill;
+	data->source.readahead = NULL;
+	data->samples.input = data->flat_input;
+	data->samples.expected = data->flat_expected;
+	data->samples.sample_count = input_samples;
+	return 1;
+}
+
+PyObject* nm_float_list(const float* values, size_t count){
+	PyObject* list = PyList_New(count);
+	for (size_t i = 0;i<count;++i){
+		PyList_SetItem(list, i, PyFloat_FromDouble(values[i]));
+	}
+	return list;
+}
+
+static PyObject* nm_fit(PyObject* self, PyObject* args, PyObject* kwargs){
+	static char* keywords[] = {
+		"model", "input", "expected", "epochs", "shuffle", "lr_schedule", "patience", "validation", "verbosity", NULL
+	};
+	PyObject* intptr;
+	PyObject* input;
+	PyObject* expected = Py_None;
+	Py_ssize_t epochs = 1;
+	int shuffle = 1;
+	const char* schedule_description = "constant";
+	Py_ssize_t patience = 0;
+	PyObject* validation = Py_None;
+	uint16_t verbosity = 0;
+	if (!PyArg_ParseTupleAndKeywords(
+		args, kwargs, "OO|OnpsnOH", keywords,
+		&intptr, &input, &expected, &epochs, &shuffle, &schedule_description, &patience, &validation, &verbosity
+	)){
+		return NULL;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in fit\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	neuromorph_fit_args fit_args = {epochs < 0 ? 0 : epochs, shuffle, patience < 0 ? 0 : patience, {NULL, 0, 0}, verbosity};
+	if (!neuromorph_parse_schedule(&fit_args.schedule, schedule_description)){
+		Py_RETURN_NONE;
+	}
+	nm_fit_data train_data;
+	if (!nm_fit_data_init(&train_data, model, input, expected)){
+		nm_fit_data_free(&train_data);
+		Py_RETURN_NONE;
+	}
+	nm_fit_data validation_data;
+	neuromorph_sample_view* validation_samples = NULL;
+	if (validation != Py_None){
+		PyObject* validation_input = validation;
+		PyObject* validation_expected = Py_None;
+		if (PyTuple_Check(validation) && PyTuple_Size(validation) == 2){
+			validation_input = PyTuple_GetItem(validation, 0);
+			validation_expected = PyTuple_GetItem(validation, 1);
+		}
+		if (!nm_fit_data_init(&validation_data, model, validation_input, validation_expected)){
+			nm_fit_data_free(&validation_data);
+			nm_fit_data_free(&train_data);
+			Py_RETURN_NONE;
+		}
+		validation_samples = &validation_data.samples;
+	}
+	neuromorph_fit_history history;
+	uint8_t fitted;
+	Py_BEGIN_ALLOW_THREADS
+	fitted = neuromorph_fit(model, &train_data.source, validation_samples, &fit_args, &history);
+	Py_END_ALLOW_THREADS
+	nm_fit_data_free(&train_data);
+	if (validation_samples != NULL){
+		nm_fit_data_free(&validation_data);
+	}
+	if (!fitted){
+		neuromorph_fit_history_free(&history);
+		Py_RETURN_NONE;
+	}
+	PyObject* result = Py_BuildValue(
+		"{s:N,s:N,s:N,s:n,s:n,s:O}",
+		"loss", nm_float_list(history.loss, history.epochs),
+		"validation_loss", nm_float_list(history.validation_loss, validation_samples ? history.epochs : 0),
+		"learning_rate", nm_float_list(history.learning_rate, history.epochs),
+		"epochs", (Py_ssize_t)history.epochs,
+		"best_epoch", (Py_ssize_t)history.best_epoch,
+		"stopped_early", history.stopped_early ? Py_True : Py_False
+	);
+	neuromorph_fit_history_free(&history);
+	return result;
+}
+
+static PyObject* nm_epoch_stats(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	if (!PyArg_ParseTuple(args, "O", &intptr)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in epoch_stats\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph_epoch_stats stats = ((neuromorph*)id)->epoch_stats;
+	return Py_BuildValue(
+		"{s:k,s:f,s:d,s:d}",
+		"batches", stats.batches,
+		"loss", stats.loss,
+		"seconds", stats.seconds,
+		"stall_seconds", stats.stall_seconds
+	);
+}
+
+static PyObject* nm_evaluate(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	PyObject* input;
+	PyObject* expected = Py_None;
+	if (!PyArg_ParseTuple(args, "OO|O", &intptr, &input, &expected)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in evaluate\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	nm_fit_data data;
+	if (!nm_fit_data_init(&data, model, input, expected)){
+		nm_fit_data_free(&data);
+		Py_RETURN_NONE;
+	}
+	size_t sample_count = data.samples.sample_count;
+	float* losses = malloc(sizeof(float)*sample_count);
+	float mean;
+	Py_BEGIN_ALLOW_THREADS
+	mean = neuromorph_evaluate(model, data.samples.input, data.samples.expected, sample_count, losses);
+	Py_END_ALLOW_THREADS
+	nm_fit_data_free(&data);
+	PyObject* result = Py_BuildValue("(fN)", mean, nm_float_list(losses, sample_count));
+	free(losses);
+	return result;
+}
+
+static PyObject* nm_threads(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	uint16_t workers = 0;
+	if (!PyArg_ParseTuple(args, "O|H", &intptr, &workers)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in threads\n");
+		Py_RETURN_NONE;
+	}
+	return Py_BuildValue("H", neuromorph_set_workers((neuromorph*)id, workers));
+}
+
+// with a tier name sets the model's precision, returns the tier now in use
+static PyObject* nm_precision(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	const char* name = NULL;
+	if (!PyArg_ParseTuple(args, "O|s", &intptr, &name)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in precision\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	if (name != NULL){
+		uint8_t precision = neuromorph_precision_parse(name);
+		if (precision == NEUROMORPH_PRECISIONS){
+			fprintf(stderr, "unknown precision %s, expected exact, accurate or fast\n", name);
+			Py_RETURN_NONE;
+		}
+		neuromorph_set_precision(model, precision);
+	}
+	return Py_BuildValue("s", neuromorph_precision_name(model->precision));
+}
+
+static PyObject* nm_default_precision(PyObject* self, PyObject* args){
+	const char* name;
+	if (!PyArg_ParseTuple(args, "s", &name)){
+		Py_RETURN_NONE;
+	}
+	uint8_t precision = neuromorph_precision_parse(name);
+	if (precision == NEUROMORPH_PRECISIONS){
+		fprintf(stderr, "unknown precision %s, expected exact, accurate or fast\n", name);
+		Py_RETURN_FALSE;
+	}
+	neuromorph_set_default_precision(precision);
+	Py_RETURN_TRUE;
+}
+
+/*
+ * Sequences are nested lists shaped sequences x timesteps x width, or float32 buffers of the same layout,
+ * timesteps is read from a three dimensional buffer's shape or has to be given
+*/
+static PyObject* nm_train_sequences(PyObject* self, PyObject* args, PyObject* kwargs){
+	static char* keywords[] = {"model", "input", "expected", "window", "timesteps", "verbosity", NULL};
+	PyObject* intptr;
+	PyObject* input;
+	PyObject* expected;
+	Py_ssize_t window = 0;
+	Py_ssize_t timesteps = 0;
+	uint16_t verbosity = 0;
+	if (!PyArg_ParseTupleAndKeywords(
+		args, kwargs, "OOO|nnH", keywords,
+		&intptr, &input, &expected, &window, &timesteps, &verbosity
+	)){
+		return NULL;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in train_sequences\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	const size_t input_width = model->input->buffer_size;
+	const size_t output_width = model->output->buffer_size;
+	float* flat_input = NULL;
+	float* flat_expected = NULL;
+	Py_buffer input_view;
+	Py_buffer expected_view;
+	uint8_t buffered = 0;
+	const float* input_data;
+	const float* expected_data;
+	size_t sequence_count;
+	if (PyList_Check(input)){
+		size_t input_samples, expected_samples, input_inner, expected_inner;
+		flat_input = nm_flatten_tensor(input, &input_samples, &input_inner);
+		flat_expected = flat_input ? nm_flatten_tensor(expected, &expected_samples, &expected_inner) : NULL;
+		if (!flat_expected){
+			free(flat_input);
+			Py_RETURN_NONE;
+		}
+		sequence_count = PyList_Size(input);
+		timesteps = input_samples/sequence_count;
+		if (input_inner != input_width || expected_inner != output_width || input_samples != expected_samples){
+			fprintf(stderr, "Sequence tensors do not match the model input and output\n");
+			free(flat_input);
+			free(flat_expected);
+			Py_RETURN_NONE;
+		}
+		input_data = flat_input;
+		expected_data = flat_expected;
+	}
+	else{
+		if (PyObject_GetBuffer(input, &input_view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_ND) != 0){
+			PyErr_Clear();
+			fprintf(stderr, "Input must be nested lists or a C contiguous buffer\n");
+			Py_RETURN_NONE;
+		}
+		if (PyObject_GetBuffer(expected, &expected_view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_ND) != 0){
+			PyErr_Clear();
+			PyBuffer_Release(&input_view);
+			fprintf(stderr, "Expected must be a C contiguous buffer\n");
+			Py_RETURN_NONE;
+		}
+		buffered = 1;
+		if (timesteps == 0 && input_view.ndim == 3){
+			timesteps = input_view.shape[1];
+		}
+		size_t expected_sequences;
+		if (
+			timesteps <= 0 ||
+			!nm_buffer_check(&input_view, timesteps*input_width, &sequence_count) ||
+			!nm_buffer_check(&expected_view, timesteps*output_width, &expected_sequences) ||
+			sequence_count != expected_sequences
+		){
+			fprintf(stderr, "Sequence buffers need a known timestep count and matching sequence counts\n");
+			PyBuffer_Release(&input_view);
+			PyBuffer_Release(&expected_view);
+			Py_RETURN_NONE;
+		}
+		input_data = input_view.buf;
+		expected_data = expected_view.buf;
+	}
+	float loss;
+	Py_BEGIN_ALLOW_THREADS
+	loss = neuromorph_train_sequences(model, input_data, expected_data, sequence_count, timesteps, window < 0 ? 0 : window, verbosity);
+	Py_END_ALLOW_THREADS
+	free(flat_input);
+	free(flat_expected);
+	if (buffered){
+		PyBuffer_Release(&input_view);
+		PyBuffer_Release(&expected_view);
+	}
+	return Py_BuildValue("f", loss);
+}
+
+uint8_t nm_list_floats(PyObject* list, float* const out, size_t size){
+	if (!PyList_Check(list) || (size_t)PyList_Size(list) != size){
+		fprintf(stderr, "Expected a list of %lu floats\n", size);
+		return 0;
+	}
+	for (size_t i = 0;i<size;++i){
+		out[i] = PyFloat_AsDouble(PyList_GetItem(list, i));
+	}
+	if (PyErr_Occurred()){
+		PyErr_Clear();
+		fprintf(stderr, "Non float encountered in vector\n");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Predicts one vector, or a list of vectors, on a context of its own with the GIL released,
+ * so python threads can predict on one model concurrently
+*/
+static PyObject* nm_predict(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	PyObject* input;
+	if (!PyArg_ParseTuple(args, "OO", &intptr, &input)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in predict\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	if (!PyList_Check(input) || PyList_Size(input) == 0){
+		fprintf(stderr, "Expected a vector or a list of vectors\n");
+		Py_RETURN_NONE;
+	}
+	uint8_t single = !PyList_Check(PyList_GetItem(input, 0));
+	size_t sample_count = single ? 1 : PyList_Size(input);
+	size_t input_width = model->input->buffer_size;
+	size_t output_width = model->output->buffer_size;
+	float* vectors = malloc(sizeof(float)*sample_count*input_width);
+	float* outputs = malloc(sizeof(float)*sample_count*output_width);
+	for (size_t i = 0;i<sample_count;++i){
+		if (!nm_list_floats(single ? input : PyList_GetItem(input, i), vectors+(i*input_width), input_width)){
+			free(vectors);
+			free(outputs);
+			Py_RETURN_NONE;
+		}
+	}
+	neuromorph_context* context = neuromorph_context_init(model);
+	Py_BEGIN_ALLOW_THREADS
+	neuromorph_predict(context, vectors, outputs, sample_count);
+	Py_END_ALLOW_THREADS
+	neuromorph_context_free(context);
+	PyObject* result;
+	if (single){
+		result = nm_float_list(outputs, output_width);
+	}
+	else{
+		result = PyList_New(sample_count);
+		for (size_t i = 0;i<sample_count;++i){
+			PyList_SetItem(result, i, nm_float_list(outputs+(i*output_width), output_width));
+		}
+	}
+	free(vectors);
+	free(outputs);
+	return result;
+}
+
+uint8_t nm_parse_session(PyObject* intptr, neuromorph_session** session){
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse session\n");
+		return 0;
+	}
+	*session = (neuromorph_session*)id;
+	return 1;
+}
+
+static PyObject* nm_session(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	if (!PyArg_ParseTuple(args, "O", &intptr)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in session\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph_session* session = neuromorph_session_init((neuromorph*)id);
+	if (!session){
+		Py_RETURN_NONE;
+	}
+	return PyLong_FromVoidPtr(session);
+}
+
+static PyObject* nm_step(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	PyObject* input;
+	if (!PyArg_ParseTuple(args, "OO", &intptr, &input)){
+		Py_RETURN_NONE;
+	}
+	neuromorph_session* session;
+	if (!nm_parse_session(intptr, &session)){
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = session->model;
+	size_t input_width = model->input->buffer_size;
+	float* vector = malloc(sizeof(float)*(input_width+model->output->buffer_size));
+	float* output = vector+input_width;
+	if (!nm_list_floats(input, vector, input_width)){
+		free(vector);
+		Py_RETURN_NONE;
+	}
+	neuromorph_context* context = neuromorph_context_init(model);
+	Py_BEGIN_ALLOW_THREADS
+	neuromorph_session_step(session, context, vector, output);
+	Py_END_ALLOW_THREADS
+	neuromorph_context_free(context);
+	PyObject* result = nm_float_list(output, model->output->buffer_size);
+	free(vector);
+	return result;
+}
+
+static PyObject* nm_session_reset(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	neuromorph_session* session;
+	if (!PyArg_ParseTuple(args, "O", &intptr) || !nm_parse_session(intptr, &session)){
+		Py_RETURN_NONE;
+	}
+	neuromorph_session_reset(session);
+	Py_RETURN_NONE;
+}
+
+static PyObject* nm_session_release(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	neuromorph_session* session;
+	if (!PyArg_ParseTuple(args, "O", &intptr) || !nm_parse_session(intptr, &session)){
+		Py_RETURN_NONE;
+	}
+	neuromorph_session_free(session);
+	Py_RETURN_NONE;
+}
+
+static PyObject* nm_session_bytes(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	if (!PyArg_ParseTuple(args, "O", &intptr)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in session_bytes\n");
+		Py_RETURN_NONE;
+	}
+	return Py_BuildValue("n", (Py_ssize_t)neuromorph_session_bytes((neuromorph*)id));
+}
+
+static PyObject* nm_accumulate(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	Py_ssize_t steps;
+	if (!PyArg_ParseTuple(args, "On", &intptr, &steps)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in accumulate\n");
+		Py_RETURN_NONE;
+	}
+	if (!neuromorph_set_accumulation((neuromorph*)id, steps < 0 ? 0 : steps)){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_save(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	const char* path;
+	if (!PyArg_ParseTuple(args, "Os", &intptr, &path)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in save\n");
+		Py_RETURN_NONE;
+	}
+	if (!neuromorph_save((neuromorph*)id, path)){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_load(PyObject* self, PyObject* args){
+	const char* path;
+	if (!PyArg_ParseTuple(args, "s", &path)){
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = neuromorph_load(path);
+	if (!model){
+		Py_RETURN_NONE;
+	}
+	return PyLong_FromVoidPtr(model);
+}
+
+static PyObject* nm_load_shared(PyObject* self, PyObject* args){
+	const char* path;
+	if (!PyArg_ParseTuple(args, "s", &path)){
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = neuromorph_load_shared(path);
+	if (!model){
+		Py_RETURN_NONE;
+	}
+	return PyLong_FromVoidPtr(model);
+}
+
+static PyObject* nm_share(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	const char* name;
+	if (!PyArg_ParseTuple(args, "Os", &intptr, &name)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in share\n");
+		Py_RETURN_NONE;
+	}
+	if (!neuromorph_share((neuromorph*)id, name)){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_attach(PyObject* self, PyObject* args){
+	const char* name;
+	if (!PyArg_ParseTuple(args, "s", &name)){
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = neuromorph_attach(name);
+	if (!model){
+		Py_RETURN_NONE;
+	}
+	return PyLong_FromVoidPtr(model);
+}
+
+static PyObject* nm_unshare(PyObject* self, PyObject* args){
+	const char* name;
+	if (!PyArg_ParseTuple(args, "s", &name)){
+		Py_RETURN_NONE;
+	}
+	if (!neuromorph_unshare(name)){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_publish(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	PyObject* source;
+	if (!PyArg_ParseTuple(args, "OO", &intptr, &source)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in publish\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	neuromorph* donor;
+	uint8_t loaded = PyUnicode_Check(source);
+	if (loaded){
+		donor = neuromorph_load(PyUnicode_AsUTF8(source));
+		if (!donor){
+			Py_RETURN_FALSE;
+		}
+	}
+	else{
+		uintptr_t source_id;
+		if (!nm_parse_model_id(source, &source_id)){
+			fprintf(stderr, "Expected a model or a checkpoint path to publish\n");
+			Py_RETURN_NONE;
+		}
+		donor = (neuromorph*)source_id;
+	}
+	uint8_t published = 0;
+	if (donor->parameter_count != model->parameter_count){
+		fprintf(stderr, "Published model has %lu parameters, the serving model has %lu\n",
+			donor->parameter_count, model->parameter_count
+		);
+	}
+	else if (!donor->description || !model->description || strcmp(donor->description, model->description) != 0){
+		fprintf(stderr, "Published model was compiled from a different description than the serving model\n");
+	}
+	else{
+		Py_BEGIN_ALLOW_THREADS
+		published = neuromorph_publish(model, donor->parameters);
+		Py_END_ALLOW_THREADS
+	}
+	if (loaded){
+		neuromorph_free(donor);
+	}
+	if (!published){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_serve(PyObject* self, PyObject* args, PyObject* kwargs){
+	static char* keywords[] = {"model", "path", "max_batch", "max_latency_ms", NULL};
+	PyObject* intptr;
+	const char* path;
+	Py_ssize_t max_batch = 32;
+	double max_latency_ms = 2.0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|nd", keywords, &intptr, &path, &max_batch, &max_latency_ms)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in serve\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph_server_config config = {path, max_batch < 1 ? 1 : max_batch, max_latency_ms*1e-3};
+	uint8_t served;
+	Py_BEGIN_ALLOW_THREADS
+	served = neuromorph_serve((neuromorph*)id, &config);
+	Py_END_ALLOW_THREADS
+	if (!served){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+}
+
+static PyObject* nm_node_profile(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	if (!PyArg_ParseTuple(args, "O", &intptr)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in profile\n");
+		Py_RETURN_NONE;
+	}
+#ifdef nm_profile
+	neuromorph* model = (neuromorph*)id;
+	PyObject* nodes = PyList_New(model->schedule.size);
+	const char* phases[2] = {"forward", "backward"};
+	for (size_t i = 0;i<model->schedule.size;++i){
+		neuromorph_node* node = (neuromorph_node*)model->schedule.data[i];
+		const neuromorph_node_profile* profile = &node->profile;
+		PyObject* entry = Py_BuildValue(
+			"{s:s,s:s,s:K,s:K,s:K,s:K,s:K,s:K}",
+			"name", node->name,
+			"type", neuromorph_node_type_name(node),
+			"forward_ns", profile->nanoseconds[NEUROMORPH_PROFILE_FORWARD],
+			"forward_calls", profile->calls[NEUROMORPH_PROFILE_FORWARD],
+			"forward_bytes", profile->bytes[NEUROMORPH_PROFILE_FORWARD],
+			"backward_ns", profile->nanoseconds[NEUROMORPH_PROFILE_BACKWARD],
+			"backward_calls", profile->calls[NEUROMORPH_PROFILE_BACKWARD],
+			"backward_bytes", profile->bytes[NEUROMORPH_PROFILE_BACKWARD]
+		);
+		for (size_t phase = 0;phase<2;++phase){
+			if (profile->counted[phase] == 0){
+				continue;
+			}
+			char key[64];
+			for (size_t counter = 0;counter<NEUROMORPH_PERF_COUNTERS;++counter){
+				snprintf(key, sizeof(key), "%s_%s", phases[phase], neuromorph_perf_name(counter));
+				PyObject* value = PyLong_FromUnsignedLongLong(profile->counters[phase][counter]);
+				PyDict_SetItemString(entry, key, value);
+				Py_DECREF(value);
+			}
+			uint64_t cycles = profile->counters[phase][NEUROMORPH_PERF_CYCLES];
+			snprintf(key, sizeof(key), "%s_ipc", phases[phase]);
+			PyObject* ipc = PyFloat_FromDouble(cycles ? (double)profile->counters[phase][NEUROMORPH_PERF_INSTRUCTIONS]/cycles : 0);
+			PyDict_SetItemString(entry, key, ipc);
+			Py_DECREF(ipc);
+			snprintf(key, sizeof(key), "%s_counted_calls", phases[phase]);
+			PyObject* counted = PyLong_FromUnsignedLongLong(profile->counted[phase]);
+			PyDict_SetItemString(entry, key, counted);
+			Py_DECREF(counted);
+		}
+		PyList_SetItem(nodes, i, entry);
+	}
+	return nodes;
+#else
+	fprintf(stderr, "neuromorph was built without nm_profile, rebuild with NM_PROFILE=1 to collect node timings\n");
+	Py_RETURN_NONE;
+#endif
+}
+
+static PyObject* nm_node_profile_reset(PyObject* self, PyObject* args){
+	PyObject* intptr;
+	if (!PyArg_ParseTuple(args, "O", &intptr)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in profile_reset\n");
+		Py_RETURN_NONE;
+	}
+#ifdef nm_profile
+	neuromorph_profile_reset((neuromorph*)id);
+#endif
+	Py_RETURN_NONE;
+}
+
+static PyObject* nm_cost(PyObject* self, PyObject* args, PyObject* kwargs){
+	static char* keywords[] = {"model", "samples_per_second", "roofline", NULL};
+	static neuromorph_roofline roofline = {0, 0};
+	static size_t roofline_threads = 0;
+	PyObject* intptr;
+	double samples_per_second = 0;
+	int measure = 1;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|dp", keywords, &intptr, &samples_per_second, &measure)){
+		Py_RETURN_NONE;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in cost\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph* model = (neuromorph*)id;
+	neuromorph_cost* cost = neuromorph_cost_init(model);
+	if (!cost){
+		Py_RETURN_NONE;
+	}
+	PyObject* nodes = PyList_New(cost->node_count);
+	for (size_t i = 0;i<cost->node_count;++i){
+		const neuromorph_node_cost* node = cost->nodes+i;
+		PyList_SetItem(nodes, i, Py_BuildValue(
+			"{s:s,s:s,s:d,s:d,s:d,s:d,s:d,s:d,s:K,s:K,s:K}",
+			"name", node->node->name,
+			"type", neuromorph_node_type_name(node->node),
+			"forward_flops", node->flops[NEUROMORPH_PROFILE_FORWARD],
+			"backward_flops", node->flops[NEUROMORPH_PROFILE_BACKWARD],
+			"forward_bytes", node->bytes[NEUROMORPH_PROFILE_FORWARD],
+			"backward_bytes", node->bytes[NEUROMORPH_PROFILE_BACKWARD],
+			"forward_intensity", node->intensity[NEUROMORPH_PROFILE_FORWARD],
+			"backward_intensity", node->intensity[NEUROMORPH_PROFILE_BACKWARD],
+			"weight_bytes", (unsigned long long)node->weight_bytes,
+			"backlog_bytes", (unsigned long long)node->backlog_bytes,
+			"workspace_bytes", (unsigned long long)node->workspace_bytes
+		));
+	}
+	PyObject* report = Py_BuildValue(
+		"{s:N,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:K,s:K,s:K}",
+		"nodes", nodes,
+		"forward_flops", cost->flops[NEUROMORPH_PROFILE_FORWARD],
+		"backward_flops", cost->flops[NEUROMORPH_PROFILE_BACKWARD],
+		"forward_bytes", cost->bytes[NEUROMORPH_PROFILE_FORWARD],
+		"backward_bytes", cost->bytes[NEUROMORPH_PROFILE_BACKWARD],
+		"forward_intensity", cost->intensity[NEUROMORPH_PROFILE_FORWARD],
+		"backward_intensity", cost->intensity[NEUROMORPH_PROFILE_BACKWARD],
+		"train_intensity", cost->train_intensity,
+		"batch_intensity", cost->batch_intensity,
+		"weight_bytes", (unsigned long long)cost->weight_bytes,
+		"backlog_bytes", (unsigned long long)cost->backlog_bytes,
+		"workspace_bytes", (unsigned long long)cost->workspace_bytes
+	);
+	// without a measured rate, the last training epoch gives one
+	if (samples_per_second <= 0 && model->epoch_stats.seconds > 0){
+		samples_per_second = (model->epoch_stats.batches*model->batch_size)/model->epoch_stats.seconds;
+	}
+	if (measure){
+		size_t threads = neuromorph_batch_workers(model, model->batch_size);
+		if (roofline_threads != threads){
+			Py_BEGIN_ALLOW_THREADS
+			neuromorph_roofline_probe(&roofline, threads);
+			Py_END_ALLOW_THREADS
+			roofline_threads = threads;
+		}
+		PyObject* peak = PyFloat_FromDouble(roofline.peak_flops);
+		PyObject* bandwidth = PyFloat_FromDouble(roofline.bandwidth);
+		PyDict_SetItemString(report, "peak_flops", peak);
+		PyDict_SetItemString(report, "bandwidth", bandwidth);
+		Py_DECREF(peak);
+		Py_DECREF(bandwidth);
+		if (samples_per_second > 0){
+			double flops = cost->flops[NEUROMORPH_PROFILE_FORWARD]+cost->flops[NEUROMORPH_PROFILE_BACKWARD];
+			double attainable;
+			double efficiency = neuromorph_roofline_efficiency(&roofline, flops, cost->batch_intensity, samples_per_second, &attainable);
+			PyObject* measured = Py_BuildValue(
+				"{s:d,s:d,s:d,s:d}",
+				"samples_per_second", samples_per_second,
+				"achieved_flops", flops*samples_per_second,
+				"attainable_flops", attainable,
+				"efficiency", efficiency
+			);
+			PyDict_Update(report, measured);
+			Py_DECREF(measured);
+		}
+	}
+	neuromorph_cost_free(cost);
+	return report;
+}
+
+static PyObject* nm_gradcheck_result(const neuromorph_gradcheck* const result){
+	// kernels that do not depend on the tier report None
+	const char* precision = result->precision < NEUROMORPH_PRECISIONS ? neuromorph_precision_name(result->precision) : NULL;
+	return Py_BuildValue(
+		"{s:s,s:s,s:z,s:K,s:K,s:d,s:d,s:d,s:d,s:O}",
+		"kind", result->kind,
+		"name", result->name,
+		"precision", precision,
+		"checked", (unsigned long long)result->checked,
+		"skipped", (unsigned long long)result->skipped,
+		"max_error", result->max_error,
+		"analytic", result->analytic,
+		"numeric", result->numeric,
+		"tolerance", result->tolerance,
+		"passed", result->passed ? Py_True : Py_False
+	);
+}
+
+static PyObject* nm_gradcheck(PyObject* self, PyObject* args){
+	PyObject* intptr = NULL;
+	if (!PyArg_ParseTuple(args, "|O", &intptr)){
+		Py_RETURN_NONE;
+	}
+	if (intptr == NULL){
+		neuromorph_gradcheck results[NEUROMORPH_GRADCHECK_KERNELS];
+		size_t count = neuromorph_gradcheck_kernels(results, NEUROMORPH_GRADCHECK_KERNELS);
+		PyObject* list = PyList_New(count);
+		for (size_t i = 0;i<count;++i){
+			PyList_SetItem(list, i, nm_gradcheck_result(results+i));
+		}
+		return list;
+	}
+	uintptr_t id;
+	if (!nm_parse_model_id(intptr, &id)){
+		fprintf(stderr, "Unable to parse model in gradcheck\n");
+		Py_RETURN_NONE;
+	}
+	neuromorph_gradcheck result;
+	if (!neuromorph_gradcheck_model((neuromorph*)id, &result)){
+		Py_RETURN_NONE;
+	}
+	return nm_gradcheck_result(&result);
+}
+
+static PyObject* nm_profile_counters(PyObject* self, PyObject* args){
+	int enable = 1;
+	if (!PyArg_ParseTuple(args, "|p", &enable)){
+		Py_RETURN_NONE;
+	}
+#ifdef nm_profile
+	if (neuromorph_perf_enable(enable)){
+		Py_RETURN_TRUE;
+	}
+#else
+	fprintf(stderr, "neuromorph was built without nm_profile, rebuild with NM_PROFILE=1 to collect node counters\n");
+#endif
+	Py_RETURN_FALSE;
+}
+
+static PyObject* nm_trace_start(PyObject* self, PyObject* args){
+	unsigned long long max_events = NEUROMORPH_TRACE_DEFAULT_EVENTS;
+	if (!PyArg_ParseTuple(args, "|K", &max_events)){
+		Py_RETURN_NONE;
+	}
+#ifdef nm_trace
+	neuromorph_trace_start(max_events);
+	Py_RETURN_TRUE;
+#else
+	fprintf(stderr, "neuromorph was built without nm_trace, rebuild with NM_TRACE=1 to record a timeline\n");
+	Py_RETURN_FALSE;
+#endif
+}
+
+static PyObject* nm_trace_stop(PyObject* self, PyObject* args){
+#ifdef nm_trace
+	neuromorph_trace_stop();
+#endif
+	Py_RETURN_NONE;
+}
+
+static PyObject* nm_trace_dump(PyObject* self, PyObject* args){
+	const char* path;
+	if (!PyArg_ParseTuple(args, "s", &path)){
+		Py_RETURN_NONE;
+	}
+#ifdef nm_trace
+	if (!neuromorph_trace_dump(path)){
+		Py_RETURN_FALSE;
+	}
+	Py_RETURN_TRUE;
+#else
+	fprintf(stderr, "neuromorph was built without nm_trace, rebuild with NM_TRACE=1 to record a timeline\n");
+	Py_RETURN_FALSE;
+#endif
+}
+
+static PyObject* nm_seed(PyObject* self, PyObject* args){
+	time_t sd;
+	if (!PyArg_ParseTuple(args, "K", &sd)){
+		Py_RETURN_NONE;
+	}
+	set_seed(sd);
+	Py_RETURN_NONE;
+}
+
+static PyObject* nm_release(PyObject* self, PyObject* args){
+	uintptr_t id;
+	if (sizeof(uintptr_t) == sizeof(long)){
+		if (!PyArg_ParseTuple(args,"k", &id)){
+			fprintf(stderr, "invalid model passed\n");
+			Py_RETURN_NONE;
+		}
+	}
+	else{
+		if (!PyArg_ParseTuple(args,"K", &id)){
+			fprintf(stderr, "invalid model passed\n");
+			Py_RETURN_NONE;
+		}
+	}
+	neuromorph* model = (neuromorph*)id;
+	neuromorph_free(model);
+	Py_RETURN_NONE;
+}
+
+static PyObject* say_hello(PyObject* self, PyObject* args){
+	const char* description;
+	if (!PyArg_ParseTuple(args, "s", &description)){
+		return NULL;
+	}
+	neuromorph* model = neuromorph_compile(description, 5, 0.001);
+	neuromorph_build(model);
+	printf("compiled and built model:\n%s\n\n Running batch test\n\n", description);
+	float* input = malloc(sizeof(float)*5*model->input->buffer_size);
+	float* expected = malloc(sizeof(float)*5*model->output->buffer_size);
+	float lll = neuromorph_train_batch(model, input, expected, 2);
+	free(input);
+	free(expected);
+	neuromorph_free(model);
+	printf("memory freed\n");
+	char greeting[512];
+	snprintf(greeting, sizeof(greeting), "test passed\n\n");
+	return Py_BuildValue("s", greeting);
+}
+
+static PyMethodDef NeuroMorph[] = {
+	{"say_hello",(PyCFunction)say_hello,METH_VARARGS, "Test function, given MDL compiles, builds, runs single arbitrary random test batch, frees memory"},
+	{"compile",(PyCFunction)nm_compile,METH_VARARGS, "Compiles a model from MDL"},
+	{"build",(PyCFunction)nm_build,METH_VARARGS, "Builds a compiled model"},
+	{"train",(PyCFunction)nm_train,METH_VARARGS, "Trains the model on the given batches input and expected values"},
+	{"save_dataset",(PyCFunction)nm_save_dataset,METH_VARARGS, "Writes input and expected tensors to a binary dataset file for train_file"},
+	{"train_file",(PyCFunction)nm_train_file,METH_VARARGS, "Trains the model on a memory mapped binary dataset file, optionally shuffling batch order"},
+	{"fit",(PyCFunction)nm_fit,METH_VARARGS | METH_KEYWORDS, "Runs several epochs in C with batch shuffling, a learning rate schedule, validation and early stopping"},
+	{"evaluate",(PyCFunction)nm_evaluate,METH_VARARGS, "Returns the mean and per sample loss over the given data, forward only, split across worker threads"},
+	{"threads",(PyCFunction)nm_threads,METH_VARARGS, "Sets the number of worker threads used by train and evaluate, 0 or no count uses every online core"},
+	{"precision",(PyCFunction)nm_precision,METH_VARARGS, "Sets the model's exp and tanh kernels to exact, accurate or fast when given a tier, returns the tier in use"},
+	{"default_precision",(PyCFunction)nm_default_precision,METH_VARARGS, "Sets the precision tier models start with"},
+	{"train_sequences",(PyCFunction)nm_train_sequences,METH_VARARGS | METH_KEYWORDS, "Trains on whole sequences with truncated backpropagation through time over a window of steps"},
+	{"predict",(PyCFunction)nm_predict,METH_VARARGS, "Returns the output for one input vector or a list of them, safe to call from several threads on one model"},
+	{"session",(PyCFunction)nm_session,METH_VARARGS, "Creates an inference session holding the recurrent state of one stream over the model's weights"},
+	{"step",(PyCFunction)nm_step,METH_VARARGS, "Runs one timestep through a session and returns the output vector"},
+	{"session_reset",(PyCFunction)nm_session_reset,METH_VARARGS, "Zeroes a session's recurrent state"},
+	{"session_release",(PyCFunction)nm_session_release,METH_VARARGS, "Releases a session"},
+	{"session_bytes",(PyCFunction)nm_session_bytes,METH_VARARGS, "Returns the memory held by one session of the model in bytes"},
+	{"accumulate",(PyCFunction)nm_accumulate,METH_VARARGS, "Sums gradients over the given number of batches before each update, 1 updates every batch"},
+	{"save",(PyCFunction)nm_save,METH_VARARGS, "Writes a built model's description and parameters to a checkpoint file"},
+	{"load",(PyCFunction)nm_load,METH_VARARGS, "Compiles and builds the model stored in a checkpoint file with its trained parameters"},
+	{"load_shared",(PyCFunction)nm_load_shared,METH_VARARGS, "Maps a checkpoint file read only, its weights are shared by every process mapping it"},
+	{"share",(PyCFunction)nm_share,METH_VARARGS, "Writes a built model's checkpoint into a named shared memory segment"},
+	{"attach",(PyCFunction)nm_attach,METH_VARARGS, "Builds a model whose weights are the read only contents of a named shared memory segment"},
+	{"unshare",(PyCFunction)nm_unshare,METH_VARARGS, "Removes a named shared memory segment, attached models keep their weights until released"},
+	{"publish",(PyCFunction)nm_publish,METH_VARARGS, "Atomically swaps in the weights of another model or a checkpoint file while predictions keep running"},
+	{"serve",(PyCFunction)nm_serve,METH_VARARGS | METH_KEYWORDS, "Serves batched predictions on a unix socket until a client requests shutdown"},
+	{"profile",(PyCFunction)nm_node_profile,METH_VARARGS, "Returns time, calls and bytes touched per scheduled node, forward and backward, when built with nm_profile"},
+	{"profile_reset",(PyCFunction)nm_node_profile_reset,METH_VARARGS, "Zeroes every node's profiling counters"},
+	{"cost",(PyCFunction)nm_cost,METH_VARARGS | METH_KEYWORDS, "Reports flops, bytes and arithmetic intensity per node and in total, with a roofline efficiency for a measured training rate"},
+	{"gradcheck",(PyCFunction)nm_gradcheck,METH_VARARGS, "Checks analytic gradients against finite differences, of every kernel or of a built model's parameters at its precision tier"},
+	{"profile_counters",(PyCFunction)nm_profile_counters,METH_VARARGS, "Turns hardware counters per node on or off, returns whether they are being read"},
+	{"trace_start",(PyCFunction)nm_trace_start,METH_VARARGS, "Clears the timeline and records spans of every thread, up to max_events, when built with nm_trace"},
+	{"trace_stop",(PyCFunction)nm_trace_stop,METH_NOARGS, "Stops recording spans"},
+	{"trace_dump",(PyCFunction)nm_trace_dump,METH_VARARGS, "Writes the recorded spans as Chrome trace event JSON"},
+	{"epoch_stats",(PyCFunction)nm_epoch_stats,METH_VARARGS, "Returns batch count, mean loss, wall time and input stall time of the last epoch"},
+	{"seed",(PyCFunction)nm_seed,METH_VARARGS, "Sets seed for learnable parameter initialization"},
+	{"release",(PyCFunction)nm_release,METH_VARARGS, "Releases memory related to model"},
+	{NULL,NULL,0,NULL}
+};
+
+PyMODINIT_FUNC PyInit_neuromorph(void){
+	static struct PyModuleDef neuromorphmodule = {
+		PyModuleDef_HEAD_INIT,
+		"neuromorph",
+		NULL,
+		-1,
+		NeuroMorph
+	};
+	return PyModule_Create(&neuromorphmodule);
+}
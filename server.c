@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "dataset.h"
+#include "trace.h"
+
+static uint8_t server_read(int fd, void* buffer, size_t size){
+	uint8_t* cursor = buffer;
+	while (size > 0){
+		ssize_t count = read(fd, cursor, size);
+		if (count < 0 && errno == EINTR){
+			continue;
+		}
+		if (count <= 0){
+			return 0;
+		}
+		cursor += count;
+		size -= count;
+	}
+	return 1;
+}
+
+static uint8_t server_write(int fd, const void* buffer, size_t size){
+	const uint8_t* cursor = buffer;
+	while (size > 0){
+		ssize_t count = send(fd, cursor, size, MSG_NOSIGNAL);
+		if (count < 0 && errno == EINTR){
+			continue;
+		}
+		if (count <= 0){
+			return 0;
+		}
+		cursor += count;
+		size -= count;
+	}
+	return 1;
+}
+
+static struct timespec server_deadline(double seconds){
+	struct timespec deadline;
+	deadline.tv_sec = (time_t)seconds;
+	deadline.tv_nsec = (long)((seconds-deadline.tv_sec)*1e9);
+	return deadline;
+}
+
+static int server_compare_latency(const void* a, const void* b){
+	double left = *(const double*)a;
+	double right = *(const double*)b;
+	return (left > right) - (left < right);
+}
+
+static void server_stop(neuromorph_server* server){
+	pthread_mutex_lock(&server->mutex);
+	server->stopping = 1;
+	shutdown(server->listen_fd, SHUT_RDWR);
+	pthread_cond_broadcast(&server->pending);
+	pthread_mutex_unlock(&server->mutex);
+}
+
+// caller holds the mutex
+void neuromorph_server_snapshot(neuromorph_server* server, neuromorph_server_stats* const stats){
+	size_t window = server->latency_count < NEUROMORPH_SERVE_LATENCY_WINDOW ? server->latency_count : NEUROMORPH_SERVE_LATENCY_WINDOW;
+	double sorted[NEUROMORPH_SERVE_LATENCY_WINDOW];
+	memcpy(sorted, server->latencies, sizeof(double)*window);
+	qsort(sorted, window, sizeof(double), server_compare_latency);
+	double elapsed = neuromorph_seconds()-server->started;
+	stats->requests = server->requests;
+	stats->batches = server->batches;
+	stats->mean_batch = server->batches ? (double)server->requests/server->batches : 0;
+	stats->p50 = window ? sorted[(size_t)((window-1)*0.50)]*1e6 : 0;
+	stats->p99 = window ? sorted[(size_t)((window-1)*0.99)]*1e6 : 0;
+	stats->throughput = elapsed > 0 ? server->requests/elapsed : 0;
+}
+
+/*
+ * Coalesces queued requests into batches of up to max_batch.
+ * A batch is dispatched once it is full or its oldest request has waited max_latency,
+ * then runs node by node across every sample so each weight matrix is streamed once per batch
+*/
+void* neuromorph_server_batcher(void* args){
+	neuromorph_server* server = args;
+	neuromorph* model = server->model;
+	const size_t max_batch = server->config.max_batch;
+	const size_t input_width = model->input->buffer_size;
+	const size_t output_width = model->output->buffer_size;
+	const size_t output_offset = model->output->backlog_offset+model->output->backlog_offset_activation;
+	float* rows = calloc(max_batch*model->backlog_size, sizeof(float));
+	float* recurrent_row = calloc(model->backlog_size, sizeof(float));
+	float* input = malloc(sizeof(float)*max_batch*input_width);
+	neuromorph_server_request** batch = malloc(sizeof(neuromorph_server_request*)*max_batch);
+	pthread_mutex_lock(&server->mutex);
+	while (!server->stopping || server->queued > 0){
+		if (server->queued == 0){
+			pthread_cond_wait(&server->pending, &server->mutex);
+			continue;
+		}
+		double deadline = server->head->queued+server->config.max_latency;
+		if (server->queued < max_batch && !server->stopping && neuromorph_seconds() < deadline){
+			struct timespec until = server_deadline(deadline);
+			pthread_cond_timedwait(&server->pending, &server->mutex, &until);
+			continue;
+		}
+		size_t count = 0;
+		while (server->head != NULL && count < max_batch){
+			batch[count++] = server->head;
+			server->head = server->head->next;
+		}
+		if (server->head == NULL){
+			server->tail = NULL;
+		}
+		server->queued -= count;
+		pthread_mutex_unlock(&server->mutex);
+		for (size_t i = 0;i<count;++i){
+			memcpy(input+(i*input_width), batch[i]->input, sizeof(float)*input_width);
+		}
+		NEUROMORPH_TRACE_BEGIN(start);
+		neuromorph_forward_rows(model, rows, recurrent_row, input, count);
+		NEUROMORPH_TRACE_END("serve batch", "serve", start, count);
+		for (size_t i = 0;i<count;++i){
+			memcpy(batch[i]->output, rows+(i*model->backlog_size)+output_offset, sizeof(float)*output_width);
+		}
+		double finished = neuromorph_seconds();
+		pthread_mutex_lock(&server->mutex);
+		for (size_t i = 0;i<count;++i){
+			server->latencies[server->latency_count%NEUROMORPH_SERVE_LATENCY_WINDOW] = finished-batch[i]->queued;
+			server->latency_count += 1;
+			batch[i]->done = 1;
+		}
+		server->requests += count;
+		server->batches += 1;
+		pthread_cond_broadcast(&server->completed);
+	}
+	pthread_mutex_unlock(&server->mutex);
+	free(rows);
+	free(recurrent_row);
+	free(input);
+	free(batch);
+	return NULL;
+}
+
+void* neuromorph_server_connection(void* args){
+	neuromorph_connection_args* connection = args;
+	neuromorph_server* server = connection->server;
+	int fd = connection->fd;
+	free(connection);
+	const size_t input_width = server->model->input->buffer_size;
+	const size_t output_width = server->model->output->buffer_size;
+	float* input = malloc(sizeof(float)*input_width);
+	float* output = malloc(sizeof(float)*output_width);
+	uint32_t type;
+	while (server_read(fd, &type, sizeof(type))){
+		if (type == NEUROMORPH_SERVE_PREDICT){
+			if (!server_read(fd, input, sizeof(float)*input_width)){
+				break;
+			}
+			neuromorph_server_request request = {input, output, neuromorph_seconds(), 0, NULL};
+			pthread_mutex_lock(&server->mutex);
+			if (server->stopping){
+				pthread_mutex_unlock(&server->mutex);
+				break;
+			}
+			if (server->tail == NULL){
+				server->head = &request;
+			}
+			else{
+				server->tail->next = &request;
+			}
+			server->tail = &request;
+			server->queued += 1;
+			pthread_cond_signal(&server->pending);
+			while (!request.done){
+				pthread_cond_wait(&server->completed, &server->mutex);
+			}
+			pthread_mutex_unlock(&server->mutex);
+			if (!server_write(fd, output, sizeof(float)*output_width)){
+				break;
+			}
+		}
+		else if (type == NEUROMORPH_SERVE_STATS){
+			neuromorph_server_stats stats;
+			pthread_mutex_lock(&server->mutex);
+			neuromorph_server_snapshot(server, &stats);
+			pthread_mutex_unlock(&server->mutex);
+			if (!server_write(fd, &stats, sizeof(stats))){
+				break;
+			}
+		}
+		else if (type == NEUROMORPH_SERVE_SHUTDOWN){
+			server_stop(server);
+			break;
+		}
+		else{
+			fprintf(stderr, "unknown request type %u, closing connection\n", type);
+			break;
+		}
+	}
+	free(input);
+	free(output);
+	pthread_mutex_lock(&server->mutex);
+	for (size_t i = 0;i<server->connection_count;++i){
+		if (server->connections[i] == fd){
+			server->connections[i] = server->connections[--server->connection_count];
+			break;
+		}
+	}
+	close(fd);
+	pthread_cond_broadcast(&server->completed);
+	pthread_mutex_unlock(&server->mutex);
+	return NULL;
+}
+
+/*
+ * Serves predictions for a built model on a unix socket until a client sends NEUROMORPH_SERVE_SHUTDOWN.
+ * Each client gets its own thread, a single batcher thread runs the model, so the model must not be trained meanwhile
+*/
+uint8_t neuromorph_serve(neuromorph* model, const neuromorph_server_config* const config){
+	if (model->schedule.size == 0){
+		fprintf(stderr, "only built models can be served\n");
+		return 0;
+	}
+	if (config->max_batch == 0){
+		fprintf(stderr, "max batch must be at least 1\n");
+		return 0;
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(config->socket_path) >= sizeof(address.sun_path)){
+		fprintf(stderr, "socket path %s is too long\n", config->socket_path);
+		return 0;
+	}
+	strcpy(address.sun_path, config->socket_path);
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0){
+		fprintf(stderr, "could not create socket\n");
+		return 0;
+	}
+	unlink(config->socket_path);
+	if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 64) != 0){
+		fprintf(stderr, "could not listen on %s\n", config->socket_path);
+		close(listen_fd);
+		return 0;
+	}
+	neuromorph_server* server = calloc(1, sizeof(neuromorph_server));
+	server->model = model;
+	server->config = *config;
+	server->listen_fd = listen_fd;
+	server->started = neuromorph_seconds();
+	server->connection_capacity = 16;
+	server->connections = malloc(sizeof(int)*server->connection_capacity);
+	pthread_mutex_init(&server->mutex, NULL);
+	pthread_condattr_t monotonic;
+	pthread_condattr_init(&monotonic);
+	pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+	pthread_cond_init(&server->pending, &monotonic);
+	pthread_condattr_destroy(&monotonic);
+	pthread_cond_init(&server->completed, NULL);
+	pthread_t batcher;
+	pthread_create(&batcher, NULL, neuromorph_server_batcher, server);
+	for (;;){
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			break;
+		}
+		pthread_mutex_lock(&server->mutex);
+		if (server->stopping){
+			pthread_mutex_unlock(&server->mutex);
+			close(fd);
+			break;
+		}
+		if (server->connection_count == server->connection_capacity){
+			server->connection_capacity *= 2;
+			server->connections = realloc(server->connections, sizeof(int)*server->connection_capacity);
+		}
+		server->connections[server->connection_count++] = fd;
+		pthread_mutex_unlock(&server->mutex);
+		neuromorph_connection_args* args = malloc(sizeof(neuromorph_connection_args));
+		args->server = server;
+		args->fd = fd;
+		pthread_t thread;
+		pthread_create(&thread, NULL, neuromorph_server_connection, args);
+		pthread_detach(thread);
+	}
+	server_stop(server);
+	pthread_join(batcher, NULL);
+	pthread_mutex_lock(&server->mutex);
+	for (size_t i = 0;i<server->connection_count;++i){
+		shutdown(server->connections[i], SHUT_RDWR);
+	}
+	while (server->connection_count > 0){
+		pthread_cond_wait(&server->completed, &server->mutex);
+	}
+	pthread_mutex_unlock(&server->mutex);
+	close(listen_fd);
+	unlink(config->socket_path);
+	pthread_cond_destroy(&server->pending);
+	pthread_cond_destroy(&server->completed);
+	pthread_mutex_destroy(&server->mutex);
+	free(server->connections);
+	free(server);
+	return 1;
+}
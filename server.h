@@ -0,0 +1,75 @@
+#ifndef NEUROMORPH_SERVER_H
+#define NEUROMORPH_SERVER_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "NeuroMorph.h"
+
+/* Wire protocol, host byte order, one unix stream socket per client
+ * every message starts with a uint32 type
+ * NEUROMORPH_SERVE_PREDICT is followed by input_width float32, answered with output_width float32
+ * NEUROMORPH_SERVE_STATS is answered with NEUROMORPH_SERVE_STAT_COUNT float64, laid out like neuromorph_server_stats
+ * NEUROMORPH_SERVE_SHUTDOWN stops the server once queued requests are answered, it has no reply
+*/
+#define NEUROMORPH_SERVE_PREDICT 1
+#define NEUROMORPH_SERVE_STATS 2
+#define NEUROMORPH_SERVE_SHUTDOWN 3
+
+#define NEUROMORPH_SERVE_STAT_COUNT 6
+#define NEUROMORPH_SERVE_LATENCY_WINDOW 4096
+
+typedef struct neuromorph_server_config{
+	const char* socket_path;
+	size_t max_batch;
+	double max_latency; // seconds the oldest queued request waits for others to join its batch
+}neuromorph_server_config;
+
+typedef struct neuromorph_server_stats{
+	double requests;
+	double batches;
+	double mean_batch;
+	double p50; // microseconds from a request being queued to its batch finishing, over the latency window
+	double p99;
+	double throughput; // requests per second since the server started
+}neuromorph_server_stats;
+
+typedef struct neuromorph_server_request{
+	const float* input;
+	float* output;
+	double queued;
+	uint8_t done;
+	struct neuromorph_server_request* next;
+}neuromorph_server_request;
+
+typedef struct neuromorph_server{
+	neuromorph* model;
+	neuromorph_server_config config;
+	int listen_fd;
+	neuromorph_server_request* head;
+	neuromorph_server_request* tail;
+	size_t queued;
+	uint8_t stopping;
+	int* connections;
+	size_t connection_count;
+	size_t connection_capacity;
+	double latencies[NEUROMORPH_SERVE_LATENCY_WINDOW];
+	size_t latency_count;
+	size_t requests;
+	size_t batches;
+	double started;
+	pthread_mutex_t mutex;
+	pthread_cond_t pending; // signalled when a request is queued or the server stops
+	pthread_cond_t completed; // signalled when a batch finishes or a connection closes
+}neuromorph_server;
+
+typedef struct neuromorph_connection_args{
+	neuromorph_server* server;
+	int fd;
+}neuromorph_connection_args;
+
+uint8_t neuromorph_serve(neuromorph* model, const neuromorph_server_config* const config);
+void neuromorph_server_snapshot(neuromorph_server* server, neuromorph_server_stats* const stats);
+void* neuromorph_server_batcher(void* args);
+void* neuromorph_server_connection(void* args);
+
+#endif
@@ -1,5 +1,6 @@
 from setuptools import setup, Extension
 import subprocess
+import os
 
 try:
     import cpuinfo
@@ -24,7 +25,9 @@ compile_options = {
     "fma": "-mfma"
 }
 
-module = Extension('neuromorph',sources=['NeuroMorph.c', 'hashmap.c'], extra_compile_args=['-lpthread','-lm']+[option for version, option in compile_options.items() if version in simd_version],define_macros=[(f"nm_{token}", "1") for token in simd_version])
+feature_macros = [(f"nm_{feature.lower()}", "1") for feature in ["PROFILE", "TRACE"] if os.environ.get(f"NM_{feature}")]
+
+module = Extension('neuromorph',sources=['NeuroMorph.c', 'hashmap.c', 'dataset.c', 'checkpoint.c', 'server.c', 'trace.c', 'perf.c', 'cost.c', 'gradcheck.c', 'python.c'], extra_compile_args=['-lpthread','-lm']+[option for version, option in compile_options.items() if version in simd_version],define_macros=[(f"nm_{token}", "1") for token in simd_version]+feature_macros)
 
 setup(
     name="NeuroMorph",
@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <unistd.h>
+
+#include "neuromorph_api.h"
+
+/*
+ * Drives libneuromorph through neuromorph_api.h alone, the way a C++ host links it:
+ * compiles and trains a model, checks the loss falls, saves and loads it, and checks the loaded model predicts the same
+*/
+
+#define API_TEST_BATCH 8
+#define API_TEST_BATCHES 64
+#define API_TEST_EPOCHS 20
+
+static const char* api_test_model = "/uniform -0.5 0.5,zero/ (input, 4) (a, 8, <tanh>) (output, 2, <sigmoid>, <mse>)";
+
+static int failures = 0;
+
+static void check(bool condition, const char* what){
+	if (!condition){
+		fprintf(stderr, "FAIL %s\n", what);
+		failures += 1;
+	}
+}
+
+// two smooth functions of the input, squashed into (0, 1)
+static void api_test_data(std::vector<float>& input, std::vector<float>& expected, size_t samples){
+	input.resize(samples*4);
+	expected.resize(samples*2);
+	for (size_t i = 0;i<samples;++i){
+		float* x = input.data()+(i*4);
+		for (size_t k = 0;k<4;++k){
+			x[k] = (float)rand()/(float)RAND_MAX;
+		}
+		expected[i*2] = 0.25f+(0.5f*x[0]*x[1]);
+		expected[(i*2)+1] = 0.5f+(0.25f*(x[2]-x[3]));
+	}
+}
+
+int main(){
+	srand(7);
+	neuromorph* model = neuromorph_compile(api_test_model, API_TEST_BATCH, 0.5);
+	check(model != NULL, "compile");
+	if (!model){
+		return 1;
+	}
+	check(!neuromorph_set_accumulation(model, 4), "accumulation is refused before build");
+	neuromorph_build(model);
+	neuromorph_set_workers(model, 2);
+	check(neuromorph_input_width(model) == 4, "input width");
+	check(neuromorph_output_width(model) == 2, "output width");
+	check(neuromorph_batch_size(model) == API_TEST_BATCH, "batch size");
+	const size_t samples = API_TEST_BATCH*API_TEST_BATCHES;
+	std::vector<float> input;
+	std::vector<float> expected;
+	api_test_data(input, expected, samples);
+	std::vector<float> losses(samples);
+	float before = neuromorph_evaluate(model, input.data(), expected.data(), samples, losses.data());
+	for (size_t epoch = 0;epoch<API_TEST_EPOCHS;++epoch){
+		for (size_t batch = 0;batch<API_TEST_BATCHES;++batch){
+			const size_t offset = batch*API_TEST_BATCH;
+			float loss = neuromorph_train_batch(model, input.data()+(offset*4), expected.data()+(offset*2), 0);
+			check(std::isfinite(loss), "finite training loss");
+		}
+	}
+	float after = neuromorph_evaluate(model, input.data(), expected.data(), samples, losses.data());
+	printf("evaluate loss %.6f before training, %.6f after\n", before, after);
+	check(after < before*0.5f, "training lowers the loss");
+	std::vector<float> trained(samples*2);
+	neuromorph_context* context = neuromorph_context_init(model);
+	neuromorph_predict(context, input.data(), trained.data(), samples);
+	neuromorph_context_free(context);
+	char path[] = "/tmp/neuromorph_api_testXXXXXX";
+	int fd = mkstemp(path);
+	check(fd >= 0, "temporary checkpoint");
+	if (fd >= 0){
+		close(fd);
+		check(neuromorph_save(model, path), "save");
+		neuromorph* loaded = neuromorph_load(path);
+		check(loaded != NULL, "load");
+		if (loaded){
+			std::vector<float> restored(samples*2);
+			neuromorph_context* loaded_context = neuromorph_context_init(loaded);
+			neuromorph_predict(loaded_context, input.data(), restored.data(), samples);
+			neuromorph_context_free(loaded_context);
+			check(memcmp(trained.data(), restored.data(), sizeof(float)*samples*2) == 0, "loaded model predicts like the saved one");
+			neuromorph_free(loaded);
+		}
+		remove(path);
+	}
+	neuromorph_free(model);
+	if (failures){
+		fprintf(stderr, "api_test: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("api_test: ok\n");
+	return 0;
+}
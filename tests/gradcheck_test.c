@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "NeuroMorph.h"
+#include "gradcheck.h"
+
+/*
+ * Gradient check test, every activation, loss and convergence kernel, then each README example model
+ * at every precision tier. Built once with the SIMD paths and once scalar, so both kernel sets are covered
+*/
+
+static const char* gradcheck_models[][2] = {
+	{"small", "/normal 0 0.1,zero/ (input, 4) {gate, recur, additive} (a, 4, <relu, 5.9>) (b, 4, <swish, 5.9>) [link,[recur,]] (output, 4, <sigmoid>, <mse, 4>)"},
+	{"big", "/xavier,const_uneven 0.1 0.3/ (input, 4) (a, 4, <sigmoid>) {c2, g, additive} (b, 4, <relu>) [b1, (d, 4, <softmax>) {standby, stalerecur, additive} (e, 4, <softmax>) | (f, 4, <relu>) [stale,[stalerecur,]] (g, 4, <relu>) ] (c, 4, <sigmoid>) {c1, e, additive} (output, 4, <sigmoid>, <huber_modified, 2.4>)"},
+	{"gated", "/uniform 0 0.5,const_uneven 0.1 0.2/ (input, 4) {gate, doubleforget, additive} (a, 4, <relu>) (b, 4, <swish, 5.9>) [link,(forget, 4, <tanh>)(doubleforget, 4, <tanh>)] (output, 4, <sigmoid>, <mse>)"},
+	{"lstm", "/xavier,const_flat 0.5/ (input, 4) {a, lastrecur, additive} [b, (include, 4, <sigmoid>) | (process, 4, <tanh>) {pi, include, multiplicative} | (add, 4, <sigmoid>) ] (forget, 4, <sigmoid>) {state0, prevstaterecur, multiplicative} {state1, pi, additive} [prevstate,[prevstaterecur,]] (statep, 4, <tanh>) {lastc, add, multiplicative} [last,[lastrecur,]] (output, 4, <tanh>, <mse>)"}
+};
+
+#define GRADCHECK_TEST_MODELS (sizeof(gradcheck_models)/sizeof(gradcheck_models[0]))
+
+void gradcheck_test_report(const char* model, const neuromorph_gradcheck* const result){
+	fprintf(stderr, "gradcheck_test: %s %s %s at %s, max error %.2e of %.0e, analytic %.6g numeric %.6g\n",
+		model, result->kind, result->name,
+		result->precision < NEUROMORPH_PRECISIONS ? neuromorph_precision_name(result->precision) : "-",
+		result->max_error, result->tolerance, result->analytic, result->numeric
+	);
+}
+
+int main(){
+	srand(3);
+	size_t failed = 0;
+	size_t checks = 0;
+	neuromorph_gradcheck results[NEUROMORPH_GRADCHECK_KERNELS];
+	size_t count = neuromorph_gradcheck_kernels(results, NEUROMORPH_GRADCHECK_KERNELS);
+	for (size_t i = 0;i<count;++i){
+		checks += 1;
+		if (!results[i].passed){
+			gradcheck_test_report("kernel", results+i);
+			failed += 1;
+		}
+	}
+	for (size_t i = 0;i<GRADCHECK_TEST_MODELS;++i){
+		neuromorph* model = neuromorph_compile(gradcheck_models[i][1], 1, 0.01);
+		if (model == NULL){
+			fprintf(stderr, "gradcheck_test: could not compile model %s\n", gradcheck_models[i][0]);
+			return 1;
+		}
+		neuromorph_build(model);
+		for (uint8_t precision = 0;precision<NEUROMORPH_PRECISIONS;++precision){
+			neuromorph_gradcheck result;
+			neuromorph_set_precision(model, precision);
+			checks += 1;
+			if (!neuromorph_gradcheck_model(model, &result) || !result.passed){
+				gradcheck_test_report(gradcheck_models[i][0], &result);
+				failed += 1;
+			}
+		}
+		neuromorph_free(model);
+	}
+	printf("%zu gradient checks, %zu failed\n", checks, failed);
+	if (failed){
+		return 1;
+	}
+	printf("gradcheck_test: ok\n");
+	return 0;
+}
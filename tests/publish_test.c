@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "neuromorph_api.h"
+
+/*
+ * Publication stress test, readers predict on their own contexts while the main thread
+ * keeps swapping between two parameter sets. Every output has to match the reference of one set,
+ * a torn read would mix weights from both, and under ASan a premature free of an old arena fails the run
+*/
+
+#define PUBLISH_READERS 4
+#define PUBLISH_SWAPS 2000
+#define PUBLISH_SAMPLES 8
+
+typedef struct publish_reader{
+	neuromorph* model;
+	const float* input;
+	const float* reference[2];
+	size_t output_width;
+	volatile uint8_t* done;
+	size_t predictions;
+	size_t mismatches;
+}publish_reader;
+
+uint8_t publish_matches(const float* output, const float* reference, size_t width){
+	return memcmp(output, reference, sizeof(float)*width) == 0;
+}
+
+void* publish_read(void* args){
+	publish_reader* reader = args;
+	neuromorph_context* context = neuromorph_context_init(reader->model);
+	float* output = malloc(sizeof(float)*reader->output_width*PUBLISH_SAMPLES);
+	while (!__atomic_load_n(reader->done, __ATOMIC_ACQUIRE) || reader->predictions == 0){
+		neuromorph_predict(context, reader->input, output, PUBLISH_SAMPLES);
+		for (size_t i = 0;i<PUBLISH_SAMPLES;++i){
+			size_t offset = i*reader->output_width;
+			if (!publish_matches(output+offset, reader->reference[0]+offset, reader->output_width)
+			 && !publish_matches(output+offset, reader->reference[1]+offset, reader->output_width)){
+				reader->mismatches += 1;
+			}
+		}
+		reader->predictions += 1;
+	}
+	free(output);
+	neuromorph_context_free(context);
+	return NULL;
+}
+
+int main(){
+	srand(7);
+	neuromorph* model = neuromorph_compile(
+		"/uniform -0.5 0.5,zero/ (input, 6) (a, 16, <tanh>) (b, 16, <relu>) (output, 3, <sigmoid>, <mse>)",
+		1,
+		0.1
+	);
+	if (model == NULL){
+		fprintf(stderr, "publish_test: could not compile model\n");
+		return 1;
+	}
+	neuromorph_build(model);
+	size_t input_width = neuromorph_input_width(model);
+	size_t output_width = neuromorph_output_width(model);
+	size_t count = neuromorph_parameter_count(model);
+	float* sets[2] = {malloc(sizeof(float)*count), malloc(sizeof(float)*count)};
+	neuromorph_get_parameters(model, sets[0]);
+	for (size_t i = 0;i<count;++i){
+		sets[1][i] = ((float)rand()/RAND_MAX)-0.5;
+	}
+	float* input = malloc(sizeof(float)*input_width*PUBLISH_SAMPLES);
+	for (size_t i = 0;i<input_width*PUBLISH_SAMPLES;++i){
+		input[i] = ((float)rand()/RAND_MAX)*2-1;
+	}
+	float* reference[2];
+	neuromorph_context* context = neuromorph_context_init(model);
+	for (size_t set = 0;set<2;++set){
+		reference[set] = malloc(sizeof(float)*output_width*PUBLISH_SAMPLES);
+		neuromorph_publish(model, sets[set]);
+		neuromorph_predict(context, input, reference[set], PUBLISH_SAMPLES);
+	}
+	neuromorph_context_free(context);
+	if (memcmp(reference[0], reference[1], sizeof(float)*output_width*PUBLISH_SAMPLES) == 0){
+		fprintf(stderr, "publish_test: parameter sets give identical outputs\n");
+		return 1;
+	}
+	volatile uint8_t done = 0;
+	pthread_t threads[PUBLISH_READERS];
+	publish_reader readers[PUBLISH_READERS];
+	for (size_t i = 0;i<PUBLISH_READERS;++i){
+		readers[i] = (publish_reader){model, input, {reference[0], reference[1]}, output_width, &done, 0, 0};
+		pthread_create(&threads[i], NULL, publish_read, &readers[i]);
+	}
+	uint8_t failed = 0;
+	for (size_t i = 0;i<PUBLISH_SWAPS;++i){
+		if (!neuromorph_publish(model, sets[i&1])){
+			fprintf(stderr, "publish_test: publish %zu failed\n", i);
+			failed = 1;
+			break;
+		}
+	}
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	size_t predictions = 0;
+	for (size_t i = 0;i<PUBLISH_READERS;++i){
+		pthread_join(threads[i], NULL);
+		predictions += readers[i].predictions;
+		if (readers[i].mismatches){
+			fprintf(stderr, "publish_test: reader %zu saw %zu outputs matching neither parameter set\n", i, readers[i].mismatches);
+			failed = 1;
+		}
+	}
+	printf("%d publishes across %zu predictions\n", PUBLISH_SWAPS, predictions);
+	for (size_t set = 0;set<2;++set){
+		free(sets[set]);
+		free(reference[set]);
+	}
+	free(input);
+	neuromorph_free(model);
+	if (failed){
+		return 1;
+	}
+	printf("publish_test: ok\n");
+	return 0;
+}
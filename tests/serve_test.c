@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "NeuroMorph.h"
+#include "server.h"
+
+/*
+ * Serving test, neuromorph_serve runs on a socket in a temporary directory while several clients
+ * send PREDICT concurrently, every answer has to equal neuromorph_predict on the same input.
+ * Then STATS has to account for every request, and SHUTDOWN has to make neuromorph_serve return
+*/
+
+#define SERVE_CLIENTS 6
+#define SERVE_REQUESTS 200
+#define SERVE_SAMPLES 32
+
+typedef struct serve_client{
+	const char* socket_path;
+	const float* input;
+	const float* reference;
+	size_t input_width;
+	size_t output_width;
+	size_t offset;
+	size_t answered;
+	size_t mismatches;
+}serve_client;
+
+typedef struct serve_server{
+	neuromorph* model;
+	neuromorph_server_config config;
+	uint8_t result;
+}serve_server;
+
+uint8_t serve_read(int fd, void* buffer, size_t size){
+	char* cursor = buffer;
+	while (size > 0){
+		ssize_t got = read(fd, cursor, size);
+		if (got <= 0){
+			return 0;
+		}
+		cursor += got;
+		size -= got;
+	}
+	return 1;
+}
+
+uint8_t serve_write(int fd, const void* buffer, size_t size){
+	const char* cursor = buffer;
+	while (size > 0){
+		ssize_t sent = write(fd, cursor, size);
+		if (sent <= 0){
+			return 0;
+		}
+		cursor += sent;
+		size -= sent;
+	}
+	return 1;
+}
+
+// the server binds asynchronously, so retry until it listens
+int serve_connect(const char* socket_path){
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	for (size_t attempt = 0;attempt<500;++attempt){
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0){
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0){
+			return fd;
+		}
+		close(fd);
+		usleep(10000);
+	}
+	return -1;
+}
+
+void* serve_run(void* args){
+	serve_server* server = args;
+	server->result = neuromorph_serve(server->model, &server->config);
+	return NULL;
+}
+
+void* serve_request(void* args){
+	serve_client* client = args;
+	int fd = serve_connect(client->socket_path);
+	if (fd < 0){
+		return NULL;
+	}
+	float* output = malloc(sizeof(float)*client->output_width);
+	uint32_t type = NEUROMORPH_SERVE_PREDICT;
+	for (size_t i = 0;i<SERVE_REQUESTS;++i){
+		size_t sample = (client->offset+i)%SERVE_SAMPLES;
+		if (!serve_write(fd, &type, sizeof(type))
+		 || !serve_write(fd, client->input+(sample*client->input_width), sizeof(float)*client->input_width)
+		 || !serve_read(fd, output, sizeof(float)*client->output_width)){
+			break;
+		}
+		client->answered += 1;
+		if (memcmp(output, client->reference+(sample*client->output_width), sizeof(float)*client->output_width) != 0){
+			client->mismatches += 1;
+		}
+	}
+	free(output);
+	close(fd);
+	return NULL;
+}
+
+int main(){
+	srand(11);
+	char directory[] = "/tmp/neuromorph_serve_XXXXXX";
+	if (mkdtemp(directory) == NULL){
+		fprintf(stderr, "serve_test: could not create a temporary directory\n");
+		return 1;
+	}
+	char socket_path[64];
+	snprintf(socket_path, sizeof(socket_path), "%s/serve.sock", directory);
+	neuromorph* model = neuromorph_compile(
+		"/uniform -0.5 0.5,zero/ (input, 5) (a, 12, <tanh>) (b, 12, <relu>) (output, 4, <sigmoid>, <mse>)",
+		1,
+		0.1
+	);
+	if (model == NULL){
+		fprintf(stderr, "serve_test: could not compile model\n");
+		return 1;
+	}
+	neuromorph_build(model);
+	size_t input_width = neuromorph_input_width(model);
+	size_t output_width = neuromorph_output_width(model);
+	float* input = malloc(sizeof(float)*input_width*SERVE_SAMPLES);
+	for (size_t i = 0;i<input_width*SERVE_SAMPLES;++i){
+		input[i] = ((float)rand()/RAND_MAX)*2-1;
+	}
+	float* reference = malloc(sizeof(float)*output_width*SERVE_SAMPLES);
+	neuromorph_context* context = neuromorph_context_init(model);
+	neuromorph_predict(context, input, reference, SERVE_SAMPLES);
+	neuromorph_context_free(context);
+	serve_server server = {model, {socket_path, 8, 0.001}, 0};
+	pthread_t server_thread;
+	pthread_create(&server_thread, NULL, serve_run, &server);
+	pthread_t threads[SERVE_CLIENTS];
+	serve_client clients[SERVE_CLIENTS];
+	for (size_t i = 0;i<SERVE_CLIENTS;++i){
+		clients[i] = (serve_client){socket_path, input, reference, input_width, output_width, i*5, 0, 0};
+		pthread_create(&threads[i], NULL, serve_request, &clients[i]);
+	}
+	uint8_t failed = 0;
+	size_t answered = 0;
+	for (size_t i = 0;i<SERVE_CLIENTS;++i){
+		pthread_join(threads[i], NULL);
+		answered += clients[i].answered;
+		if (clients[i].answered != SERVE_REQUESTS){
+			fprintf(stderr, "serve_test: client %zu got %zu of %d answers\n", i, clients[i].answered, SERVE_REQUESTS);
+			failed = 1;
+		}
+		if (clients[i].mismatches){
+			fprintf(stderr, "serve_test: client %zu got %zu answers differing from neuromorph_predict\n", i, clients[i].mismatches);
+			failed = 1;
+		}
+	}
+	int fd = serve_connect(socket_path);
+	if (fd < 0){
+		fprintf(stderr, "serve_test: could not connect to %s\n", socket_path);
+		return 1;
+	}
+	neuromorph_server_stats stats;
+	uint32_t type = NEUROMORPH_SERVE_STATS;
+	if (!serve_write(fd, &type, sizeof(type)) || !serve_read(fd, &stats, sizeof(stats))){
+		fprintf(stderr, "serve_test: no answer to STATS\n");
+		failed = 1;
+	}
+	else{
+		printf("%.0f requests in %.0f batches, mean batch %.2f, p50 %.1fus, p99 %.1fus\n", stats.requests, stats.batches, stats.mean_batch, stats.p50, stats.p99);
+		if (stats.requests != answered || stats.batches < 1 || stats.batches > stats.requests){
+			fprintf(stderr, "serve_test: STATS counted %.0f requests in %.0f batches for %zu answers\n", stats.requests, stats.batches, answered);
+			failed = 1;
+		}
+	}
+	type = NEUROMORPH_SERVE_SHUTDOWN;
+	serve_write(fd, &type, sizeof(type));
+	close(fd);
+	pthread_join(server_thread, NULL);
+	if (!server.result){
+		fprintf(stderr, "serve_test: neuromorph_serve failed\n");
+		failed = 1;
+	}
+	if (access(socket_path, F_OK) == 0){
+		fprintf(stderr, "serve_test: socket %s left behind\n", socket_path);
+		failed = 1;
+	}
+	rmdir(directory);
+	free(input);
+	free(reference);
+	neuromorph_free(model);
+	if (failed){
+		return 1;
+	}
+	printf("serve_test: ok\n");
+	return 0;
+}
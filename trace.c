@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+#ifdef nm_trace
+
+static neuromorph_trace_buffer* trace_buffers = NULL;
+static size_t trace_reserved = 0;
+static size_t trace_max_events = 0;
+static size_t trace_dropped = 0;
+static uint64_t trace_origin = 0;
+static uint8_t trace_enabled = 0;
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static __thread neuromorph_trace_buffer* trace_local = NULL;
+static __thread int32_t trace_tid = 0;
+
+// runs when a thread that recorded exits, its buffer can then be claimed by the next thread
+static void trace_release(void* buffer){
+	__atomic_store_n(&((neuromorph_trace_buffer*)buffer)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void trace_key_init(){
+	pthread_key_create(&trace_key, trace_release);
+}
+
+// claims a free buffer, one with room left in this trace when reserved is set, otherwise one not used yet in this trace
+static neuromorph_trace_buffer* trace_claim(uint8_t reserved){
+	for (neuromorph_trace_buffer* buffer = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);buffer != NULL;buffer = buffer->next){
+		uint8_t free_buffer = 0;
+		if (__atomic_load_n(&buffer->owned, __ATOMIC_RELAXED)){
+			continue;
+		}
+		if (!__atomic_compare_exchange_n(&buffer->owned, &free_buffer, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+			continue;
+		}
+		if (reserved ? buffer->count < buffer->limit : buffer->limit == 0){
+			return buffer;
+		}
+		trace_release(buffer);
+	}
+	return NULL;
+}
+
+static neuromorph_trace_buffer* trace_acquire(){
+	neuromorph_trace_buffer* buffer = trace_claim(1);
+	if (buffer != NULL){
+		return buffer;
+	}
+	size_t reserved = __atomic_load_n(&trace_reserved, __ATOMIC_RELAXED);
+	size_t take;
+	do{
+		if (reserved >= trace_max_events){
+			return NULL;
+		}
+		take = trace_max_events-reserved < NEUROMORPH_TRACE_BUFFER_EVENTS ? trace_max_events-reserved : NEUROMORPH_TRACE_BUFFER_EVENTS;
+	}while (!__atomic_compare_exchange_n(&trace_reserved, &reserved, reserved+take, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	buffer = trace_claim(0);
+	if (buffer == NULL){
+		buffer = malloc(sizeof(neuromorph_trace_buffer));
+		if (!buffer){
+			__atomic_sub_fetch(&trace_reserved, take, __ATOMIC_RELAXED);
+			return NULL;
+		}
+		buffer->owned = 1;
+		buffer->count = 0;
+		buffer->next = __atomic_load_n(&trace_buffers, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&trace_buffers, &buffer->next, buffer, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){}
+	}
+	buffer->limit = take;
+	return buffer;
+}
+
+/*
+ * Clears every recorded span and starts recording, at most max_events are kept, later spans are counted as dropped.
+ * Buffers are reused rather than freed, so threads still holding one stay valid. Not safe while traced work is running
+*/
+void neuromorph_trace_start(size_t max_events){
+	pthread_once(&trace_key_once, trace_key_init);
+	__atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+	for (neuromorph_trace_buffer* buffer = trace_buffers;buffer != NULL;buffer = buffer->next){
+		buffer->count = 0;
+		buffer->limit = 0;
+	}
+	trace_reserved = 0;
+	trace_max_events = max_events;
+	trace_dropped = 0;
+	trace_origin = neuromorph_nanoseconds();
+	__atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+}
+
+void neuromorph_trace_stop(){
+	__atomic_store_n(&trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+void neuromorph_trace_record(const char* name, const char* category, uint64_t start, uint64_t end, uint64_t count){
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_ACQUIRE)){
+		return;
+	}
+	if (trace_tid == 0){
+		trace_tid = syscall(SYS_gettid);
+	}
+	neuromorph_trace_buffer* buffer = trace_local;
+	if (buffer == NULL || buffer->count >= buffer->limit){
+		if (buffer != NULL){
+			trace_release(buffer);
+		}
+		buffer = trace_acquire();
+		trace_local = buffer;
+		pthread_setspecific(trace_key, buffer);
+		if (buffer == NULL){
+			__atomic_add_fetch(&trace_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+	neuromorph_trace_event* event = buffer->events+buffer->count;
+	event->name = name;
+	event->category = category;
+	event->start = start;
+	event->end = end;
+	event->count = count;
+	event->tid = trace_tid;
+	__atomic_store_n(&buffer->count, buffer->count+1, __ATOMIC_RELEASE);
+}
+
+static void trace_string(FILE* outfile, const char* text){
+	fputc('"', outfile);
+	for (;*text;++text){
+		if (*text == '"' || *text == '\\'){
+			fputc('\\', outfile);
+		}
+		fputc(*text, outfile);
+	}
+	fputc('"', outfile);
+}
+
+/*
+ * Writes every span recorded since neuromorph_trace_start as complete ("X") events, timestamps in microseconds from the start.
+ * Call once traced work has returned, spans still being written by other threads may be missed
+*/
+uint8_t neuromorph_trace_dump(const char* path){
+	FILE* outfile = fopen(path, "w");
+	if (!outfile){
+		fprintf(stderr, "could not open trace %s for writing\n", path);
+		return 0;
+	}
+	const int pid = getpid();
+	fprintf(outfile, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":%lu},\"traceEvents\":[\n", __atomic_load_n(&trace_dropped, __ATOMIC_RELAXED));
+	uint8_t first = 1;
+	for (neuromorph_trace_buffer* buffer = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);buffer != NULL;buffer = buffer->next){
+		size_t count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+		for (size_t i = 0;i<count;++i){
+			const neuromorph_trace_event* event = buffer->events+i;
+			uint64_t start = event->start > trace_origin ? event->start-trace_origin : 0;
+			uint64_t end = event->end > trace_origin ? event->end-trace_origin : 0;
+			fputs(first ? "{\"name\":" : ",\n{\"name\":", outfile);
+			trace_string(outfile, event->name);
+			fputs(",\"cat\":", outfile);
+			trace_string(outfile, event->category);
+			fprintf(outfile, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+				pid, event->tid, start/1000.0, (end-start)/1000.0
+			);
+			if (event->count){
+				fprintf(outfile, ",\"args\":{\"samples\":%lu}", event->count);
+			}
+			fputc('}', outfile);
+			first = 0;
+		}
+	}
+	fputs("\n]}\n", outfile);
+	if (fclose(outfile) != 0){
+		fprintf(stderr, "failed writing trace %s\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef NEUROMORPH_TRACE_H
+#define NEUROMORPH_TRACE_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "NeuroMorph.h"
+
+/* Execution timeline, compiled in only with nm_trace
+ * every thread appends spans to a buffer it owns, so recording takes no locks,
+ * buffers are claimed with a compare and swap and handed back when the thread exits.
+ * neuromorph_trace_dump writes every span as Chrome trace event JSON, viewable in chrome://tracing or Perfetto.
+ * Span names point at node names and string literals, so dump before freeing the traced models
+*/
+#define NEUROMORPH_TRACE_BUFFER_EVENTS 1024
+#define NEUROMORPH_TRACE_DEFAULT_EVENTS (1<<20)
+
+typedef struct neuromorph_trace_event{
+	const char* name;
+	const char* category;
+	uint64_t start;
+	uint64_t end;
+	uint64_t count; // samples the span covered, 0 when it is not per sample work
+	int32_t tid;
+}neuromorph_trace_event;
+
+typedef struct neuromorph_trace_buffer{
+	struct neuromorph_trace_buffer* next;
+	uint8_t owned;
+	size_t count;
+	size_t limit; // events reserved for this buffer in the current trace, 0 until a thread claims it
+	neuromorph_trace_event events[NEUROMORPH_TRACE_BUFFER_EVENTS];
+}neuromorph_trace_buffer;
+
+#ifdef nm_trace
+#define NEUROMORPH_TRACE_BEGIN(start) const uint64_t start = neuromorph_nanoseconds()
+#define NEUROMORPH_TRACE_END(name, category, start, count) neuromorph_trace_record(name, category, start, neuromorph_nanoseconds(), count)
+
+void neuromorph_trace_start(size_t max_events);
+void neuromorph_trace_stop();
+uint8_t neuromorph_trace_dump(const char* path);
+void neuromorph_trace_record(const char* name, const char* category, uint64_t start, uint64_t end, uint64_t count);
+#else
+#define NEUROMORPH_TRACE_BEGIN(start)
+#define NEUROMORPH_TRACE_END(name, category, start, count)
+#endif
+
+#endif